@@ -1,13 +1,15 @@
 #include "Agent.h"
 #include "Application.h"
 #include "ModuleNetworkManager.h"
+#include "ModuleNodeCluster.h"
 
 uint16_t g_IdCounter = 1;
 
 Agent::Agent(Node *node) :
 	_destroyFlag(false),
 	_node(node),
-	_id(g_IdCounter++)
+	_id(g_IdCounter++),
+	_yellowPagesRequestId(0)
 {
 }
 
@@ -18,72 +20,86 @@ Agent::~Agent()
 
 bool Agent::sendPacketToYellowPages(OutputMemoryStream &stream)
 {
-	// Create socket
-	TCPSocketPtr agentSocket = SocketUtil::CreateTCPSocket(SocketAddressFamily::INET);
-	if (agentSocket == nullptr) {
-		eLog << "SocketUtil::CreateTCPSocket() failed";
+	const SocketAddress &address = App->modNodeCluster->yellowPagesAddress();
+	if (!address.IsValid()) {
+		eLog << "Agent::sendPacketToYellowPages() - YellowPages address not resolved";
 		return false;
 	}
+	return sendPacketToAgent(address, stream);
+}
 
-	// Connect to Yellow Pages
-	char addressAndPort[128];
-	sprintf_s(addressAndPort, "%s:%d", HOSTNAME_YP, LISTEN_PORT_YP);
-	SocketAddress yellowPagesAddress(addressAndPort);
-	int res = agentSocket->Connect(yellowPagesAddress);
-	if (res != NO_ERROR) {
-		eLog << "TCPSocket::Connect() failed";
+bool Agent::sendPacketToAgent(const SocketAddress &address, OutputMemoryStream &stream)
+{
+	// Get the (shared) connection to the remote host
+	TCPSocketPtr socket = App->networkManager->GetConnection(address);
+	if (socket == nullptr) {
+		eLog << "ModuleNetworkManager::GetConnection() failed";
 		return false;
 	}
 
-	// Add socket to the network manager
-	App->networkManager->AddSocket(agentSocket);
+	// Get notified if the connection cannot be established
+	if (socket->IsConnecting()) {
+		App->modNodeCluster->WaitForConnection(socket->GetHandle(), id());
+	}
 
-	// Add socket to the list of sockets of this agent
-	_sockets.push_back(agentSocket);
+	App->networkManager->rttStats().packetSent(id(), stream.GetBufferPtr(), stream.GetSize());
 
-	// Append data
-	agentSocket->SendPacket(stream.GetBufferPtr(), stream.GetSize());
+	// Append data (queued until connected), replies will be routed
+	// back to this agent by the PacketHeader::dstAgentId field.
+	// Agents only send small requests, which go ahead of bulk replies.
+	if (!socket->SendPacket(std::move(stream), PacketPriority::High)) {
+		eLog << "TCPSocket::SendPacket() failed - outgoing buffer full";
+		return false;
+	}
 	return true;
 }
 
-bool Agent::sendPacketToAgent(const std::string &ip, uint16_t port, OutputMemoryStream &stream)
+bool Agent::sendRequestToYellowPages(OutputMemoryStream &stream)
 {
-	// Create socket
-	TCPSocketPtr agentSocket = SocketUtil::CreateTCPSocket(SocketAddressFamily::INET);
-	if (agentSocket == nullptr) {
-		eLog << "SocketUtil::CreateTCPSocket() failed";
+	const SocketAddress &address = App->modNodeCluster->yellowPagesAddress();
+	if (!address.IsValid()) {
+		eLog << "Agent::sendRequestToYellowPages() - YellowPages address not resolved";
 		return false;
 	}
+	return sendRequestToAgent(address, stream);
+}
 
-	// Connect to Yellow Pages
-	char addressAndPort[128];
-	sprintf_s(addressAndPort, "%s:%d", ip.c_str(), port);
-	SocketAddress yellowPagesAddress(addressAndPort);
-	int res = agentSocket->Connect(yellowPagesAddress);
-	if (res != NO_ERROR) {
-		eLog << "TCPSocket::Connect() failed";
-		return false;
+bool Agent::sendRequestToAgent(const SocketAddress &address, OutputMemoryStream &stream)
+{
+	// Agents of this process are reached without the network anyway
+	if (App->networkManager->useUdpRpc() && !App->networkManager->IsLocalAddress(address))
+	{
+		// Responses are routed back to this agent by the PacketHeader::dstAgentId
+		// field, failed requests are sent again through sendPacketToAgent
+		const uint32_t requestId = App->networkManager->rpcChannel().SendRequest(address, stream.GetBufferPtr(), stream.GetSize());
+		if (requestId != 0) {
+			App->networkManager->rttStats().packetSent(id(), stream.GetBufferPtr(), stream.GetSize());
+			App->modNodeCluster->WaitForResponse(requestId, id(), address);
+			return true;
+		}
 	}
 
-	// Add socket to the network manager
-	App->networkManager->AddSocket(agentSocket);
+	return sendPacketToAgent(address, stream);
+}
+
+void Agent::tagYellowPagesRequest(PacketHeader &packetHeader)
+{
+	_yellowPagesRequestId = App->modNodeCluster->NewYellowPagesRequest(id());
+	packetHeader.requestId = _yellowPagesRequestId;
+}
 
-	// Add socket to the list of sockets of this agent
-	_sockets.push_back(agentSocket);
+void Agent::OnConnectFailed(SocketHandle socket)
+{
+	wLog << "OnConnectFailed() - Could not connect to " << App->networkManager->GetSocket(socket)->RemoteAddress().GetString();
+}
 
-	// Append data
-	agentSocket->SendPacket(stream.GetBufferPtr(), stream.GetSize());
-	return true;
+void Agent::OnRpcResponse(const PacketHeader &packetHeader, InputMemoryStream &)
+{
+	wLog << "OnRpcResponse() - Unexpected PacketType: " << PacketTypeName(packetHeader.packetType);
 }
 
 void Agent::destroy()
 {
 	// Tell the AgentContainer to remove this Agent
 	_destroyFlag = true;
-
-	// Disconnect all sockets used by this agent
-	for (auto socket : _sockets) {
-		socket->Disconnect();
-	}
-	_sockets.clear();
 }
\ No newline at end of file
@@ -3,8 +3,10 @@
 #include "Log.h"
 #include "Packets.h"
 #include "Node.h"
+#include <initializer_list>
 #include <list>
 #include <memory>
+#include <utility>
 
 // Concrete agent declarations
 class MCC;
@@ -13,6 +15,50 @@ class UCC;
 class UCP;
 
 
+/**
+ * Packet handlers of an agent class indexed by PacketType, so that
+ * packets are dispatched without going through all the types. It also
+ * counts the packets of each type received by agents of the class.
+ */
+template <class AgentClass>
+class PacketHandlerTable
+{
+public:
+
+	using Handler = void (AgentClass::*)(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream);
+
+	PacketHandlerTable(std::initializer_list<std::pair<PacketType, Handler>> handlers)
+	{
+		for (size_t i = 0; i < PACKET_TYPE_COUNT; ++i) {
+			_handlers[i] = nullptr;
+			_receivedCounts[i] = 0;
+		}
+		for (const auto &handler : handlers) {
+			_handlers[static_cast<size_t>(handler.first)] = handler.second;
+		}
+	}
+
+	// It returns false if agents of this class do not handle the packet type
+	bool dispatch(AgentClass &agent, SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream)
+	{
+		const size_t index = static_cast<size_t>(packetHeader.packetType);
+		if (index >= PACKET_TYPE_COUNT || _handlers[index] == nullptr) {
+			return false;
+		}
+		_receivedCounts[index]++;
+		(agent.*_handlers[index])(socket, packetHeader, stream);
+		return true;
+	}
+
+	uint32_t receivedCount(PacketType packetType) const { return _receivedCounts[static_cast<size_t>(packetType)]; }
+
+private:
+
+	Handler _handlers[PACKET_TYPE_COUNT];
+	uint32_t _receivedCounts[PACKET_TYPE_COUNT]; /**< Packets dispatched per type. */
+};
+
+
 class Agent
 {
 public:
@@ -51,12 +97,38 @@ public:
 
 	// Networking methods /////////////////////////////////////////////
 
-	// Packet send functions
+	// Packet send functions (the stream buffer is handed over to the socket)
 	bool sendPacketToYellowPages(OutputMemoryStream &stream);
-	bool sendPacketToAgent(const std::string &ip, uint16_t port, OutputMemoryStream &stream);
+	bool sendPacketToAgent(const SocketAddress &address, OutputMemoryStream &stream);
+
+	// Request send functions, for small stateless requests whose response
+	// fits in a datagram. They use UDP when enabled (falling back to TCP).
+	bool sendRequestToYellowPages(OutputMemoryStream &stream);
+	bool sendRequestToAgent(const SocketAddress &address, OutputMemoryStream &stream);
+
+	// Requests to the YellowPages get an id from the node cluster, which
+	// routes their responses back to this agent by that id (they share
+	// one connection with the requests of all the agents, and can be
+	// answered in any order). Only the last request is waited for.
+	void tagYellowPagesRequest(PacketHeader &packetHeader);
+	bool isYellowPagesResponse(const PacketHeader &packetHeader) const { return packetHeader.requestId == _yellowPagesRequestId; }
 
 	// Function called from ModuleNodeCluster to forward packets received from the network
-	virtual void OnPacketReceived(TCPSocketPtr socket, const PacketHeader &packetHeader, InputMemoryStream &stream) = 0;
+	// (the handle of the socket they came from is valid during the call,
+	// handlers can reply through it with ModuleNetworkManager::SendPacket)
+	virtual void OnPacketReceived(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream) = 0;
+
+	// Function called from ModuleNodeCluster to forward responses received over UDP
+	// (there is no socket to reply to, so agents only accept here the
+	// responses whose handlers do not use it)
+	virtual void OnRpcResponse(const PacketHeader &packetHeader, InputMemoryStream &stream);
+
+	// Function called from ModuleNodeCluster when a connection used by this agent could not be established
+	virtual void OnConnectFailed(SocketHandle socket);
+
+	// Function called from ModuleNodeCluster to answer requests received over UDP
+	// (it returns false if the request has to be sent again over TCP)
+	virtual bool OnRpcRequest(const PacketHeader &packetHeader, InputMemoryStream &stream, OutputMemoryStream &response) { return false; }
 
 
 	// Schedule for destruction ///////////////////////////////////////
@@ -91,7 +163,7 @@ private:
 
 	int _state; /**< Current state of the agent. */
 
-	std::vector<TCPSocketPtr> _sockets; /**< Sockets used from this agent. */
+	uint32_t _yellowPagesRequestId; /**< Last request sent to the YellowPages. */
 };
 
 using AgentPtr = std::shared_ptr<Agent>;
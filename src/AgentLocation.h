@@ -1,29 +1,22 @@
 #pragma once
 #include "Globals.h"
-#include "net/Net.h"
+#include "PacketSchema.h"
 
 /**
 * Basic location information about agents.
 * It contains the minimum information to find an agent in
-* the network (complete ip address + port + agent identifier)
+* the network (IPv4 address + port + agent identifier),
+* ready to connect to it without resolving any name.
 */
-class AgentLocation
+class AgentLocation : public PacketData<AgentLocation>
 {
 public:
 
-	std::string hostIP; /**< IP address where the agent is. */
+	uint32_t hostAddress; /**< IPv4 address where the agent is (host byte order). */
 	uint16_t hostPort; /**< Listen port of this host. */
 	uint16_t agentId; /**< Identifier of the MCC agent within the host. */
 
-	void Read(InputMemoryStream &stream) {
-		stream.Read(hostIP);
-		stream.Read(hostPort);
-		stream.Read(agentId);
-	}
+	SocketAddress address() const { return SocketAddress(hostAddress, hostPort); }
 
-	void Write(OutputMemoryStream &stream) {
-		stream.Write(hostIP);
-		stream.Write(hostPort);
-		stream.Write(agentId);
-	}
+	PACKET_FIELDS(hostAddress, hostPort, agentId)
 };
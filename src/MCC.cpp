@@ -2,6 +2,7 @@
 #include "UCC.h"
 #include "Application.h"
 #include "ModuleAgentContainer.h"
+#include "ModuleNetworkManager.h"
 #include "ModuleNodeCluster.h"
 #include <cmath>
 
@@ -86,113 +87,121 @@ void MCC::stop()
 }
 
 
-void MCC::OnPacketReceived(TCPSocketPtr socket, const PacketHeader &packetHeader, InputMemoryStream &stream)
+PacketHandlerTable<MCC> &MCC::packetHandlers()
 {
-	const PacketType packetType = packetHeader.packetType;
+	static PacketHandlerTable<MCC> handlers = {
+		{ PacketType::RegisterMCCAck, &MCC::onRegisterMCCAck },
+		{ PacketType::PositionRequest, &MCC::onPositionRequest },
+		{ PacketType::NegociationProposalRequest, &MCC::onNegociationProposalRequest },
+		{ PacketType::UnregisterMCCAck, &MCC::onUnregisterMCCAck }
+	};
+	return handlers;
+}
 
-	switch (packetType)
+void MCC::OnPacketReceived(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream)
+{
+	if (!packetHandlers().dispatch(*this, socket, packetHeader, stream))
 	{
-	case PacketType::RegisterMCCAck:
+		wLog << "OnPacketReceived() - Unexpected PacketType.";
+	}
+}
+
+void MCC::onRegisterMCCAck(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream)
+{
+	if (state() == ST_MCC_REGISTERING && isYellowPagesResponse(packetHeader))
 	{
-		if (state() == ST_MCC_REGISTERING)
-		{
-			setState(ST_MCC_IDLE);
-			socket->Disconnect();
-		}
-		else
-		{
-			wLog << "OnPacketReceived() - PacketType::RegisterMCCAck was unexpected.";
-		}
-		break;
+		setState(ST_MCC_IDLE);
 	}
-	// TODO: Handle other packets
-	case PacketType::PositionRequest:
+	else
 	{
-		if (state() >= ST_MCC_IDLE && state() < ST_MCC_FINISHED)
-		{
-			PacketHeader oPacketHead;
-			oPacketHead.packetType = PacketType::PositionAnswer;
-			oPacketHead.srcAgentId = id();
-			oPacketHead.dstAgentId = packetHeader.srcAgentId;
-
-			PacketPositionResponse oPacketData;
-			oPacketData.x = node()->x();
-			oPacketData.y = node()->y();
-
-			OutputMemoryStream ostream;
-			oPacketHead.Write(ostream);
-			oPacketData.Write(ostream);
+		wLog << "OnPacketReceived() - PacketType::RegisterMCCAck was unexpected.";
+	}
+}
 
-			socket->SendPacket(ostream.GetBufferPtr(), ostream.GetSize());
-		}
-		else
-		{
-			wLog << "OnPacketReceived() - PacketType::PositionRequest was unexpected.";
-		}
-		break;
+void MCC::onPositionRequest(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream)
+{
+	OutputMemoryStream ostream(0);
+	if (writePositionAnswer(packetHeader, ostream))
+	{
+		App->networkManager->SendPacket(socket, std::move(ostream), PacketPriority::High);
 	}
-	case PacketType::NegociationProposalRequest:
+}
+
+void MCC::onNegociationProposalRequest(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream)
+{
+	if (state() >= ST_MCC_IDLE && state() < ST_MCC_FINISHED)
 	{
-		if (state() >= ST_MCC_IDLE && state() < ST_MCC_FINISHED)
-		{
-			// Send negotiation response
-			PacketHeader oPacketHead;
-			oPacketHead.packetType = PacketType::NegociationProposalAnswer;
-			oPacketHead.srcAgentId = id();
-			oPacketHead.dstAgentId = packetHeader.srcAgentId;
+		// Send negotiation response
+		PacketHeader oPacketHead;
+		oPacketHead.packetType = PacketType::NegociationProposalAnswer;
+		oPacketHead.srcAgentId = id();
+		oPacketHead.dstAgentId = packetHeader.srcAgentId;
 
-			PacketStartNegotiationResponse oPacketData;
-			oPacketData.negociation_approved = false;
+		PacketStartNegotiationResponse oPacketData;
+		oPacketData.negociation_approved = false;
 
-			if (state() == ST_MCC_IDLE
-				&& App->modNodeCluster->NodeMissingConstraint(node()->id(), _contributedItemId))
-			{
-				App->modNodeCluster->AddConstraintToNode(node()->id(), _contributedItemId);
-				
-				// Create UCC
-				createChildUCC();
+		if (state() == ST_MCC_IDLE
+			&& App->modNodeCluster->NodeMissingConstraint(node()->id(), _contributedItemId))
+		{
+			App->modNodeCluster->AddConstraintToNode(node()->id(), _contributedItemId);
+			
+			// Create UCC
+			createChildUCC();
 
-				AgentLocation ucclocation;
-				ucclocation.hostIP = socket->RemoteAddress().GetIPString();
-				ucclocation.agentId = _ucc->id();
-				ucclocation.hostPort = LISTEN_PORT_AGENTS;
+			AgentLocation ucclocation;
+			ucclocation.hostAddress = App->networkManager->GetSocket(socket)->RemoteAddress().GetIPv4Address();
+			ucclocation.agentId = _ucc->id();
+			ucclocation.hostPort = LISTEN_PORT_AGENTS;
 
-				oPacketData.ucc_location = ucclocation;
-				oPacketData.negociation_approved = true;
+			oPacketData.ucc_location = ucclocation;
+			oPacketData.negociation_approved = true;
 
-				//_negotiationAgreement = false;
-				setState(ST_MCC_NEGOTIATING);
-			}
+			//_negotiationAgreement = false;
+			setState(ST_MCC_NEGOTIATING);
+		}
 
-			OutputMemoryStream ostream;
-			oPacketHead.Write(ostream);
-			oPacketData.Write(ostream);
+		OutputMemoryStream ostream(PacketSize(oPacketHead, oPacketData));
+		oPacketHead.Write(ostream);
+		oPacketData.Write(ostream);
 
-			socket->SendPacket(ostream.GetBufferPtr(), ostream.GetSize());
-		}
-		else
-		{
-			wLog << "OnPacketReceived() - PacketType::NegociationProposalRequest was unexpected.";
-		}
-		break;
+		App->networkManager->SendPacket(socket, std::move(ostream), PacketPriority::High);
+	}
+	else
+	{
+		wLog << "OnPacketReceived() - PacketType::NegociationProposalRequest was unexpected.";
 	}
+}
 
-	case PacketType::UnregisterMCCAck:
+void MCC::onUnregisterMCCAck(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream)
+{
+	if (state() == ST_MCC_UNREGISTERING && isYellowPagesResponse(packetHeader))
 	{
-		if (state() == ST_MCC_UNREGISTERING)
-		{
-			setState(ST_MCC_FINISHED);
-			socket->Disconnect();
-		}
-		else
-		{
-			wLog << "OnPacketReceived() - PacketType::UnregisterMCCAck was unexpected.";
-		}
-		break;
+		setState(ST_MCC_FINISHED);
 	}
-	default:
-		wLog << "OnPacketReceived() - Unexpected PacketType.";
+	else
+	{
+		wLog << "OnPacketReceived() - PacketType::UnregisterMCCAck was unexpected.";
+	}
+}
+
+void MCC::OnConnectFailed(SocketHandle socket)
+{
+	// The Yellow Pages could not be reached
+	if (state() == ST_MCC_REGISTERING || state() == ST_MCC_UNREGISTERING)
+	{
+		wLog << "OnConnectFailed() - MCC " << id() << " could not reach the Yellow Pages.";
+		setState(ST_MCC_FINISHED);
+	}
+}
+
+bool MCC::OnRpcRequest(const PacketHeader &packetHeader, InputMemoryStream &stream, OutputMemoryStream &response)
+{
+	// Only the position can be requested over UDP
+	if (packetHeader.packetType == PacketType::PositionRequest)
+	{
+		return writePositionAnswer(packetHeader, response);
 	}
+	return false;
 }
 
 bool MCC::isIdling() const
@@ -219,11 +228,12 @@ bool MCC::registerIntoYellowPages()
 	packetHead.packetType = PacketType::RegisterMCC;
 	packetHead.srcAgentId = id();
 	packetHead.dstAgentId = -1;
+	tagYellowPagesRequest(packetHead);
 	PacketRegisterMCC packetData;
 	packetData.itemId = _contributedItemId;
 
 	// Serialize message
-	OutputMemoryStream stream;
+	OutputMemoryStream stream(PacketSize(packetHead, packetData));
 	packetHead.Write(stream);
 	packetData.Write(stream);
 
@@ -237,17 +247,43 @@ void MCC::unregisterFromYellowPages()
 	packetHead.packetType = PacketType::UnregisterMCC;
 	packetHead.srcAgentId = id();
 	packetHead.dstAgentId = -1;
+	tagYellowPagesRequest(packetHead);
 	PacketUnregisterMCC packetData;
 	packetData.itemId = _contributedItemId;
 
 	// Serialize message
-	OutputMemoryStream stream;
+	OutputMemoryStream stream(PacketSize(packetHead, packetData));
 	packetHead.Write(stream);
 	packetData.Write(stream);
 
 	sendPacketToYellowPages(stream);
 }
 
+bool MCC::writePositionAnswer(const PacketHeader &packetHeader, OutputMemoryStream &ostream)
+{
+	if (state() >= ST_MCC_IDLE && state() < ST_MCC_FINISHED)
+	{
+		PacketHeader oPacketHead;
+		oPacketHead.packetType = PacketType::PositionAnswer;
+		oPacketHead.srcAgentId = id();
+		oPacketHead.dstAgentId = packetHeader.srcAgentId;
+
+		PacketPositionResponse oPacketData;
+		oPacketData.x = node()->x();
+		oPacketData.y = node()->y();
+
+		ostream.Reserve(PacketSize(oPacketHead, oPacketData));
+		oPacketHead.Write(ostream);
+		oPacketData.Write(ostream);
+		return true;
+	}
+	else
+	{
+		wLog << "OnPacketReceived() - PacketType::PositionRequest was unexpected.";
+		return false;
+	}
+}
+
 void MCC::createChildUCC()
 {
 	// TODO: Create a unicast contributor
@@ -18,7 +18,12 @@ public:
 	void update() override;
 	void stop() override;
 	MCC* asMCC() override { return this; }
-	void OnPacketReceived(TCPSocketPtr socket, const PacketHeader &packetHeader, InputMemoryStream &stream) override;
+	void OnPacketReceived(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream) override;
+	void OnConnectFailed(SocketHandle socket) override;
+	bool OnRpcRequest(const PacketHeader &packetHeader, InputMemoryStream &stream, OutputMemoryStream &response) override;
+
+	// Packet handlers of MCC agents
+	static PacketHandlerTable<MCC> &packetHandlers();
 
 	// Getters
 	bool isIdling() const;
@@ -39,6 +44,14 @@ private:
 	bool registerIntoYellowPages();
 	void unregisterFromYellowPages();
 
+	bool writePositionAnswer(const PacketHeader &packetHeader, OutputMemoryStream &ostream);
+
+	// Packet handlers
+	void onRegisterMCCAck(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream);
+	void onPositionRequest(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream);
+	void onNegociationProposalRequest(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream);
+	void onUnregisterMCCAck(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream);
+
 	// UCC
 	UCCPtr _ucc;
 	void createChildUCC();
@@ -52,13 +52,13 @@ void MCP::update()
 			packetHead.srcAgentId = id();
 			packetHead.dstAgentId = agent.agentId;
 
-			OutputMemoryStream stream;
+			OutputMemoryStream stream(PacketSize(packetHead));
 			packetHead.Write(stream);
 
-			sendPacketToAgent(agent.hostIP, agent.hostPort, stream);
+			sendRequestToAgent(agent.address(), stream);
 			setState(ST_MCP_MCC_POSITION_RESPONSE);
 		}
-		else
+		else if (!_mccPagesPending)
 		{
 			_mccRegisterIndex = 0;
 			setState(ST_MCP_ITERATING_OVER_MCCs);
@@ -76,10 +76,10 @@ void MCP::update()
 			packetHead.srcAgentId = id();
 			packetHead.dstAgentId = agent.agentId;
 
-			OutputMemoryStream stream;
+			OutputMemoryStream stream(PacketSize(packetHead));
 			packetHead.Write(stream);
 
-			sendPacketToAgent(agent.hostIP, agent.hostPort, stream);
+			sendPacketToAgent(agent.address(), stream);
 			setState(ST_MCP_WAITING_NEGOTIATION_RESPONSE);
 		}
 		else
@@ -114,109 +114,174 @@ void MCP::stop()
 	destroy();
 }
 
-void MCP::OnPacketReceived(TCPSocketPtr socket, const PacketHeader &packetHeader, InputMemoryStream &stream)
+PacketHandlerTable<MCP> &MCP::packetHandlers()
+{
+	static PacketHandlerTable<MCP> handlers = {
+		{ PacketType::ReturnMCCsForItem, &MCP::onReturnMCCsForItem },
+		{ PacketType::ReturnMCCsForItemPage, &MCP::onReturnMCCsForItemPage },
+		{ PacketType::PositionAnswer, &MCP::onPositionAnswer },
+		{ PacketType::NegociationProposalAnswer, &MCP::onNegociationProposalAnswer }
+	};
+	return handlers;
+}
+
+void MCP::OnPacketReceived(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream)
 {
-	const PacketType packetType = packetHeader.packetType;
+	if (!packetHandlers().dispatch(*this, socket, packetHeader, stream))
+	{
+		wLog << "OnPacketReceived() - Unexpected PacketType.";
+	}
+}
 
-	switch (packetType)
+void MCP::OnRpcResponse(const PacketHeader &packetHeader, InputMemoryStream &stream)
+{
+	// Responses to the requests sent with sendRequestToAgent, their
+	// handlers never reply through the socket
+	switch (packetHeader.packetType)
 	{
 	case PacketType::ReturnMCCsForItem:
+	case PacketType::PositionAnswer:
+		packetHandlers().dispatch(*this, SocketHandle(), packetHeader, stream);
+		break;
+	default:
+		Agent::OnRpcResponse(packetHeader, stream);
+		break;
+	}
+}
+
+void MCP::onReturnMCCsForItem(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream)
+{
+	if (state() == ST_MCP_REQUESTING_MCCs && isYellowPagesResponse(packetHeader))
 	{
-		if (state() == ST_MCP_REQUESTING_MCCs)
-		{
-			// Read the packet
-			PacketReturnMCCsForItem packetData;
-			packetData.Read(stream);
+		// Read the packet
+		PacketReturnMCCsForItem packetData;
+		packetData.Read(stream);
 
-			// Store the returned MCCs from YP
-			_mccRegisters.swap(packetData.mccAddresses);
+		// Store the returned MCCs from YP
+		_mccRegisters.swap(packetData.mccAddresses);
 
-			// Select the first MCC to negociate
-			_mccRegisterIndex = 0;
-			setState(ST_MCP_MCC_POSITION_REQUEST);
+		// Select the first MCC to negociate
+		_mccRegisterIndex = 0;
+		setState(ST_MCP_MCC_POSITION_REQUEST);
+	}
+	else
+	{
+		wLog << "OnPacketReceived() - PacketType::ReturnMCCsForItem was unexpected.";
+	}
+}
 
-			socket->Disconnect();
-		}
-		else
+void MCP::onReturnMCCsForItemPage(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream)
+{
+	if ((state() == ST_MCP_REQUESTING_MCCs || _mccPagesPending) && isYellowPagesResponse(packetHeader))
+	{
+		// Read the packet
+		PacketReturnMCCsForItemPage packetData;
+		packetData.Read(stream);
+
+		// Later pages are probed after the MCCs already received
+		_mccRegisters.insert(_mccRegisters.end(), packetData.mccAddresses.begin(), packetData.mccAddresses.end());
+		_mccPagesPending = !packetData.lastPage;
+
+		// Start with the first page
+		if (state() == ST_MCP_REQUESTING_MCCs)
 		{
-			wLog << "OnPacketReceived() - PacketType::ReturnMCCsForItem was unexpected.";
+			_mccRegisterIndex = 0;
+			setState(ST_MCP_MCC_POSITION_REQUEST);
 		}
-		break;
 	}
-	case PacketType::PositionAnswer:
+	else
 	{
-		if (state() == ST_MCP_MCC_POSITION_RESPONSE)
-		{
-			// Read the packet
-			PacketPositionResponse packetData;
-			packetData.Read(stream);
+		wLog << "OnPacketReceived() - PacketType::ReturnMCCsForItemPage was unexpected.";
+	}
+}
 
-			double distance = sqrt(pow(node()->x() - packetData.x, 2) + pow(node()->y() - packetData.y, 2));
+void MCP::onPositionAnswer(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream)
+{
+	if (state() == ST_MCP_MCC_POSITION_RESPONSE)
+	{
+		// Read the packet
+		PacketPositionResponse packetData;
+		packetData.Read(stream);
 
-			if (distance + distance_traveled <= App->modNodeCluster->MaxTravelDistance())
-			{
-				bool ordered = false;
+		double distance = sqrt(pow(node()->x() - packetData.x, 2) + pow(node()->y() - packetData.y, 2));
+
+		if (distance + distance_traveled <= App->modNodeCluster->MaxTravelDistance())
+		{
+			bool ordered = false;
 
-				for (auto agent = ordered_distances.begin(); !ordered && agent != ordered_distances.end();)
+			for (auto agent = ordered_distances.begin(); !ordered && agent != ordered_distances.end();)
+			{
+				if (distance <= agent->second)
 				{
-					if (distance <= agent->second)
-					{
-						ordered = true;
-						ordered_distances.insert(agent, *new std::pair<int, double>(_mccRegisterIndex, distance));
-					}
-					else
-					{
-						agent++;
-					}
+					ordered = true;
+					ordered_distances.insert(agent, *new std::pair<int, double>(_mccRegisterIndex, distance));
+				}
+				else
+				{
+					agent++;
 				}
-
-				if (!ordered)
-					ordered_distances.push_back(*new std::pair<int, double>(_mccRegisterIndex, distance));
 			}
 
-			_mccRegisterIndex++;
-			setState(ST_MCP_MCC_POSITION_REQUEST);
-			socket->Disconnect();
-		}
-		else
-		{
-			wLog << "OnPacketReceived() - PacketType::ReturnMCCsForItem was unexpected.";
+			if (!ordered)
+				ordered_distances.push_back(*new std::pair<int, double>(_mccRegisterIndex, distance));
 		}
-		break;
+
+		_mccRegisterIndex++;
+		setState(ST_MCP_MCC_POSITION_REQUEST);
 	}
-	
-	// TODO: Handle other packets
-	case PacketType::NegociationProposalAnswer:
+	else
 	{
-		if (state() == ST_MCP_WAITING_NEGOTIATION_RESPONSE)
-		{
-			PacketStartNegotiationResponse iPacketData;
-			iPacketData.Read(stream);
+		wLog << "OnPacketReceived() - PacketType::ReturnMCCsForItem was unexpected.";
+	}
+}
 
-			if (iPacketData.negociation_approved)
-			{
-				// Create UCP to achieve the constraint item
-				createChildUCP(iPacketData.ucc_location);
+void MCP::onNegociationProposalAnswer(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream)
+{
+	if (state() == ST_MCP_WAITING_NEGOTIATION_RESPONSE)
+	{
+		PacketStartNegotiationResponse iPacketData;
+		iPacketData.Read(stream);
 
-				// Wait for UCP results
-				setState(ST_MCP_NEGOTIATING);
-			}
-			else
-			{
-				_mccRegisterIndex++;
-				setState(ST_MCP_ITERATING_OVER_MCCs);
-			}
+		if (iPacketData.negociation_approved)
+		{
+			// Create UCP to achieve the constraint item
+			createChildUCP(iPacketData.ucc_location);
 
-			socket->Disconnect();
+			// Wait for UCP results
+			setState(ST_MCP_NEGOTIATING);
 		}
 		else
 		{
-			wLog << "OnPacketReceived() - PacketType::NegociationProposalAnswer was unexpected.";
+			_mccRegisterIndex++;
+			setState(ST_MCP_ITERATING_OVER_MCCs);
 		}
-		break;
 	}
-	default:
-		wLog << "OnPacketReceived() - Unexpected PacketType.";
+	else
+	{
+		wLog << "OnPacketReceived() - PacketType::NegociationProposalAnswer was unexpected.";
+	}
+}
+
+void MCP::OnConnectFailed(SocketHandle socket)
+{
+	switch (state())
+	{
+	case ST_MCP_REQUESTING_MCCs:
+		// The Yellow Pages could not be reached
+		wLog << "OnConnectFailed() - MCP " << id() << " could not reach the Yellow Pages.";
+		setState(ST_MCP_NEGOTIATION_FINISHED);
+		break;
+	case ST_MCP_MCC_POSITION_RESPONSE:
+		// Skip this MCC
+		_mccRegisterIndex++;
+		setState(ST_MCP_MCC_POSITION_REQUEST);
+		break;
+	case ST_MCP_WAITING_NEGOTIATION_RESPONSE:
+		// Try with the next MCC
+		_mccRegisterIndex++;
+		setState(ST_MCP_ITERATING_OVER_MCCs);
+		break;
+	default:;
 	}
 }
 
@@ -232,21 +297,42 @@ bool MCP::negotiationAgreement() const
 
 bool MCP::queryMCCsForItem(int itemId)
 {
+	_mccRegisters.clear();
+
 	// Create message header and data
 	PacketHeader packetHead;
-	packetHead.packetType = PacketType::QueryMCCsForItem;
 	packetHead.srcAgentId = id();
 	packetHead.dstAgentId = -1;
+	tagYellowPagesRequest(packetHead);
+
+	// Long lists of MCCs can be received page by page
+	const int pageSize = App->modNodeCluster->MccPageSize();
+	if (pageSize > 0)
+	{
+		packetHead.packetType = PacketType::QueryMCCsForItemPaged;
+		PacketQueryMCCsForItemPaged packetData;
+		packetData.itemId = _requestedItemId;
+		packetData.pageSize = static_cast<uint16_t>(pageSize);
+
+		OutputMemoryStream stream(PacketSize(packetHead, packetData));
+		packetHead.Write(stream);
+		packetData.Write(stream);
+
+		// Several responses, so not through UDP
+		return sendPacketToYellowPages(stream);
+	}
+
+	packetHead.packetType = PacketType::QueryMCCsForItem;
 	PacketQueryMCCsForItem packetData;
 	packetData.itemId = _requestedItemId;
 
 	// Serialize message
-	OutputMemoryStream stream;
+	OutputMemoryStream stream(PacketSize(packetHead, packetData));
 	packetHead.Write(stream);
 	packetData.Write(stream);
 
 	// 1) Ask YP for MCC hosting the item 'itemId'
-	return sendPacketToYellowPages(stream);
+	return sendRequestToYellowPages(stream);
 }
 
 void MCP::createChildUCP(const AgentLocation &uccLoc)
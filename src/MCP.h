@@ -18,7 +18,13 @@ public:
 	void update() override;
 	void stop() override;
 	MCP* asMCP() override { return this; }
-	void OnPacketReceived(TCPSocketPtr socket, const PacketHeader &packetHeader, InputMemoryStream &stream) override;
+	void OnPacketReceived(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream) override;
+
+	void OnRpcResponse(const PacketHeader &packetHeader, InputMemoryStream &stream) override;
+	void OnConnectFailed(SocketHandle socket) override;
+
+	// Packet handlers of MCP agents
+	static PacketHandlerTable<MCP> &packetHandlers();
 
 	// Getters
 	uint16_t requestedItemId() const { return _requestedItemId; }
@@ -37,11 +43,18 @@ private:
 
 	bool queryMCCsForItem(int itemId);
 
+	// Packet handlers
+	void onReturnMCCsForItem(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream);
+	void onReturnMCCsForItemPage(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream);
+	void onPositionAnswer(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream);
+	void onNegociationProposalAnswer(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream);
+
 	uint16_t _requestedItemId;
 	uint16_t _contributedItemId;
 
 	int _mccRegisterIndex; /**< Iterator through _mccRegisters. */
 	std::vector<AgentLocation> _mccRegisters; /**< MCCs returned by the YP. */
+	bool _mccPagesPending = false; /**< More pages of MCCs are coming from the YP. */
 
 	std::vector<std::pair<int,double>> distances;
 	std::vector<std::pair<int, double>> ordered_distances;
@@ -82,6 +82,17 @@ bool  ModuleAgentContainer::update()
 	return true;
 }
 
+void ModuleAgentContainer::updateAgain()
+{
+	for (auto agentToAdd : _agentsToAdd)
+	{
+		_agents.push_back(agentToAdd);
+	}
+	_agentsToAdd.clear();
+
+	update();
+}
+
 bool ModuleAgentContainer::postUpdate()
 {
 	// Add pending agents to add
@@ -146,5 +157,22 @@ void ModuleAgentContainer::drawInfoGUI()
 		ImGui::TextWrapped("# MCP agents: %d", mcpCount);
 		ImGui::TextWrapped("# UCC agents: %d", uccCount);
 		ImGui::TextWrapped("# UCP agents: %d", ucpCount);
+
+		if (ImGui::TreeNode("Received packets"))
+		{
+			for (size_t i = 0; i < PACKET_TYPE_COUNT; ++i)
+			{
+				const PacketType packetType = static_cast<PacketType>(i);
+				const uint32_t count =
+					MCC::packetHandlers().receivedCount(packetType) +
+					MCP::packetHandlers().receivedCount(packetType) +
+					UCC::packetHandlers().receivedCount(packetType) +
+					UCP::packetHandlers().receivedCount(packetType);
+				if (count > 0) {
+					ImGui::Text("%s: %u", PacketTypeName(packetType), count);
+				}
+			}
+			ImGui::TreePop();
+		}
 	}
 }
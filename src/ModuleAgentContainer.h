@@ -39,6 +39,11 @@ public:
 	// Update
 	bool update() override;
 
+	// It adds the agents created so far and updates all of them once
+	// more, so that they act within the same frame on the packets
+	// dispatched after update() (see ModuleNetworkManager::postUpdate)
+	void updateAgain();
+
 	// Post update
 	bool postUpdate() override;
 
@@ -1,5 +1,6 @@
 #include "ModuleMainMenu.h"
 #include "ModuleAgentContainer.h"
+#include "ModuleNetworkManager.h"
 #include "ModuleNodeCluster.h"
 #include "ModuleYellowPages.h"
 #include "ModuleTextures.h"
@@ -21,6 +22,14 @@ bool ModuleMainMenu::updateGUI()
 	ImGui::Image(texture, ImVec2(width, height));
 	//ImGui::ImageButton(texture, ImVec2(width, height));
 
+	// Unsupported backends fall back to select
+	const char *backends[] = { "select", "epoll", "io_uring" };
+	int backend = (int)App->networkManager->PollerBackend();
+	if (ImGui::Combo("Network backend", &backend, backends, IM_ARRAYSIZE(backends)))
+	{
+		App->networkManager->SetPollerBackend((SocketPollerBackend)backend);
+	}
+
 	if (ImGui::Button("Node cluster"))
 	{
 		setEnabled(false);
@@ -1,6 +1,10 @@
 #pragma once
 
 #include "ModuleNetworkManager.h"
+#include "ModuleAgentContainer.h"
+#include "Application.h"
+#include "Packets.h"
+#include "Log.h"
 #include "imgui/imgui.h"
 
 
@@ -18,15 +22,95 @@ bool ModuleNetworkManager::preUpdate()
 
 bool ModuleNetworkManager::postUpdate()
 {
-	const int timeoutMillis = 0;
-	HandleSocketOperations(timeoutMillis);
+	// The packets dispatched usually make agents change their state and
+	// send more packets. With more than one iteration per frame, agents
+	// are updated again and their packets exchanged within this same
+	// frame, for as long as packets keep arriving.
+	for (int iteration = 0; iteration < _iterationsPerFrame; ++iteration)
+	{
+		if (iteration > 0 && App->agentContainer->isEnabled()) {
+			App->agentContainer->updateAgain();
+		}
+		if (handleNetworkOperations() == 0) {
+			break;
+		}
+	}
+
+	const uint64_t acquireCount = StreamBufferPool::AcquireCount();
+	const uint64_t systemAllocationCount = StreamBufferPool::SystemAllocationCount();
+	_frameAcquires = acquireCount - _lastAcquireCount;
+	_frameSystemAllocations = systemAllocationCount - _lastSystemAllocationCount;
+	_lastAcquireCount = acquireCount;
+	_lastSystemAllocationCount = systemAllocationCount;
+
+	sampleTransportRates();
+	_rttStats.expireRequests();
+
+	// Packets refused by the sockets (full queues or budget), which
+	// the agents do not check for
+	const uint64_t packetsDropped = Stats().GetPacketsDropped();
+	if (packetsDropped != _lastPacketsDropped)
+	{
+		wLog << "ModuleNetworkManager: " << (int)(packetsDropped - _lastPacketsDropped) << " outgoing packets dropped";
+		_lastPacketsDropped = packetsDropped;
+	}
 
 	return true;
 }
 
+int ModuleNetworkManager::handleNetworkOperations()
+{
+	const uint64_t packetsReceived = Stats().GetPacketsReceived();
+
+	if (IsThreaded())
+	{
+		// Socket operations already run in the network thread
+		DispatchThreadEvents();
+	}
+	else
+	{
+		const int timeoutMillis = 0;
+		HandleSocketOperations(timeoutMillis);
+	}
+	const int datagramCount = _rpcChannel.Update();
+
+	return (int)(Stats().GetPacketsReceived() - packetsReceived) + datagramCount;
+}
+
+void ModuleNetworkManager::sampleTransportRates()
+{
+	const auto now = std::chrono::steady_clock::now();
+	const double seconds = std::chrono::duration<double>(now - _lastSampleTime).count();
+	if (seconds < 1.0) {
+		return;
+	}
+
+	const ConnectionStats &stats = Stats();
+	TransportRates sample;
+	sample.bytesSent = (double)stats.GetBytesSent();
+	sample.bytesReceived = (double)stats.GetBytesReceived();
+	sample.packetsSent = (double)stats.GetPacketsSent();
+	sample.packetsReceived = (double)stats.GetPacketsReceived();
+	sample.connects = (double)stats.GetConnects();
+	sample.accepts = (double)stats.GetAccepts();
+	sample.disconnects = (double)stats.GetDisconnects();
+
+	_rates.bytesSent = (sample.bytesSent - _lastSample.bytesSent) / seconds;
+	_rates.bytesReceived = (sample.bytesReceived - _lastSample.bytesReceived) / seconds;
+	_rates.packetsSent = (sample.packetsSent - _lastSample.packetsSent) / seconds;
+	_rates.packetsReceived = (sample.packetsReceived - _lastSample.packetsReceived) / seconds;
+	_rates.connects = (sample.connects - _lastSample.connects) / seconds;
+	_rates.accepts = (sample.accepts - _lastSample.accepts) / seconds;
+	_rates.disconnects = (sample.disconnects - _lastSample.disconnects) / seconds;
+
+	_lastSample = sample;
+	_lastSampleTime = now;
+}
+
 bool ModuleNetworkManager::stop()
 {
 	Finalize();
+	_rpcChannel.Close();
 
 	return true;
 }
@@ -42,8 +126,124 @@ void ModuleNetworkManager::drawInfoGUI()
 {
 	if (ImGui::CollapsingHeader("ModuleNetworkManager", ImGuiTreeNodeFlags_DefaultOpen))
 	{
-		int socketsCount = TCPNetworkManager::allSockets().size();
+		int socketsCount = TCPNetworkManager::SocketCount();
 
 		ImGui::TextWrapped("# active sockets: %d", socketsCount);
+		ImGui::TextWrapped("# pooled connections: %d", (int)TCPNetworkManager::pooledConnections().size());
+		ImGui::TextWrapped("# in-process sockets: %d", TCPNetworkManager::LocalSocketCount());
+		ImGui::TextWrapped("# shared-memory sockets: %d", TCPNetworkManager::SharedMemorySocketCount());
+		ImGui::TextWrapped("Readiness backend: %s", TCPNetworkManager::PollerName());
+		ImGui::TextWrapped("# pending UDP requests: %d", (int)_rpcChannel.PendingRequestCount());
+		ImGui::TextWrapped("# stream buffers per frame: %d (%d allocated)", (int)_frameAcquires, (int)_frameSystemAllocations);
+
+		// Backpressure
+		ImGui::TextWrapped("Outgoing bytes queued: %.1f KB", TCPNetworkManager::OutgoingBudgetUsed() / 1024.0);
+		ImGui::TextWrapped("# sockets backing up: %d", TCPNetworkManager::BackingUpSocketCount());
+		int budgetMB = (int)(TCPNetworkManager::OutgoingBudgetLimit() / (1024 * 1024));
+		if (ImGui::SliderInt("Outgoing budget (MB)", &budgetMB, 1, 256))
+		{
+			SetOutgoingBudget((uint64_t)budgetMB * 1024 * 1024);
+		}
+		int readBudgetKB = (int)(TCPNetworkManager::ReadBudget() / 1024);
+		if (ImGui::SliderInt("Read budget per socket (KB)", &readBudgetKB, 16, 4096))
+		{
+			SetReadBudget((uint32_t)readBudgetKB * 1024);
+		}
+		int acceptBudget = (int)TCPNetworkManager::AcceptBudget();
+		if (ImGui::SliderInt("Accept budget per frame", &acceptBudget, 1, 1024))
+		{
+			SetAcceptBudget((uint32_t)acceptBudget);
+		}
+
+		// Latency
+		ImGui::SliderInt("Network iterations per frame", &_iterationsPerFrame, 1, MAX_NETWORK_ITERATIONS_PER_FRAME);
+		bool sendImmediately = TCPNetworkManager::SendsImmediately();
+		if (ImGui::Checkbox("Send packets immediately", &sendImmediately))
+		{
+			SetSendImmediately(sendImmediately);
+		}
+		if (ImGui::TreeNode("Outgoing queues"))
+		{
+			for (const auto &connection : TCPNetworkManager::pooledConnections())
+			{
+				const TransportStats &socketStats = connection.second->GetStats();
+				ImGui::Text("%s: %u bytes queued (%u high, %u normal packets), %.1f KB out, %.1f KB in, %d packets out, %d in",
+					connection.first.GetString().c_str(), connection.second->GetOutgoingBytes(),
+					connection.second->GetOutgoingPackets(PacketPriority::High),
+					connection.second->GetOutgoingPackets(PacketPriority::Normal),
+					socketStats.GetBytesSent() / 1024.0, socketStats.GetBytesReceived() / 1024.0,
+					(int)socketStats.GetPacketsSent(), (int)socketStats.GetPacketsReceived());
+			}
+			ImGui::TreePop();
+		}
+
+		// Transport statistics
+		if (ImGui::TreeNode("Transport"))
+		{
+			const ConnectionStats &stats = Stats();
+			ImGui::Text("Sent: %.1f KB/s, %.0f packets/s (%.1f MB, %d packets)",
+				_rates.bytesSent / 1024.0, _rates.packetsSent,
+				stats.GetBytesSent() / (1024.0 * 1024.0), (int)stats.GetPacketsSent());
+			ImGui::Text("Received: %.1f KB/s, %.0f packets/s (%.1f MB, %d packets)",
+				_rates.bytesReceived / 1024.0, _rates.packetsReceived,
+				stats.GetBytesReceived() / (1024.0 * 1024.0), (int)stats.GetPacketsReceived());
+			ImGui::Text("Dropped: %d packets", (int)stats.GetPacketsDropped());
+			ImGui::Text("Send calls: %d (%d partial), receive calls: %d",
+				(int)stats.GetSendCalls(), (int)stats.GetPartialSends(), (int)stats.GetReceiveCalls());
+			ImGui::Text("Connects: %.1f/s, accepts: %.1f/s, disconnects: %.1f/s",
+				_rates.connects, _rates.accepts, _rates.disconnects);
+			ImGui::Text("Connects: %d (%d failed), accepts: %d, disconnects: %d",
+				(int)stats.GetConnects(), (int)stats.GetConnectFailures(), (int)stats.GetAccepts(), (int)stats.GetDisconnects());
+			ImGui::Text("Average connection lifetime: %.1f s", stats.GetAverageLifetimeMillis() / 1000.0);
+			ImGui::TreePop();
+		}
+
+		// Request/response round-trip times
+		if (ImGui::TreeNode("Round-trip times"))
+		{
+			ImGui::Text("# requests waiting: %d", (int)_rttStats.pendingRequestCount());
+			for (const auto &entry : _rttStats.histograms())
+			{
+				const RttHistogram &histogram = entry.second;
+				ImGui::Text("%s -> %s: %d, mean %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms",
+					PacketTypeName(entry.first.first), PacketTypeName(entry.first.second), (int)histogram.count(),
+					histogram.meanMillis(), histogram.percentileMillis(50.0), histogram.percentileMillis(99.0), histogram.maxMillis());
+			}
+			if (ImGui::Button("Reset round-trip times"))
+			{
+				_rttStats.clear();
+			}
+			ImGui::TreePop();
+		}
+		ImGui::Checkbox("Small requests over UDP", &_useUdpRpc);
+
+		const char *encodings[] = { "Fixed (big-endian)", "Native byte order", "Compact" };
+		int encoding = (int)PacketHeader::writeEncoding();
+		if (ImGui::Combo("Packet encoding", &encoding, encodings, IM_ARRAYSIZE(encodings)))
+		{
+			PacketHeader::writeEncoding() = (StreamEncoding)encoding;
+		}
+
+		bool sharedMemory = IsSharedMemoryEnabled();
+		if (ImGui::Checkbox("Shared memory with local processes", &sharedMemory))
+		{
+			SetSharedMemoryEnabled(sharedMemory);
+		}
+
+		bool threaded = IsThreaded();
+		if (ImGui::Checkbox("Network I/O thread", &threaded))
+		{
+			if (threaded) {
+				StartThread();
+			} else {
+				StopThread();
+			}
+		}
+		if (threaded)
+		{
+			ImGui::TextWrapped("Packet hand-off latency (p99): %.3f ms", ThreadHandoffLatencyP99());
+		}
+		const RttHistogram &hops = _rttStats.hopHistogram();
+		ImGui::TextWrapped("Negotiation hop latency (p99): %.3f ms (%d hops)", hops.percentileMillis(99.0), (int)hops.count());
 	}
 }
@@ -2,6 +2,10 @@
 
 #include "Module.h"
 #include "net/Net.h"
+#include "RttStats.h"
+
+// Upper limit of the network iterations per frame (see postUpdate)
+constexpr int MAX_NETWORK_ITERATIONS_PER_FRAME = 16;
 
 class ModuleNetworkManager : public Module, public TCPNetworkManager
 {
@@ -22,4 +26,62 @@ public:
 public:
 
 	void drawInfoGUI();
+
+	// Channel for small request/response packets over UDP
+	UDPRpcChannel &rpcChannel() { return _rpcChannel; }
+
+	// Whether or not agents send their small requests over UDP
+	bool useUdpRpc() const { return _useUdpRpc && _rpcChannel.IsOpen(); }
+
+	// Round-trip times of the requests of the agents
+	RttStats &rttStats() { return _rttStats; }
+
+	// Rates of the last second (see TCPNetworkManager::Stats for the totals)
+	double bytesSentPerSecond() const { return _rates.bytesSent; }
+	double bytesReceivedPerSecond() const { return _rates.bytesReceived; }
+	double packetsSentPerSecond() const { return _rates.packetsSent; }
+	double packetsReceivedPerSecond() const { return _rates.packetsReceived; }
+	double connectsPerSecond() const { return _rates.connects; }
+	double acceptsPerSecond() const { return _rates.accepts; }
+	double disconnectsPerSecond() const { return _rates.disconnects; }
+
+private:
+
+	UDPRpcChannel _rpcChannel;
+
+	bool _useUdpRpc = true;
+
+	// Socket operations and packet dispatch run up to this many times
+	// per frame, with the agents updated in between
+	int _iterationsPerFrame = 4;
+
+	// It runs the socket operations (or dispatches the events of the
+	// network thread) and the UDP channel once, and returns the packets
+	// and datagrams received
+	int handleNetworkOperations();
+
+	// Stream buffers acquired and allocated during the last frame
+	uint64_t _lastAcquireCount = 0;
+	uint64_t _lastSystemAllocationCount = 0;
+	uint64_t _frameAcquires = 0;
+	uint64_t _frameSystemAllocations = 0;
+
+	uint64_t _lastPacketsDropped = 0;
+
+	RttStats _rttStats;
+
+	// Transport counters, sampled once per second to compute the rates
+	struct TransportRates {
+		double bytesSent = 0.0;
+		double bytesReceived = 0.0;
+		double packetsSent = 0.0;
+		double packetsReceived = 0.0;
+		double connects = 0.0;
+		double accepts = 0.0;
+		double disconnects = 0.0;
+	};
+	void sampleTransportRates();
+	TransportRates _rates;
+	TransportRates _lastSample;
+	std::chrono::steady_clock::time_point _lastSampleTime;
 };
@@ -46,6 +46,7 @@ bool ModuleNodeCluster::update()
 		break;
 	case RUNNING:
 		runSystem();
+		expireYellowPagesRequests();
 		break;
 	case STOPPING:
 		stopSystem();
@@ -84,6 +85,8 @@ bool ModuleNodeCluster::updateGUI()
 		}
 		ImGui::TextWrapped("# missing items in the cluster: %d", missingItemsCount);
 
+		ImGui::TextWrapped("# YP requests in flight: %d", (int)_yellowPagesRequests.size());
+
 		ImGui::Separator();
 
 		if (ImGui::Button("Create MCCs"))
@@ -322,6 +325,9 @@ bool ModuleNodeCluster::updateGUI()
 		ImGui::Text("Max Distance  ");
 		ImGui::SameLine();
 		ImGui::SliderInt("Distance", &max_travel_distance, -1, (MAP_WIDTH + MAP_HEIGHT) * MAX_NODES, "%i");
+		ImGui::Text("YP Page Size  ");
+		ImGui::SameLine();
+		ImGui::SliderInt("Page", &mcc_page_size, 0, 64, "%i");
 		ImGui::Separator();
 
 		int negociation_depth = 0;
@@ -361,20 +367,22 @@ bool ModuleNodeCluster::cleanUp()
 	return true;
 }
 
-void ModuleNodeCluster::OnAccepted(TCPSocketPtr socket)
+void ModuleNodeCluster::OnAccepted(SocketHandle socket)
 {
 	// Nothing to do
 }
 
-void ModuleNodeCluster::OnPacketReceived(TCPSocketPtr socket, InputMemoryStream & stream)
+void ModuleNodeCluster::OnPacketReceived(SocketHandle socket, InputMemoryStream & stream)
 {
 	//iLog << "OnPacketReceived";
 
 	PacketHeader packetHead;
 	packetHead.Read(stream);
+	const uint16_t agentId = responseAgentId(packetHead);
+	App->networkManager->rttStats().packetReceived(agentId, packetHead.packetType);
 
 	// Get the agent
-	auto agentPtr = App->agentContainer->getAgent(packetHead.dstAgentId);
+	auto agentPtr = App->agentContainer->getAgent(agentId);
 	if (agentPtr != nullptr)
 	{
 		agentPtr->OnPacketReceived(socket, packetHead, stream);
@@ -385,9 +393,166 @@ void ModuleNodeCluster::OnPacketReceived(TCPSocketPtr socket, InputMemoryStream
 	}
 }
 
-void ModuleNodeCluster::OnDisconnected(TCPSocketPtr socket)
+void ModuleNodeCluster::OnDisconnected(SocketHandle socket)
 {
-	// Nothing to do
+	_agentsWaitingForConnection.erase(socket);
+}
+
+void ModuleNodeCluster::OnConnected(SocketHandle socket)
+{
+	_agentsWaitingForConnection.erase(socket);
+}
+
+void ModuleNodeCluster::OnConnectFailed(SocketHandle socket)
+{
+	auto it = _agentsWaitingForConnection.find(socket);
+	if (it == _agentsWaitingForConnection.end()) {
+		return;
+	}
+
+	// Notify all the agents that queued packets into this connection
+	std::vector<uint16_t> agentIds;
+	agentIds.swap(it->second);
+	_agentsWaitingForConnection.erase(it);
+
+	for (uint16_t agentId : agentIds)
+	{
+		auto agentPtr = App->agentContainer->getAgent(agentId);
+		if (agentPtr != nullptr && agentPtr->isValid())
+		{
+			agentPtr->OnConnectFailed(socket);
+		}
+	}
+}
+
+void ModuleNodeCluster::WaitForConnection(SocketHandle socket, uint16_t agentId)
+{
+	std::vector<uint16_t> &agentIds = _agentsWaitingForConnection[socket];
+	if (std::find(agentIds.begin(), agentIds.end(), agentId) == agentIds.end()) {
+		agentIds.push_back(agentId);
+	}
+}
+
+bool ModuleNodeCluster::OnRpcRequest(InputMemoryStream &request, OutputMemoryStream &response)
+{
+	PacketHeader packetHead;
+	packetHead.Read(request);
+
+	// Get the agent
+	auto agentPtr = App->agentContainer->getAgent(packetHead.dstAgentId);
+	if (agentPtr != nullptr)
+	{
+		return agentPtr->OnRpcRequest(packetHead, request, response);
+	}
+	return false;
+}
+
+void ModuleNodeCluster::OnRpcResponse(uint32_t requestId, InputMemoryStream &response)
+{
+	_pendingRequests.erase(requestId);
+
+	// Same as responses received over TCP, but there is no socket to
+	// reply to (see Agent::OnRpcResponse)
+	PacketHeader packetHead;
+	packetHead.Read(response);
+	const uint16_t agentId = responseAgentId(packetHead);
+	App->networkManager->rttStats().packetReceived(agentId, packetHead.packetType);
+
+	auto agentPtr = App->agentContainer->getAgent(agentId);
+	if (agentPtr != nullptr)
+	{
+		agentPtr->OnRpcResponse(packetHead, response);
+	}
+	else
+	{
+		eLog << "Couldn't find agent: " << packetHead.dstAgentId;
+	}
+}
+
+void ModuleNodeCluster::OnRpcFailed(uint32_t requestId, const char *request, uint32_t requestSize)
+{
+	auto it = _pendingRequests.find(requestId);
+	if (it == _pendingRequests.end()) {
+		return;
+	}
+
+	PendingRequest pendingRequest = it->second;
+	_pendingRequests.erase(it);
+
+	// Send the request again over TCP
+	auto agentPtr = App->agentContainer->getAgent(pendingRequest.agentId);
+	if (agentPtr != nullptr && agentPtr->isValid())
+	{
+		OutputMemoryStream stream(requestSize);
+		stream.Write(request, requestSize);
+		agentPtr->sendPacketToAgent(pendingRequest.address, stream);
+	}
+}
+
+void ModuleNodeCluster::WaitForResponse(uint32_t requestId, uint16_t agentId, const SocketAddress &address)
+{
+	PendingRequest &pendingRequest = _pendingRequests[requestId];
+	pendingRequest.agentId = agentId;
+	pendingRequest.address = address;
+}
+
+uint32_t ModuleNodeCluster::NewYellowPagesRequest(uint16_t agentId)
+{
+	const uint32_t requestId = _nextYellowPagesRequestId++;
+	if (_nextYellowPagesRequestId == 0) {
+		_nextYellowPagesRequestId = 1; // 0 means no request
+	}
+
+	YellowPagesRequest &request = _yellowPagesRequests[requestId];
+	request.agentId = agentId;
+	request.sendTime = std::chrono::steady_clock::now();
+	return requestId;
+}
+
+const SocketAddress &ModuleNodeCluster::yellowPagesAddress()
+{
+	// Failed lookups are not cached by SocketAddress, so a name server
+	// that was not reachable before is asked again
+	if (!_yellowPagesAddress.IsValid()) {
+		_yellowPagesAddress = SocketAddress(std::string(HOSTNAME_YP) + ":" + std::to_string(LISTEN_PORT_YP));
+	}
+	return _yellowPagesAddress;
+}
+
+uint16_t ModuleNodeCluster::responseAgentId(const PacketHeader &packetHead)
+{
+	if (packetHead.requestId != 0)
+	{
+		auto it = _yellowPagesRequests.find(packetHead.requestId);
+		if (it != _yellowPagesRequests.end())
+		{
+			const uint16_t agentId = it->second.agentId;
+			_yellowPagesRequests.erase(it);
+			return agentId;
+		}
+	}
+
+	// Later responses to the same request (e.g. pages) and packets
+	// which answer no YellowPages request go by the destination agent
+	return packetHead.dstAgentId;
+}
+
+void ModuleNodeCluster::expireYellowPagesRequests()
+{
+	const auto now = std::chrono::steady_clock::now();
+	if (now - _lastYellowPagesExpireTime < std::chrono::seconds(1)) {
+		return;
+	}
+	_lastYellowPagesExpireTime = now;
+
+	for (auto it = _yellowPagesRequests.begin(); it != _yellowPagesRequests.end();)
+	{
+		if (now - it->second.sendTime > std::chrono::seconds(YELLOW_PAGES_REQUEST_TIMEOUT_SECONDS)) {
+			it = _yellowPagesRequests.erase(it);
+		} else {
+			++it;
+		}
+	}
 }
 
 void ModuleNodeCluster::ReportLastTravelDistance(double distance)
@@ -444,6 +609,14 @@ bool ModuleNodeCluster::startSystem()
 	App->networkManager->SetDelegate(this);
 	App->networkManager->AddSocket(listenSocket);
 
+	// Small requests can also be served over UDP
+	App->networkManager->rpcChannel().SetDelegate(this);
+	if (App->networkManager->rpcChannel().Open(port)) {
+		iLog << " - UDP request channel open on port " << LISTEN_PORT_AGENTS;
+	} else {
+		wLog << " - UDP request channel not available, using TCP only";
+	}
+
 #ifdef RANDOM_INITIALIZATION
 	// Initialize nodes
 	for (int i = 0; i < MAX_NODES; ++i)
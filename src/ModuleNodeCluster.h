@@ -6,8 +6,12 @@
 #include "MCC.h"
 #include "MCP.h"
 #include <map>
+#include <unordered_map>
 
-class ModuleNodeCluster : public Module, public TCPNetworkManagerDelegate
+// Time a YellowPages request waits for its response before being forgotten
+constexpr int YELLOW_PAGES_REQUEST_TIMEOUT_SECONDS = 30;
+
+class ModuleNodeCluster : public Module, public TCPNetworkManagerDelegate, public UDPRpcChannelDelegate
 {
 public:
 
@@ -28,11 +32,43 @@ public:
 
 	// TCPNetworkManagerDelegate virtual methods
 
-	void OnAccepted(TCPSocketPtr socket) override;
+	void OnAccepted(SocketHandle socket) override;
+
+	void OnPacketReceived(SocketHandle socket, InputMemoryStream &stream) override;
+
+	void OnDisconnected(SocketHandle socket) override;
+
+	void OnConnected(SocketHandle socket) override;
+
+	void OnConnectFailed(SocketHandle socket) override;
+
+
+	// UDPRpcChannelDelegate virtual methods
+
+	bool OnRpcRequest(InputMemoryStream &request, OutputMemoryStream &response) override;
+
+	void OnRpcResponse(uint32_t requestId, InputMemoryStream &response) override;
+
+	void OnRpcFailed(uint32_t requestId, const char *request, uint32_t requestSize) override;
+
+
+	// Agents sending through a connection still in progress
+
+	void WaitForConnection(SocketHandle socket, uint16_t agentId);
+
+	// Agents waiting for the response to a UDP request
+
+	void WaitForResponse(uint32_t requestId, uint16_t agentId, const SocketAddress &address);
+
+	// Requests of the agents to the YellowPages, pipelined over a single
+	// connection: it returns the id the request is tagged with, whose
+	// first response is routed back to the agent by that id
 
-	void OnPacketReceived(TCPSocketPtr socket, InputMemoryStream &stream) override;
+	uint32_t NewYellowPagesRequest(uint16_t agentId);
 
-	void OnDisconnected(TCPSocketPtr socket) override;
+	// Address of the YellowPages, resolved again while it is not valid
+
+	const SocketAddress &yellowPagesAddress();
 
 
 	// User criteria
@@ -41,6 +77,8 @@ public:
 
 	int MaxNearest() const { return max_mcc_iterations; }
 
+	int MccPageSize() const { return mcc_page_size; }
+
 	double MaxTravelDistance() const { return max_travel_distance; }
 
 	void ReportLastTravelDistance(double distance);
@@ -76,10 +114,44 @@ private:
 
 	int max_travel_distance = 500; // max item travel distance
 
+	int mcc_page_size = 0; // mcc's per yp page (0: all at once)
+
 	// Negociations
 
 	std::map<uint16_t, std::vector<uint16_t>> negotiations;
 
+	// Connections in progress
+
+	std::map<SocketHandle, std::vector<uint16_t>> _agentsWaitingForConnection; /**< By handle, they do not keep the sockets alive. */
+
+	// UDP requests in progress
+
+	struct PendingRequest {
+		uint16_t agentId;
+		SocketAddress address;
+	};
+
+	std::map<uint32_t, PendingRequest> _pendingRequests;
+
+	// YellowPages requests in flight
+
+	struct YellowPagesRequest {
+		uint16_t agentId;
+		std::chrono::steady_clock::time_point sendTime;
+	};
+
+	std::unordered_map<uint32_t, YellowPagesRequest> _yellowPagesRequests;
+
+	uint32_t _nextYellowPagesRequestId = 1;
+
+	SocketAddress _yellowPagesAddress; /**< Not valid until HOSTNAME_YP is resolved. */
+
+	std::chrono::steady_clock::time_point _lastYellowPagesExpireTime;
+
+	uint16_t responseAgentId(const PacketHeader &packetHead);
+
+	void expireYellowPagesRequests();
+
 	double traveled_distance = 0;
 
 	double last_total_distance = 0;
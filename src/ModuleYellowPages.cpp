@@ -71,7 +71,7 @@ bool ModuleYellowPages::updateGUI()
 			{
 				for (auto &agentLocation : agentLocations)
 				{
-					ImGui::Text(" - %s:%d - agent:%d", agentLocation.hostIP.c_str(), agentLocation.hostPort, agentLocation.agentId);
+					ImGui::Text(" - %s - agent:%d", agentLocation.address().GetString().c_str(), agentLocation.agentId);
 				}
 
 				ImGui::TreePop();
@@ -123,6 +123,14 @@ bool ModuleYellowPages::startService()
 	App->networkManager->SetDelegate(this);
 	App->networkManager->AddSocket(listenSocket);
 
+	// Small queries can also be answered over UDP
+	App->networkManager->rpcChannel().SetDelegate(this);
+	if (App->networkManager->rpcChannel().Open(port)) {
+		iLog << " - UDP request channel open on port " << LISTEN_PORT_YP;
+	} else {
+		wLog << " - UDP request channel not available, using TCP only";
+	}
+
 	return true;
 }
 
@@ -131,12 +139,12 @@ void ModuleYellowPages::stopService()
 	// Nothing to do
 }
 
-void ModuleYellowPages::OnAccepted(TCPSocketPtr socket)
+void ModuleYellowPages::OnAccepted(SocketHandle socket)
 {
 	// Nothing to do
 }
 
-void ModuleYellowPages::OnPacketReceived(TCPSocketPtr socket, InputMemoryStream &stream)
+void ModuleYellowPages::OnPacketReceived(SocketHandle socket, InputMemoryStream &stream)
 {
 	// Read packet header
 	PacketHeader inPacketHead;
@@ -150,21 +158,20 @@ void ModuleYellowPages::OnPacketReceived(TCPSocketPtr socket, InputMemoryStream
 
 		// Register the MCC into the yellow pages
 		AgentLocation mcc;
-		mcc.hostIP = socket->RemoteAddress().GetIPString();
+		mcc.hostAddress = App->networkManager->GetSocket(socket)->RemoteAddress().GetIPv4Address();
 		mcc.hostPort = LISTEN_PORT_AGENTS;
 		mcc.agentId = inPacketHead.srcAgentId;
 		_mccByItem[inPacketData.itemId].push_back(mcc);
-
-		// Host address
-		std::string hostAddress = socket->RemoteAddress().GetString();
+		_batchMCCsByItem.erase(inPacketData.itemId);
 
 		// Send RegisterMCCAck packet
-		OutputMemoryStream outStream;
 		PacketHeader outPacket;
 		outPacket.packetType = PacketType::RegisterMCCAck;
 		outPacket.dstAgentId = inPacketHead.srcAgentId;
+		outPacket.requestId = inPacketHead.requestId;
+		OutputMemoryStream outStream(PacketSize(outPacket));
 		outPacket.Write(outStream);
-		socket->SendPacket(outStream.GetBufferPtr(), outStream.GetSize());
+		App->networkManager->SendPacket(socket, std::move(outStream), PacketPriority::High);
 	}
 	else if (inPacketHead.packetType == PacketType::UnregisterMCC)
 	{
@@ -179,6 +186,7 @@ void ModuleYellowPages::OnPacketReceived(TCPSocketPtr socket, InputMemoryStream
 				iLog << "MCC  " << it->agentId << " unregistred";
 				auto oldIt = it++;
 				mccs.erase(oldIt);
+				_batchMCCsByItem.erase(inPacketData.itemId);
 				break;
 			}
 			else {
@@ -191,36 +199,24 @@ void ModuleYellowPages::OnPacketReceived(TCPSocketPtr socket, InputMemoryStream
 		PacketHeader outPacket;
 		outPacket.packetType = PacketType::UnregisterMCCAck;
 		outPacket.dstAgentId = inPacketHead.srcAgentId;
+		outPacket.requestId = inPacketHead.requestId;
 
-		OutputMemoryStream outStream;
+		OutputMemoryStream outStream(PacketSize(outPacket));
 		outPacket.Write(outStream);
-		socket->SendPacket(outStream.GetBufferPtr(), outStream.GetSize());
+		App->networkManager->SendPacket(socket, std::move(outStream), PacketPriority::High);
 	}
 	else if (inPacketHead.packetType == PacketType::QueryMCCsForItem)
 	{
-		// Read packet
-		PacketQueryMCCsForItem inPacketData;
-		inPacketData.Read(stream);
-
-		// Response packet
-		PacketReturnMCCsForItem outPacketData;
+		OutputMemoryStream outStream(0); // Sized by writeMCCsForItem
+		writeMCCsForItem(inPacketHead, stream, outStream);
 
-		// Obtain the MCCAddresses
-		auto itemId = inPacketData.itemId;
-		auto &mccAddressList = _mccByItem[itemId];
-		for (auto &mccAddress : mccAddressList) {
-			outPacketData.mccAddresses.push_back(mccAddress);
-		}
-
-		// Send response packet
-		PacketHeader outPacketHead;
-		outPacketHead.packetType = PacketType::ReturnMCCsForItem;
-		outPacketHead.dstAgentId = inPacketHead.srcAgentId;
-
-		OutputMemoryStream outStream;
-		outPacketHead.Write(outStream);
-		outPacketData.Write(outStream);
-		socket->SendPacket(outStream.GetBufferPtr(), outStream.GetSize());
+		// Lists of MCCs can be big, so they leave the way to the
+		// packets of the negotiations sharing the connection
+		App->networkManager->SendPacket(socket, std::move(outStream), PacketPriority::Normal);
+	}
+	else if (inPacketHead.packetType == PacketType::QueryMCCsForItemPaged)
+	{
+		sendMCCsForItemPages(socket, inPacketHead, stream);
 	}
 	else
 	{
@@ -228,8 +224,104 @@ void ModuleYellowPages::OnPacketReceived(TCPSocketPtr socket, InputMemoryStream
 	}
 }
 
-void ModuleYellowPages::OnDisconnected(TCPSocketPtr socket)
+void ModuleYellowPages::OnDisconnected(SocketHandle socket)
 {
 	// Nothing to do
 	//iLog << "Socket disconnected gracefully";
 }
+
+void ModuleYellowPages::OnReceiveBatchEnd(SocketHandle socket)
+{
+	// The responses of the batch are queued already
+	_batchMCCsByItem.clear();
+}
+
+bool ModuleYellowPages::OnRpcRequest(InputMemoryStream &request, OutputMemoryStream &response)
+{
+	// Read packet header
+	PacketHeader inPacketHead;
+	inPacketHead.Read(request);
+
+	// Only queries are stateless, the rest go through TCP
+	if (inPacketHead.packetType == PacketType::QueryMCCsForItem)
+	{
+		writeMCCsForItem(inPacketHead, request, response);
+		return true;
+	}
+	return false;
+}
+
+void ModuleYellowPages::writeMCCsForItem(const PacketHeader &inPacketHead, InputMemoryStream &stream, OutputMemoryStream &outStream)
+{
+	// Read packet
+	PacketQueryMCCsForItem inPacketData;
+	inPacketData.Read(stream);
+
+	// Response packet header
+	PacketHeader outPacketHead;
+	outPacketHead.packetType = PacketType::ReturnMCCsForItem;
+	outPacketHead.dstAgentId = inPacketHead.srcAgentId;
+	outPacketHead.requestId = inPacketHead.requestId;
+
+	// Response packet, encoded once per batch
+	const std::vector<char> &outPacketData = encodedMCCsForItem(inPacketData.itemId);
+
+	outStream.Reserve(PacketSize(outPacketHead) + (uint32_t)outPacketData.size());
+	outPacketHead.Write(outStream);
+	outStream.Write(outPacketData.data(), (uint32_t)outPacketData.size());
+}
+
+const std::vector<char> &ModuleYellowPages::encodedMCCsForItem(uint16_t itemId)
+{
+	const StreamEncoding encoding = PacketHeader::writeEncoding();
+	EncodedMCCs &encoded = _batchMCCsByItem[itemId];
+	if (!encoded.data.empty() && encoded.encoding == encoding) {
+		return encoded.data;
+	}
+
+	// Obtain the MCCAddresses
+	PacketReturnMCCsForItem outPacketData;
+	auto &mccAddressList = _mccByItem[itemId];
+	for (auto &mccAddress : mccAddressList) {
+		outPacketData.mccAddresses.push_back(mccAddress);
+	}
+
+	OutputMemoryStream outStream(outPacketData.encodedSize(encoding));
+	outStream.SetEncoding(encoding);
+	outPacketData.Write(outStream);
+
+	encoded.encoding = encoding;
+	encoded.data.assign(outStream.GetBufferPtr(), outStream.GetBufferPtr() + outStream.GetSize());
+	return encoded.data;
+}
+
+void ModuleYellowPages::sendMCCsForItemPages(SocketHandle socket, const PacketHeader &inPacketHead, InputMemoryStream &stream)
+{
+	// Read packet
+	PacketQueryMCCsForItemPaged inPacketData;
+	inPacketData.Read(stream);
+	const size_t pageSize = std::max<size_t>(inPacketData.pageSize, 1);
+
+	// Response packet header
+	PacketHeader outPacketHead;
+	outPacketHead.packetType = PacketType::ReturnMCCsForItemPage;
+	outPacketHead.dstAgentId = inPacketHead.srcAgentId;
+	outPacketHead.requestId = inPacketHead.requestId;
+
+	// One page after another (at least one, even if empty)
+	auto &mccAddressList = _mccByItem[inPacketData.itemId];
+	auto it = mccAddressList.begin();
+	do
+	{
+		PacketReturnMCCsForItemPage outPacketData;
+		while (it != mccAddressList.end() && outPacketData.mccAddresses.size() < pageSize) {
+			outPacketData.mccAddresses.push_back(*it++);
+		}
+		outPacketData.lastPage = (it == mccAddressList.end());
+
+		OutputMemoryStream outStream(PacketSize(outPacketHead, outPacketData));
+		outPacketHead.Write(outStream);
+		outPacketData.Write(outStream);
+		App->networkManager->SendPacket(socket, std::move(outStream), PacketPriority::Normal);
+	} while (it != mccAddressList.end());
+}
@@ -2,12 +2,14 @@
 
 #include "Module.h"
 #include "AgentLocation.h"
+#include "Packets.h"
 #include "net/Net.h"
 #include <map>
+#include <vector>
 
 class IDatabaseGateway;
 
-class ModuleYellowPages : public Module, public TCPNetworkManagerDelegate
+class ModuleYellowPages : public Module, public TCPNetworkManagerDelegate, public UDPRpcChannelDelegate
 {
 public:
 
@@ -26,11 +28,18 @@ public:
 
 	// TCPNetworkManagerDelegate virtual methods
 
-	void OnAccepted(TCPSocketPtr socket) override;
+	void OnAccepted(SocketHandle socket) override;
 
-	void OnPacketReceived(TCPSocketPtr socket, InputMemoryStream &stream) override;
+	void OnPacketReceived(SocketHandle socket, InputMemoryStream &stream) override;
 
-	void OnDisconnected(TCPSocketPtr socket) override;
+	void OnDisconnected(SocketHandle socket) override;
+
+	void OnReceiveBatchEnd(SocketHandle socket) override;
+
+
+	// UDPRpcChannelDelegate virtual methods
+
+	bool OnRpcRequest(InputMemoryStream &request, OutputMemoryStream &response) override;
 
 private:
 
@@ -38,7 +47,22 @@ private:
 
 	void stopService();
 
+	void writeMCCsForItem(const PacketHeader &inPacketHead, InputMemoryStream &stream, OutputMemoryStream &outStream);
+
+	void sendMCCsForItemPages(SocketHandle socket, const PacketHeader &inPacketHead, InputMemoryStream &stream);
+
+	const std::vector<char> &encodedMCCsForItem(uint16_t itemId);
+
 	int state = 0;
 
 	std::map<uint16_t, std::list<AgentLocation> > _mccByItem; /**< MCCs accessed by item id. */
+
+	// Encoded lists of MCCs (PacketReturnMCCsForItem) answered during
+	// the current batch of requests, by item id, so that the queries of
+	// the same item pipelined by the clusters share one encoding
+	struct EncodedMCCs {
+		StreamEncoding encoding;
+		std::vector<char> data;
+	};
+	std::map<uint16_t, EncodedMCCs> _batchMCCsByItem;
 };
\ No newline at end of file
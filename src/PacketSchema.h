@@ -0,0 +1,174 @@
+#pragma once
+#include "net/Net.h"
+
+/**
+ * Packet schema.
+ * Each packet data class lists its fields once with PACKET_FIELDS and
+ * derives from PacketData, which reads, writes and sizes them in that
+ * order. Fields can be primitive types, strings, vectors (prefixed by
+ * a 16-bit count) and other classes with PACKET_FIELDS.
+ */
+#define PACKET_FIELDS(...) \
+	template <class Visitor> void visitFields(Visitor &visitor) { visitor(__VA_ARGS__); } \
+	template <class Visitor> void visitFields(Visitor &visitor) const { visitor(__VA_ARGS__); }
+
+/**
+ * It reads the fields from a stream.
+ */
+class PacketFieldReader
+{
+public:
+
+	explicit PacketFieldReader(InputMemoryStream &stream) : _stream(stream) { }
+
+	template <class... T>
+	void operator()(T &... fields) {
+		int expand[] = { 0, (read(fields), 0)... };
+		(void)expand;
+	}
+
+private:
+
+	template <class T>
+	void read(T &field) { read(field, std::is_class<T>()); }
+	template <class T>
+	void read(T &field, std::false_type) { _stream.Read(field); }
+	template <class T>
+	void read(T &field, std::true_type) { field.visitFields(*this); }
+	void read(std::string &field) { _stream.Read(field); }
+	template <class T>
+	void read(std::vector<T> &field) {
+		uint16_t count;
+		_stream.Read(count);
+		field.resize(count);
+		for (auto &element : field) {
+			read(element);
+		}
+	}
+
+	InputMemoryStream &_stream;
+};
+
+/**
+ * It writes the fields into a stream.
+ */
+class PacketFieldWriter
+{
+public:
+
+	explicit PacketFieldWriter(OutputMemoryStream &stream) : _stream(stream) { }
+
+	template <class... T>
+	void operator()(const T &... fields) {
+		int expand[] = { 0, (write(fields), 0)... };
+		(void)expand;
+	}
+
+private:
+
+	template <class T>
+	void write(const T &field) { write(field, std::is_class<T>()); }
+	template <class T>
+	void write(const T &field, std::false_type) { _stream.Write(field); }
+	template <class T>
+	void write(const T &field, std::true_type) { field.visitFields(*this); }
+	void write(const std::string &field) { _stream.Write(field); }
+	template <class T>
+	void write(const std::vector<T> &field) {
+		_stream.Write(static_cast<uint16_t>(field.size()));
+		for (const auto &element : field) {
+			write(element);
+		}
+	}
+
+	OutputMemoryStream &_stream;
+};
+
+/**
+ * It adds up the bytes the fields take in a stream, following the
+ * encoding rules of MemoryStream (including the bools packed together
+ * in the compact encoding).
+ */
+class PacketFieldSizer
+{
+public:
+
+	explicit PacketFieldSizer(StreamEncoding encoding) : _encoding(encoding) { }
+
+	uint32_t size() const { return _size; }
+
+	template <class... T>
+	void operator()(const T &... fields) {
+		int expand[] = { 0, (add(fields), 0)... };
+		(void)expand;
+	}
+
+private:
+
+	template <class T>
+	void add(const T &field) { add(field, std::is_class<T>()); }
+	template <class T>
+	void add(const T &field, std::true_type) { field.visitFields(*this); }
+	template <class T>
+	void add(const T &field, std::false_type) {
+		if (_encoding == StreamEncoding::Compact) {
+			addCompact(field, typename CompactEncodingOf<T>::type());
+		} else {
+			_size += sizeof(T);
+		}
+	}
+	void add(const std::string &field) {
+		add(static_cast<uint32_t>(field.size()));
+		_size += static_cast<uint32_t>(field.size());
+	}
+	template <class T>
+	void add(const std::vector<T> &field) {
+		add(static_cast<uint16_t>(field.size()));
+		for (const auto &element : field) {
+			add(element);
+		}
+	}
+
+	template <class T>
+	void addCompact(const T &field, CompactAsIs) { _size += sizeof(T); }
+	template <class T>
+	void addCompact(const T &field, CompactAsVarint) { _size += VarintSize(ToVarintValue(field)); }
+	void addCompact(bool field, CompactAsBit) {
+		if (_bitCount == 0 || _bitCount == 8) {
+			_size += 1;
+			_bitCount = 0;
+		}
+		_bitCount++;
+	}
+
+	StreamEncoding _encoding;
+	uint32_t _size = 0;
+	uint32_t _bitCount = 0;
+};
+
+/**
+ * Base of the packet data classes, it generates their Read, Write and
+ * encodedSize methods from the fields listed with PACKET_FIELDS.
+ */
+template <class T>
+class PacketData
+{
+public:
+
+	void Read(InputMemoryStream &stream) {
+		PacketFieldReader reader(stream);
+		static_cast<T*>(this)->visitFields(reader);
+	}
+
+	void Write(OutputMemoryStream &stream) const {
+		PacketFieldWriter writer(stream);
+		static_cast<const T*>(this)->visitFields(writer);
+	}
+
+	// Bytes written by Write in the given encoding
+	uint32_t encodedSize(StreamEncoding encoding) const {
+		PacketFieldSizer sizer(encoding);
+		static_cast<const T*>(this)->visitFields(sizer);
+		return sizer.size();
+	}
+};
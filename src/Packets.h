@@ -18,6 +18,8 @@ enum class PacketType
 	// MCP <-> YP
 	QueryMCCsForItem,
 	ReturnMCCsForItem,
+	QueryMCCsForItemPaged,
+	ReturnMCCsForItemPage,
 
 	// MCP <-> MCC
 	PositionRequest,
@@ -40,6 +42,56 @@ enum class PacketType
 	Last
 };
 
+constexpr size_t PACKET_TYPE_COUNT = static_cast<size_t>(PacketType::Last);
+
+/**
+ * Name of each packet type, for logs and the GUI.
+ */
+inline const char *PacketTypeName(PacketType packetType)
+{
+	static const char *names[] = {
+		"RegisterMCC", "RegisterMCCAck", "UnregisterMCC", "UnregisterMCCAck",
+		"QueryMCCsForItem", "ReturnMCCsForItem", "QueryMCCsForItemPaged", "ReturnMCCsForItemPage",
+		"PositionRequest", "PositionAnswer", "NegociationProposalRequest", "NegociationProposalAnswer",
+		"RequestItem", "RequestItemResponse", "SendConstraint", "SendConstraintResponse"
+	};
+	static_assert(sizeof(names) / sizeof(names[0]) == PACKET_TYPE_COUNT, "Missing packet type names");
+	const size_t index = static_cast<size_t>(packetType);
+	return index < PACKET_TYPE_COUNT ? names[index] : "Unknown";
+}
+
+/**
+ * Whether or not agents expect a response to this packet type (the
+ * other types are the responses).
+ */
+inline bool IsRequestPacket(PacketType packetType)
+{
+	switch (packetType)
+	{
+	case PacketType::RegisterMCC:
+	case PacketType::UnregisterMCC:
+	case PacketType::QueryMCCsForItem:
+	case PacketType::QueryMCCsForItemPaged:
+	case PacketType::PositionRequest:
+	case PacketType::NegociationProposalRequest:
+	case PacketType::RequestItem:
+	case PacketType::SendConstraint:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * Flags set in the first byte of the packets written in the compact or
+ * the native encodings, whose header starts with the packet type in a
+ * single byte. Both are clear in the fixed encoding, where the first
+ * byte is the most significant one of the (big-endian) packet type.
+ */
+constexpr uint8_t COMPACT_PACKET_FLAG = 0x80;
+constexpr uint8_t NATIVE_PACKET_FLAG = 0x40;
+static_assert(static_cast<int>(PacketType::Last) < NATIVE_PACKET_FLAG, "Too many packet types for the single byte header");
+
 /**
  * Standard information used by almost all messages in the system.
  * Agents will be communicating among each other, so in many cases,
@@ -51,36 +103,84 @@ public:
 	PacketType packetType; // Which type is this packet
 	uint16_t srcAgentId;   // Which agent sent this packet?
 	uint16_t dstAgentId;   // Which agent is expected to receive the packet?
+	uint32_t requestId;    // Which request is this (or does this answer)? 0 if none
 	PacketHeader() :
 		packetType(PacketType::Last),
 		srcAgentId(NULL_AGENT_ID),
-		dstAgentId(NULL_AGENT_ID)
+		dstAgentId(NULL_AGENT_ID),
+		requestId(0)
 	{ }
+	// Encoding of the packets written by this process (fixed by default).
+	// The rest of the packet is read in the encoding found in its header.
+	// Native packets can only be read by hosts of the same endianness.
+	static StreamEncoding &writeEncoding() {
+		static StreamEncoding encoding = StreamEncoding::Fixed;
+		return encoding;
+	}
 	void Read(InputMemoryStream &stream) {
-		stream.Read(packetType);
+		uint8_t firstByte;
+		stream.Peek(&firstByte, sizeof(firstByte));
+		if (firstByte & (COMPACT_PACKET_FLAG | NATIVE_PACKET_FLAG)) {
+			stream.Read(&firstByte, sizeof(firstByte));
+			stream.SetEncoding((firstByte & COMPACT_PACKET_FLAG) ? StreamEncoding::Compact : StreamEncoding::Native);
+			packetType = static_cast<PacketType>(firstByte & ~(COMPACT_PACKET_FLAG | NATIVE_PACKET_FLAG));
+		} else {
+			stream.SetEncoding(StreamEncoding::Fixed);
+			stream.Read(packetType);
+		}
 		stream.Read(srcAgentId);
 		stream.Read(dstAgentId);
+		stream.Read(requestId);
 	}
 	void Write(OutputMemoryStream &stream) {
-		stream.Write(packetType);
+		stream.SetEncoding(writeEncoding());
+		if (stream.GetEncoding() != StreamEncoding::Fixed) {
+			const uint8_t flag = (stream.GetEncoding() == StreamEncoding::Compact) ? COMPACT_PACKET_FLAG : NATIVE_PACKET_FLAG;
+			const uint8_t firstByte = flag | static_cast<uint8_t>(packetType);
+			stream.Write(&firstByte, sizeof(firstByte));
+		} else {
+			stream.Write(packetType);
+		}
 		stream.Write(srcAgentId);
 		stream.Write(dstAgentId);
+		stream.Write(requestId);
+	}
+	// Bytes written by Write in the given encoding
+	uint32_t encodedSize(StreamEncoding encoding) const {
+		switch (encoding) {
+		case StreamEncoding::Compact:
+			return 1 + VarintSize(srcAgentId) + VarintSize(dstAgentId) + VarintSize(requestId);
+		case StreamEncoding::Native:
+			return 1 + sizeof(srcAgentId) + sizeof(dstAgentId) + sizeof(requestId);
+		default:
+			return sizeof(packetType) + sizeof(srcAgentId) + sizeof(dstAgentId) + sizeof(requestId);
+		}
 	}
 };
 
+/**
+ * Exact size of the packets written by this process, so that senders
+ * can allocate their stream once.
+ */
+inline uint32_t PacketSize(const PacketHeader &packetHeader)
+{
+	return packetHeader.encodedSize(PacketHeader::writeEncoding());
+}
+
+template <class T>
+uint32_t PacketSize(const PacketHeader &packetHeader, const PacketData<T> &packetData)
+{
+	return PacketSize(packetHeader) + packetData.encodedSize(PacketHeader::writeEncoding());
+}
+
 /**
  * To register a MCC we need to know which resource/item is
  * being provided by the MCC agent.
  */
-class PacketRegisterMCC {
+class PacketRegisterMCC : public PacketData<PacketRegisterMCC> {
 public:
 	uint16_t itemId; // Which item has to be registered?
-	void Read(InputMemoryStream &stream) {
-		stream.Read(itemId);
-	}
-	void Write(OutputMemoryStream &stream) {
-		stream.Write(itemId);
-	}
+	PACKET_FIELDS(itemId)
 };
 
 /**
@@ -99,24 +199,32 @@ using PacketQueryMCCsForItem = PacketRegisterMCC;
  * It contains a list of the addresses of MCC agents contributing
  * with the item specified by the PacketQueryMCCsForItem.
  */
-class PacketReturnMCCsForItem {
+class PacketReturnMCCsForItem : public PacketData<PacketReturnMCCsForItem> {
 public:
 	std::vector<AgentLocation> mccAddresses;
-	void Read(InputMemoryStream &stream) {
-		uint16_t count;
-		stream.Read(count);
-		mccAddresses.resize(count);
-		for (auto &mccAddress : mccAddresses) {
-			mccAddress.Read(stream);
-		}
-	}
-	void Write(OutputMemoryStream &stream) {
-		auto count = static_cast<uint16_t>(mccAddresses.size());
-		stream.Write(count);
-		for (auto &mccAddress : mccAddresses) {
-			mccAddress.Write(stream);
-		}
-	}
+	PACKET_FIELDS(mccAddresses)
+};
+
+/**
+ * Paginated form of PacketQueryMCCsForItem (TCP only).
+ * The YP answers with as many PacketReturnMCCsForItemPage as needed,
+ * so the MCP can start with the first MCCs while the rest arrive.
+ */
+class PacketQueryMCCsForItemPaged : public PacketData<PacketQueryMCCsForItemPaged> {
+public:
+	uint16_t itemId;   // Which item are the MCCs contributing with?
+	uint16_t pageSize; // How many MCCs per page?
+	PACKET_FIELDS(itemId, pageSize)
+};
+
+/**
+ * Page of the MCCs requested by a PacketQueryMCCsForItemPaged.
+ */
+class PacketReturnMCCsForItemPage : public PacketData<PacketReturnMCCsForItemPage> {
+public:
+	bool lastPage; // Whether or not more pages follow
+	std::vector<AgentLocation> mccAddresses;
+	PACKET_FIELDS(lastPage, mccAddresses)
 };
 
 
@@ -129,18 +237,11 @@ public:
 	// This packet has nothing
 };
 
-class PacketPositionResponse {
+class PacketPositionResponse : public PacketData<PacketPositionResponse> {
 public:
 	int x;
 	int y;
-	void Read(InputMemoryStream &stream) {
-		stream.Read(x);
-		stream.Read(y);
-	}
-	void Write(OutputMemoryStream &stream) {
-		stream.Write(x);
-		stream.Write(y);
-	}
+	PACKET_FIELDS(x, y)
 };
 
 class PacketStartNegotiation {
@@ -148,57 +249,33 @@ public:
 	// This packet has nothing
 };
 
-class PacketStartNegotiationResponse {
+class PacketStartNegotiationResponse : public PacketData<PacketStartNegotiationResponse> {
 public:
 	bool negociation_approved;
 	AgentLocation ucc_location;
-	void Read(InputMemoryStream &stream) {
-		stream.Read(negociation_approved);
-		ucc_location.Read(stream);
-	}
-	void Write(OutputMemoryStream &stream) {
-		stream.Write(negociation_approved);
-		ucc_location.Write(stream);
-	}
+	PACKET_FIELDS(negociation_approved, ucc_location)
 };
 
 // UCP <-> UCC
 // TODO
 
-class PacketRequestItem {
+class PacketRequestItem : public PacketData<PacketRequestItem> {
 public:
 	uint16_t requestedItemId;
-	void Read(InputMemoryStream &stream) {
-		stream.Read(requestedItemId);
-	}
-	void Write(OutputMemoryStream &stream) {
-		stream.Write(requestedItemId);
-	}
+	PACKET_FIELDS(requestedItemId)
 };
 
-class PacketRequestItemResponse {
+class PacketRequestItemResponse : public PacketData<PacketRequestItemResponse> {
 public:
 	uint16_t constraintItemId;
-	void Read(InputMemoryStream &stream) {
-		stream.Read(constraintItemId);
-	}
-	void Write(OutputMemoryStream &stream) {
-		stream.Write(constraintItemId);
-	}
+	PACKET_FIELDS(constraintItemId)
 };
 
-class PacketSendConstraint {
+class PacketSendConstraint : public PacketData<PacketSendConstraint> {
 public:
 	bool agreement;
 	uint16_t constraintItemId;
-	void Read(InputMemoryStream &stream) {
-		stream.Read(agreement);
-		stream.Read(constraintItemId);
-	}
-	void Write(OutputMemoryStream &stream) {
-		stream.Write(agreement);
-		stream.Write(constraintItemId);
-	}
+	PACKET_FIELDS(agreement, constraintItemId)
 };
 
 class PacketSendConstraintResponse {
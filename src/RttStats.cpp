@@ -0,0 +1,100 @@
+#include "RttStats.h"
+#include <algorithm>
+
+
+void RttHistogram::add(uint64_t micros)
+{
+	uint32_t bucket = 0;
+	while (bucket < RTT_BUCKET_COUNT - 1 && micros >= (RTT_FIRST_BUCKET_MICROS << bucket)) {
+		bucket++;
+	}
+	_buckets[bucket]++;
+	_count++;
+	_totalMicros += micros;
+	_maxMicros = std::max(_maxMicros, micros);
+}
+
+double RttHistogram::meanMillis() const
+{
+	return (_count > 0) ? _totalMicros / (_count * 1000.0) : 0.0;
+}
+
+double RttHistogram::maxMillis() const
+{
+	return _maxMicros / 1000.0;
+}
+
+double RttHistogram::percentileMillis(double percentile) const
+{
+	if (_count == 0) {
+		return 0.0;
+	}
+
+	const double target = _count * percentile / 100.0;
+	uint32_t accumulated = 0;
+	for (uint32_t bucket = 0; bucket < RTT_BUCKET_COUNT - 1; ++bucket)
+	{
+		accumulated += _buckets[bucket];
+		if (accumulated >= target) {
+			return std::min((RTT_FIRST_BUCKET_MICROS << bucket) / 1000.0, maxMillis());
+		}
+	}
+	return maxMillis();
+}
+
+void RttStats::packetSent(uint16_t agentId, const char *data, uint32_t size)
+{
+	PacketHeader packetHead;
+	InputMemoryStream stream(data, size);
+	packetHead.Read(stream);
+
+	if (IsRequestPacket(packetHead.packetType))
+	{
+		PendingRequest &pendingRequest = _pendingRequests[agentId];
+		pendingRequest.packetType = packetHead.packetType;
+		pendingRequest.sendTime = Clock::now();
+	}
+}
+
+void RttStats::packetReceived(uint16_t agentId, PacketType packetType)
+{
+	if (IsRequestPacket(packetType)) {
+		return;
+	}
+
+	auto it = _pendingRequests.find(agentId);
+	if (it == _pendingRequests.end()) {
+		return;
+	}
+
+	const auto rtt = Clock::now() - it->second.sendTime;
+	const auto micros = std::chrono::duration_cast<std::chrono::microseconds>(rtt).count();
+	_histograms[RequestResponse(it->second.packetType, packetType)].add(micros);
+	_hopHistogram.add(micros);
+	_pendingRequests.erase(it);
+}
+
+void RttStats::expireRequests()
+{
+	const Clock::time_point now = Clock::now();
+	if (now - _lastExpireTime < std::chrono::seconds(1)) {
+		return;
+	}
+	_lastExpireTime = now;
+
+	for (auto it = _pendingRequests.begin(); it != _pendingRequests.end();)
+	{
+		if (now - it->second.sendTime > std::chrono::milliseconds(RTT_REQUEST_TIMEOUT_MILLIS)) {
+			it = _pendingRequests.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+void RttStats::clear()
+{
+	_pendingRequests.clear();
+	_histograms.clear();
+	_hopHistogram = RttHistogram();
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "Packets.h"
+#include <chrono>
+#include <map>
+#include <unordered_map>
+
+/**
+ * Buckets of the round-trip time histograms: bucket i takes the round
+ * trips under RTT_FIRST_BUCKET_MICROS * 2^i, and the last one the rest.
+ */
+constexpr uint32_t RTT_BUCKET_COUNT = 16;
+constexpr uint64_t RTT_FIRST_BUCKET_MICROS = 64;
+
+/** Time a request waits for its response before being forgotten. */
+constexpr int RTT_REQUEST_TIMEOUT_MILLIS = 10000;
+
+/**
+ * Histogram of the round-trip times of a request/response pair.
+ */
+class RttHistogram
+{
+public:
+
+	void add(uint64_t micros);
+
+	uint32_t count() const { return _count; }
+	uint32_t bucketCount(uint32_t bucket) const { return _buckets[bucket]; }
+	double meanMillis() const;
+	double maxMillis() const;
+
+	// Upper bound of the bucket holding the given percentile (0-100),
+	// or the maximum if it is lower
+	double percentileMillis(double percentile) const;
+
+private:
+
+	uint32_t _buckets[RTT_BUCKET_COUNT] = {};
+	uint32_t _count = 0;
+	uint64_t _totalMicros = 0;
+	uint64_t _maxMicros = 0;
+};
+
+/**
+ * Round-trip times of the requests sent by the agents of this process,
+ * from the moment a request is sent to the moment the first response
+ * addressed to its agent arrives, kept per request/response type pair.
+ * It runs in the main thread (where packets are sent and dispatched).
+ */
+class RttStats
+{
+public:
+
+	using RequestResponse = std::pair<PacketType, PacketType>;
+
+	// A packet sent by an agent (only the requests are timed, see
+	// IsRequestPacket), with its header at the start of data
+	void packetSent(uint16_t agentId, const char *data, uint32_t size);
+
+	// A packet received by an agent
+	void packetReceived(uint16_t agentId, PacketType packetType);
+
+	// It forgets the requests without a response for too long (the
+	// check is done at most once per second)
+	void expireRequests();
+
+	void clear();
+
+	const std::map<RequestResponse, RttHistogram> &histograms() const { return _histograms; }
+
+	// All the pairs together: the latency of a negotiation hop
+	const RttHistogram &hopHistogram() const { return _hopHistogram; }
+	size_t pendingRequestCount() const { return _pendingRequests.size(); }
+
+private:
+
+	using Clock = std::chrono::steady_clock;
+
+	// Last request sent by each agent
+	struct PendingRequest {
+		PacketType packetType;
+		Clock::time_point sendTime;
+	};
+	std::unordered_map<uint16_t, PendingRequest> _pendingRequests;
+
+	std::map<RequestResponse, RttHistogram> _histograms;
+	RttHistogram _hopHistogram;
+
+	Clock::time_point _lastExpireTime;
+};
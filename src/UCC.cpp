@@ -1,4 +1,6 @@
 #include "UCC.h"
+#include "Application.h"
+#include "ModuleNetworkManager.h"
 
 // TODO: Make an enum with the states
 enum State
@@ -28,74 +30,78 @@ void UCC::stop()
 	destroy();
 }
 
-void UCC::OnPacketReceived(TCPSocketPtr socket, const PacketHeader &packetHeader, InputMemoryStream &stream)
+PacketHandlerTable<UCC> &UCC::packetHandlers()
 {
-	PacketType packetType = packetHeader.packetType;
+	static PacketHandlerTable<UCC> handlers = {
+		{ PacketType::RequestItem, &UCC::onRequestItem },
+		{ PacketType::SendConstraint, &UCC::onSendConstraint }
+	};
+	return handlers;
+}
 
-	switch (packetType)
+void UCC::OnPacketReceived(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream)
+{
+	if (!packetHandlers().dispatch(*this, socket, packetHeader, stream))
 	{
-		// TODO: Handle packets
-	case PacketType::RequestItem:
+		wLog << "OnPacketReceived() - Unexpected PacketType.";
+	}
+}
+
+void UCC::onRequestItem(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream)
+{
+	if (state() == ST_UCC_WAITING_ITEM_REQUEST)
 	{
-		if (state() == ST_UCC_WAITING_ITEM_REQUEST)
-		{
-			// Send back PacketType::RequestItemResponse with the constraint
-			PacketHeader oPacketHead;
-			oPacketHead.packetType = PacketType::RequestItemResponse;
-			oPacketHead.srcAgentId = id();
-			oPacketHead.dstAgentId = packetHeader.srcAgentId;
-
-			/* Do nothing with item requested
-			PacketRequestItem iPacketData;
-			iPacketData.Read(stream);*/
-
-			PacketRequestItemResponse oPacketData;
-			oPacketData.constraintItemId = _constraintItemId;
-
-			OutputMemoryStream ostream;
-			oPacketHead.Write(ostream);
-			oPacketData.Write(ostream);
-
-			socket->SendPacket(ostream.GetBufferPtr(), ostream.GetSize());
-			setState(ST_UCC_WAITING_ITEM_CONSTRAINT);
-		}
-		else
-		{
-			wLog << "OnPacketReceived() - PacketType::RequestItem was unexpected.";
-		}
-		break;
+		// Send back PacketType::RequestItemResponse with the constraint
+		PacketHeader oPacketHead;
+		oPacketHead.packetType = PacketType::RequestItemResponse;
+		oPacketHead.srcAgentId = id();
+		oPacketHead.dstAgentId = packetHeader.srcAgentId;
+
+		/* Do nothing with item requested
+		PacketRequestItem iPacketData;
+		iPacketData.Read(stream);*/
+
+		PacketRequestItemResponse oPacketData;
+		oPacketData.constraintItemId = _constraintItemId;
+
+		OutputMemoryStream ostream(PacketSize(oPacketHead, oPacketData));
+		oPacketHead.Write(ostream);
+		oPacketData.Write(ostream);
+
+		App->networkManager->SendPacket(socket, std::move(ostream), PacketPriority::High);
+		setState(ST_UCC_WAITING_ITEM_CONSTRAINT);
 	}
-	case PacketType::SendConstraint:
+	else
 	{
-		if (state() == ST_UCC_WAITING_ITEM_CONSTRAINT)
-		{
-			PacketSendConstraint iPacketData;
-			iPacketData.Read(stream);
-			_negotiationAgreement = iPacketData.agreement;
-
-			/* Do nothing with item recieved
-			iPacketData.constraintItemId;*/
-
-			PacketHeader oPacketHead;
-			oPacketHead.packetType = PacketType::SendConstraintResponse;
-			oPacketHead.srcAgentId = id();
-			oPacketHead.dstAgentId = packetHeader.srcAgentId;
-			
-			OutputMemoryStream ostream;
-			oPacketHead.Write(ostream);
-
-			socket->SendPacket(ostream.GetBufferPtr(), ostream.GetSize());
-			setState(ST_UCC_NEGOTIATION_FINISHED);
-		}
-		else
-		{
-			wLog << "OnPacketReceived() - PacketType::SendConstraint was unexpected.";
-		}
-		break;
+		wLog << "OnPacketReceived() - PacketType::RequestItem was unexpected.";
 	}
+}
 
-	default:
-		wLog << "OnPacketReceived() - Unexpected PacketType.";
+void UCC::onSendConstraint(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream)
+{
+	if (state() == ST_UCC_WAITING_ITEM_CONSTRAINT)
+	{
+		PacketSendConstraint iPacketData;
+		iPacketData.Read(stream);
+		_negotiationAgreement = iPacketData.agreement;
+
+		/* Do nothing with item recieved
+		iPacketData.constraintItemId;*/
+
+		PacketHeader oPacketHead;
+		oPacketHead.packetType = PacketType::SendConstraintResponse;
+		oPacketHead.srcAgentId = id();
+		oPacketHead.dstAgentId = packetHeader.srcAgentId;
+		
+		OutputMemoryStream ostream(PacketSize(oPacketHead));
+		oPacketHead.Write(ostream);
+
+		App->networkManager->SendPacket(socket, std::move(ostream), PacketPriority::High);
+		setState(ST_UCC_NEGOTIATION_FINISHED);
+	}
+	else
+	{
+		wLog << "OnPacketReceived() - PacketType::SendConstraint was unexpected.";
 	}
 }
 
@@ -14,7 +14,10 @@ public:
 	void update() override { }
 	void stop() override;
 	UCC* asUCC() override { return this; }
-	void OnPacketReceived(TCPSocketPtr socket, const PacketHeader &packetHeader, InputMemoryStream &stream) override;
+	void OnPacketReceived(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream) override;
+
+	// Packet handlers of UCC agents
+	static PacketHandlerTable<UCC> &packetHandlers();
 
 	// TODO
 	
@@ -26,6 +29,10 @@ public:
 
 private:
 
+	// Packet handlers
+	void onRequestItem(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream);
+	void onSendConstraint(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream);
+
 	uint16_t _contributedItemId; /**< The contributed item. */
 	uint16_t _constraintItemId; /**< The constraint item. */
 
@@ -2,6 +2,7 @@
 #include "MCP.h"
 #include "Application.h"
 #include "ModuleAgentContainer.h"
+#include "ModuleNetworkManager.h"
 #include "ModuleNodeCluster.h"
 
 
@@ -50,11 +51,11 @@ void UCP::update()
 		PacketRequestItem oPacketData;
 		oPacketData.requestedItemId = _requestedItemId;
 
-		OutputMemoryStream ostream;
+		OutputMemoryStream ostream(PacketSize(oPacketHead, oPacketData));
 		oPacketHead.Write(ostream);
 		oPacketData.Write(ostream);
 		
-		sendPacketToAgent(_uccLocation.hostIP, _uccLocation.hostPort, ostream);
+		sendPacketToAgent(_uccLocation.address(), ostream);
 		setState(ST_UCP_REQUESTING_ITEM);
 
 		break;
@@ -74,11 +75,11 @@ void UCP::update()
 			oPacketData.agreement = _negotiationAgreement;
 			oPacketData.constraintItemId = _contributedItemId;
 
-			OutputMemoryStream ostream;
+			OutputMemoryStream ostream(PacketSize(oPacketHead, oPacketData));
 			oPacketHead.Write(ostream);
 			oPacketData.Write(ostream);
 
-			sendPacketToAgent(_uccLocation.hostIP, _uccLocation.hostPort, ostream);
+			sendPacketToAgent(_uccLocation.address(), ostream);
 
 			setState(ST_UCP_SENDING_CONSTRAIN);
 			destroyChildMCP();
@@ -97,54 +98,41 @@ void UCP::stop()
 	destroy();
 }
 
-void UCP::OnPacketReceived(TCPSocketPtr socket, const PacketHeader &packetHeader, InputMemoryStream &stream)
+PacketHandlerTable<UCP> &UCP::packetHandlers()
 {
-	PacketType packetType = packetHeader.packetType;
+	static PacketHandlerTable<UCP> handlers = {
+		{ PacketType::RequestItemResponse, &UCP::onRequestItemResponse },
+		{ PacketType::SendConstraintResponse, &UCP::onSendConstraintResponse }
+	};
+	return handlers;
+}
 
-	switch (packetType)
+void UCP::OnPacketReceived(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream)
+{
+	if (!packetHandlers().dispatch(*this, socket, packetHeader, stream))
 	{
-		// TODO: Handle packets
-	case PacketType::RequestItemResponse:
+		wLog << "OnPacketReceived() - Unexpected PacketType.";
+	}
+}
+
+void UCP::onRequestItemResponse(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream)
+{
+	if (state() == ST_UCP_REQUESTING_ITEM)
 	{
-		if (state() == ST_UCP_REQUESTING_ITEM)
-		{
-			PacketRequestItemResponse packetData;
-			packetData.Read(stream);
-			_constraintUCCItemId = packetData.constraintItemId;
+		PacketRequestItemResponse packetData;
+		packetData.Read(stream);
+		_constraintUCCItemId = packetData.constraintItemId;
 
-			if (_constraintUCCItemId != _contributedItemId)
+		if (_constraintUCCItemId != _contributedItemId)
+		{
+			if (searchDepth < App->modNodeCluster->MaxDepth())
 			{
-				if (searchDepth < App->modNodeCluster->MaxDepth())
-				{
-					createChildMCP(_constraintUCCItemId);
-					socket->Disconnect();
-					setState(ST_UCP_RESOLVING_CONSTRAINT);
-				}
-				else
-				{
-					_negotiationAgreement = false;
-					PacketHeader oPacketHead;
-					oPacketHead.packetType = PacketType::SendConstraint;
-					oPacketHead.srcAgentId = id();
-					oPacketHead.dstAgentId = _uccLocation.agentId;
-
-					PacketSendConstraint oPacketData;
-					oPacketData.agreement = _negotiationAgreement;
-					oPacketData.constraintItemId = NULL_ITEM_ID;
-
-					OutputMemoryStream ostream;
-					oPacketHead.Write(ostream);
-					oPacketData.Write(ostream);
-
-					socket->SendPacket(ostream.GetBufferPtr(), ostream.GetSize());
-					setState(ST_UCP_SENDING_CONSTRAIN);
-				}
+				createChildMCP(_constraintUCCItemId);
+				setState(ST_UCP_RESOLVING_CONSTRAINT);
 			}
 			else
 			{
-				_negotiationAgreement = true;
-				App->modNodeCluster->ReportLastTravelDistance(distance_traveled);
-
+				_negotiationAgreement = false;
 				PacketHeader oPacketHead;
 				oPacketHead.packetType = PacketType::SendConstraint;
 				oPacketHead.srcAgentId = id();
@@ -152,37 +140,64 @@ void UCP::OnPacketReceived(TCPSocketPtr socket, const PacketHeader &packetHeader
 
 				PacketSendConstraint oPacketData;
 				oPacketData.agreement = _negotiationAgreement;
-				oPacketData.constraintItemId = _contributedItemId;
+				oPacketData.constraintItemId = NULL_ITEM_ID;
 
-				OutputMemoryStream ostream;
+				OutputMemoryStream ostream(PacketSize(oPacketHead, oPacketData));
 				oPacketHead.Write(ostream);
 				oPacketData.Write(ostream);
 
-				socket->SendPacket(ostream.GetBufferPtr(), ostream.GetSize());
+				App->networkManager->SendPacket(socket, std::move(ostream), PacketPriority::High);
 				setState(ST_UCP_SENDING_CONSTRAIN);
 			}
 		}
 		else
 		{
-			wLog << "OnPacketReceived() - PacketType::RequestItemResponse was unexpected.";
+			_negotiationAgreement = true;
+			App->modNodeCluster->ReportLastTravelDistance(distance_traveled);
+
+			PacketHeader oPacketHead;
+			oPacketHead.packetType = PacketType::SendConstraint;
+			oPacketHead.srcAgentId = id();
+			oPacketHead.dstAgentId = _uccLocation.agentId;
+
+			PacketSendConstraint oPacketData;
+			oPacketData.agreement = _negotiationAgreement;
+			oPacketData.constraintItemId = _contributedItemId;
+
+			OutputMemoryStream ostream(PacketSize(oPacketHead, oPacketData));
+			oPacketHead.Write(ostream);
+			oPacketData.Write(ostream);
+
+			App->networkManager->SendPacket(socket, std::move(ostream), PacketPriority::High);
+			setState(ST_UCP_SENDING_CONSTRAIN);
 		}
-		break;
 	}
-	case PacketType::SendConstraintResponse:
+	else
 	{
-		if (state() == ST_UCP_SENDING_CONSTRAIN)
-		{
-			socket->Disconnect();
-			setState(ST_UCP_NEGOTIATION_FINISHED);
-		}
-		else
-		{
-			wLog << "OnPacketReceived() - PacketType::SendConstraintResponse was unexpected.";
-		}
-		break;
+		wLog << "OnPacketReceived() - PacketType::RequestItemResponse was unexpected.";
 	}
-	default:
-		wLog << "OnPacketReceived() - Unexpected PacketType.";
+}
+
+void UCP::onSendConstraintResponse(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream)
+{
+	if (state() == ST_UCP_SENDING_CONSTRAIN)
+	{
+		setState(ST_UCP_NEGOTIATION_FINISHED);
+	}
+	else
+	{
+		wLog << "OnPacketReceived() - PacketType::SendConstraintResponse was unexpected.";
+	}
+}
+
+void UCP::OnConnectFailed(SocketHandle socket)
+{
+	// The remote UCC could not be reached
+	if (state() == ST_UCP_REQUESTING_ITEM || state() == ST_UCP_SENDING_CONSTRAIN)
+	{
+		wLog << "OnConnectFailed() - UCP " << id() << " could not reach its UCC.";
+		_negotiationAgreement = false;
+		setState(ST_UCP_NEGOTIATION_FINISHED);
 	}
 }
 
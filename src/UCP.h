@@ -18,7 +18,11 @@ public:
 	void update() override;
 	void stop() override;
 	UCP* asUCP() override { return this; }
-	void OnPacketReceived(TCPSocketPtr socket, const PacketHeader &packetHeader, InputMemoryStream &stream) override;
+	void OnPacketReceived(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream) override;
+	void OnConnectFailed(SocketHandle socket) override;
+
+	// Packet handlers of UCP agents
+	static PacketHandlerTable<UCP> &packetHandlers();
 
 	// TODO
 
@@ -32,6 +36,10 @@ public:
 
 private:
 
+	// Packet handlers
+	void onRequestItemResponse(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream);
+	void onSendConstraintResponse(SocketHandle socket, const PacketHeader &packetHeader, InputMemoryStream &stream);
+
 	// UCP data
 	uint16_t _requestedItemId; /**< The item to request. */
 	uint16_t _contributedItemId;
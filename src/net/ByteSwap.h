@@ -1,7 +1,15 @@
 #ifndef BYTE_SWAP_H
 #define BYTE_SWAP_H
 
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+
+// SSE2 is always there in x86-64 (and in x86 builds targeting it)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HAS_SSE2_BYTE_SWAP
+#include <emmintrin.h>
+#endif
 
 // Swap a word of 2 bytes
 inline uint16_t ByteSwap2(uint16_t inData)
@@ -98,4 +106,57 @@ T ByteSwap(T inData)
 	return ByteSwapper<T, sizeof(T)>().Swap(inData);
 }
 
+#ifdef HAS_SSE2_BYTE_SWAP
+// Swap the bytes of each 16-bit lane of a vector
+inline __m128i ByteSwapLanes2(__m128i inData)
+{
+	return _mm_or_si128(_mm_slli_epi16(inData, 8), _mm_srli_epi16(inData, 8));
+}
+#endif
+
+// Swap an array of inCount elements of inElementSize bytes (1, 2, 4 or 8)
+// from inData to outData. Both may be unaligned, but must not overlap.
+inline void ByteSwapArray(void *outData, const void *inData, size_t inCount, size_t inElementSize)
+{
+	char *out = static_cast<char*>(outData);
+	const char *in = static_cast<const char*>(inData);
+	size_t i = 0;
+
+	if (inElementSize == 1)
+	{
+		std::memcpy(out, in, inCount);
+		return;
+	}
+
+#ifdef HAS_SSE2_BYTE_SWAP
+	// 16 bytes per step: reorder the 16-bit words of each element and
+	// then swap the bytes within the words
+	const size_t perVector = 16 / inElementSize;
+	for (; i + perVector <= inCount; i += perVector)
+	{
+		__m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * inElementSize));
+		if (inElementSize == 4) {
+			data = _mm_shufflehi_epi16(_mm_shufflelo_epi16(data, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+		} else if (inElementSize == 8) {
+			data = _mm_shufflehi_epi16(_mm_shufflelo_epi16(data, _MM_SHUFFLE(0, 1, 2, 3)), _MM_SHUFFLE(0, 1, 2, 3));
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * inElementSize), ByteSwapLanes2(data));
+	}
+#endif
+
+	// Remaining elements, one by one
+	for (; i < inCount; ++i)
+	{
+		const char *src = in + i * inElementSize;
+		char *dst = out + i * inElementSize;
+		if (inElementSize == 2) {
+			uint16_t value; std::memcpy(&value, src, 2); value = ByteSwap2(value); std::memcpy(dst, &value, 2);
+		} else if (inElementSize == 4) {
+			uint32_t value; std::memcpy(&value, src, 4); value = ByteSwap4(value); std::memcpy(dst, &value, 4);
+		} else {
+			uint64_t value; std::memcpy(&value, src, 8); value = ByteSwap8(value); std::memcpy(dst, &value, 8);
+		}
+	}
+}
+
 #endif // BYTE_SWAP_H
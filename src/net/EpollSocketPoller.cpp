@@ -0,0 +1,136 @@
+#include "Net.h"
+
+#if defined(__linux__)
+
+EpollSocketPoller::EpollSocketPoller() :
+	mEpoll(epoll_create1(EPOLL_CLOEXEC)),
+	mEvents(256)
+{
+	if (mEpoll == -1)
+	{
+		SocketUtil::ReportError("EpollSocketPoller::EpollSocketPoller");
+	}
+}
+
+EpollSocketPoller::~EpollSocketPoller()
+{
+	for (const TCPSocketPtr &socket : mSocketsByFd)
+	{
+		if (socket != nullptr)
+		{
+			DetachSocket(*socket);
+		}
+	}
+
+	if (mEpoll != -1)
+	{
+		close(mEpoll);
+	}
+}
+
+void EpollSocketPoller::AddSocket(const TCPSocketPtr &socket)
+{
+	const int fd = socket->mSocket;
+
+	epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.fd = fd;
+	if (epoll_ctl(mEpoll, EPOLL_CTL_ADD, fd, &event) != 0)
+	{
+		SocketUtil::ReportError("EpollSocketPoller::AddSocket");
+		return;
+	}
+
+	if (mSocketsByFd.size() <= (size_t)fd)
+	{
+		mSocketsByFd.resize(fd + 1);
+	}
+	mSocketsByFd[fd] = socket;
+
+	AttachSocket(*socket, this);
+}
+
+void EpollSocketPoller::RemoveSocket(const TCPSocketPtr &socket)
+{
+	const int fd = socket->mSocket;
+	if ((size_t)fd >= mSocketsByFd.size() || mSocketsByFd[fd] != socket)
+	{
+		return; // Not registered
+	}
+
+	// It may fail if the descriptor was already closed (nothing to do then)
+	epoll_ctl(mEpoll, EPOLL_CTL_DEL, fd, nullptr);
+
+	mSocketsByFd[fd] = nullptr;
+	DetachSocket(*socket);
+}
+
+void EpollSocketPoller::SetWriteInterest(TCPSocket &socket, bool enable)
+{
+	epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = enable ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+	event.data.fd = socket.mSocket;
+	if (epoll_ctl(mEpoll, EPOLL_CTL_MOD, socket.mSocket, &event) != 0)
+	{
+		SocketUtil::ReportError("EpollSocketPoller::SetWriteInterest");
+	}
+}
+
+int EpollSocketPoller::Poll(
+		std::vector<TCPSocket*> &outReadableSockets,
+		std::vector<TCPSocket*> &outWritableSockets,
+		int timeoutMillis)
+{
+	const int eventCount = epoll_wait(mEpoll, mEvents.data(), (int)mEvents.size(), timeoutMillis);
+	if (eventCount < 0)
+	{
+		if (errno != EINTR)
+		{
+			SocketUtil::ReportError("EpollSocketPoller::Poll");
+		}
+		return 0;
+	}
+
+	for (int i = 0; i < eventCount; ++i)
+	{
+		const epoll_event &event(mEvents[i]);
+		const TCPSocketPtr &socket(mSocketsByFd[event.data.fd]);
+		if (socket == nullptr || socket->IsDisconnected())
+		{
+			continue;
+		}
+
+		// Connects in progress complete (or fail) through the write path
+		if (socket->IsConnecting())
+		{
+			if (event.events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+			{
+				outWritableSockets.push_back(socket.get());
+			}
+			continue;
+		}
+
+		// Errors and hang ups are reported through the read path,
+		// where recv() will tell the socket it was disconnected
+		if (event.events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+		{
+			outReadableSockets.push_back(socket.get());
+		}
+		if (event.events & EPOLLOUT)
+		{
+			outWritableSockets.push_back(socket.get());
+		}
+	}
+
+	// Make room for more events next time if we got a full batch
+	if (eventCount == (int)mEvents.size())
+	{
+		mEvents.resize(mEvents.size() * 2);
+	}
+
+	return eventCount;
+}
+
+#endif // __linux__
@@ -0,0 +1,41 @@
+#ifndef EPOLL_SOCKET_POLLER_H
+#define EPOLL_SOCKET_POLLER_H
+
+#if defined(__linux__)
+
+/**
+ * Linux readiness backend built on top of epoll.
+ * Sockets are registered once in the kernel, and the cost of Poll()
+ * is proportional to the number of ready sockets only.
+ */
+class EpollSocketPoller : public SocketPoller
+{
+public:
+
+	EpollSocketPoller();
+	~EpollSocketPoller() override;
+
+	bool IsValid() const { return mEpoll != -1; }
+
+	void AddSocket(const TCPSocketPtr &socket) override;
+	void RemoveSocket(const TCPSocketPtr &socket) override;
+	void SetWriteInterest(TCPSocket &socket, bool enable) override;
+
+	int Poll(
+			std::vector<TCPSocket*> &outReadableSockets,
+			std::vector<TCPSocket*> &outWritableSockets,
+			int timeoutMillis) override;
+
+	SocketPollerBackend GetBackend() const override { return SocketPollerBackend::Epoll; }
+	const char *GetName() const override { return "epoll"; }
+
+private:
+
+	int mEpoll; /**< The epoll instance. */
+	std::vector<TCPSocketPtr> mSocketsByFd; /**< Registered sockets, indexed by descriptor. */
+	std::vector<epoll_event> mEvents; /**< Output of epoll_wait. Grows when it gets full. */
+};
+
+#endif // __linux__
+
+#endif // EPOLL_SOCKET_POLLER_H
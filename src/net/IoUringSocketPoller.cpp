@@ -0,0 +1,860 @@
+#include "Net.h"
+
+#if defined(HAS_IO_URING)
+
+// Requests that can be queued before a submission is forced
+static const uint32_t IO_URING_SQ_ENTRIES = 256;
+
+// Completions the kernel can hold before it has to buffer them aside
+static const uint32_t IO_URING_CQ_ENTRIES = 4096;
+
+// User data of the requests whose completions are not interesting
+// (poll updates and removals)
+static const uint64_t IO_URING_IGNORED_USER_DATA = ~0ull;
+
+// User data of the requests that check what the kernel supports
+static const uint64_t IO_URING_PROBE_USER_DATA = ~0ull - 1;
+
+// The user data of the other requests holds the descriptor (low 32
+// bits), the request type (next 8 bits) and the generation (the rest)
+static const uint32_t IO_URING_GENERATION_MASK = 0xffffff;
+
+// Receive buffers shared by all the sockets (the ring size must be a
+// power of two). A socket that finds none left stops receiving until
+// the data of the others is taken.
+static const uint32_t IO_URING_RECEIVE_BUFFER_COUNT = 1024;
+static const uint32_t IO_URING_RECEIVE_BUFFER_SIZE = 4096;
+static const uint16_t IO_URING_RECEIVE_BUFFER_GROUP = 0;
+
+// Buffers a socket can fill before it stops receiving until the data
+// is taken (like a receive buffer of the kernel, so that a peer which
+// sends faster than it is read cannot take all of them)
+static const uint32_t IO_URING_SOCKET_RECEIVE_BUFFERS = 64;
+
+static int io_uring_setup(uint32_t entries, io_uring_params *params)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_register(int ring, uint32_t opcode, const void *arg, uint32_t argCount)
+{
+	return (int)syscall(__NR_io_uring_register, ring, opcode, arg, argCount);
+}
+
+static int io_uring_enter(int ring, uint32_t toSubmit, uint32_t minComplete, uint32_t flags, const void *arg, size_t argSize)
+{
+	return (int)syscall(__NR_io_uring_enter, ring, toSubmit, minComplete, flags, arg, argSize);
+}
+
+IoUringSocketPoller::IoUringSocketPoller() :
+	mRing(-1),
+	mDoesIO(false),
+	mSqRing(MAP_FAILED), mSqRingSize(0),
+	mSqHead(nullptr), mSqTail(nullptr), mSqMask(0), mSqEntries(0), mSqArray(nullptr),
+	mSqes(static_cast<io_uring_sqe*>(MAP_FAILED)), mSqesSize(0),
+	mCqRing(MAP_FAILED), mCqRingSize(0),
+	mCqHead(nullptr), mCqTail(nullptr), mCqMask(0), mCqes(nullptr),
+	mBufferRing(static_cast<io_uring_buf*>(MAP_FAILED)),
+	mBuffers(static_cast<char*>(MAP_FAILED)),
+	mBufferRingTail(0),
+	mBuffersGivenBack(false),
+	mSqLocalTail(0)
+{
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE;
+	params.cq_entries = IO_URING_CQ_ENTRIES;
+
+	const int ring = io_uring_setup(IO_URING_SQ_ENTRIES, &params);
+	if (ring == -1)
+	{
+		SocketUtil::ReportError("IoUringSocketPoller::IoUringSocketPoller");
+		return;
+	}
+
+	// Waiting with a timeout needs IORING_ENTER_EXT_ARG (Linux 5.11)
+	if ((params.features & IORING_FEAT_EXT_ARG) == 0 || !MapRings(ring, params))
+	{
+		UnmapRings();
+		close(ring);
+		return;
+	}
+
+	// Write interest changes update the poll requests in place, which
+	// needs IORING_POLL_UPDATE_EVENTS (Linux 5.13)
+	mRing = ring;
+	if (!CanUpdatePolls())
+	{
+		close(mRing);
+		mRing = -1;
+		return;
+	}
+
+	// Accepting and receiving on its own needs multishot receives and
+	// buffer rings (Linux 6.0), otherwise it only waits for readiness
+	mDoesIO = RegisterReceiveBuffers() && CanReceiveMultishot();
+	if (!mDoesIO)
+	{
+		UnregisterReceiveBuffers();
+	}
+}
+
+IoUringSocketPoller::~IoUringSocketPoller()
+{
+	for (const Registration &registration : mSocketsByFd)
+	{
+		if (registration.socket != nullptr)
+		{
+			DetachSocket(*registration.socket);
+		}
+	}
+
+	// Closing the ring cancels all the requests still in the kernel
+	if (mRing != -1)
+	{
+		close(mRing);
+		mRing = -1;
+	}
+	UnmapRings();
+	UnregisterReceiveBuffers();
+}
+
+bool IoUringSocketPoller::MapRings(int ring, const io_uring_params &params)
+{
+	mSqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	mCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	const bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (singleMmap)
+	{
+		mSqRingSize = std::max(mSqRingSize, mCqRingSize);
+	}
+
+	mSqRing = mmap(nullptr, mSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+	if (mSqRing == MAP_FAILED)
+	{
+		SocketUtil::ReportError("IoUringSocketPoller::MapRings");
+		return false;
+	}
+
+	if (!singleMmap)
+	{
+		mCqRing = mmap(nullptr, mCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+		if (mCqRing == MAP_FAILED)
+		{
+			SocketUtil::ReportError("IoUringSocketPoller::MapRings");
+			return false;
+		}
+	}
+
+	mSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	mSqes = static_cast<io_uring_sqe*>(mmap(nullptr, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES));
+	if (mSqes == MAP_FAILED)
+	{
+		SocketUtil::ReportError("IoUringSocketPoller::MapRings");
+		return false;
+	}
+
+	char *sq = static_cast<char*>(mSqRing);
+	mSqHead = reinterpret_cast<uint32_t*>(sq + params.sq_off.head);
+	mSqTail = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+	mSqMask = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+	mSqEntries = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_entries);
+	mSqArray = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+	mSqLocalTail = *mSqTail;
+
+	char *cq = singleMmap ? sq : static_cast<char*>(mCqRing);
+	mCqHead = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+	mCqTail = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+	mCqMask = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+	mCqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+	return true;
+}
+
+void IoUringSocketPoller::UnmapRings()
+{
+	// Reset the pointers so that unmapping again does nothing
+	if (mSqes != MAP_FAILED)
+	{
+		munmap(mSqes, mSqesSize);
+		mSqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+		mSqesSize = 0;
+	}
+	if (mCqRing != MAP_FAILED)
+	{
+		munmap(mCqRing, mCqRingSize);
+		mCqRing = MAP_FAILED;
+		mCqRingSize = 0;
+	}
+	if (mSqRing != MAP_FAILED)
+	{
+		munmap(mSqRing, mSqRingSize);
+		mSqRing = MAP_FAILED;
+		mSqRingSize = 0;
+	}
+}
+
+int IoUringSocketPoller::RunProbe()
+{
+	// Submit the request just queued and wait for its result
+	Enter(1, -1);
+
+	int result = -EINVAL;
+	uint32_t head = *mCqHead;
+	const uint32_t tail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+	for (; head != tail; ++head)
+	{
+		const io_uring_cqe &cqe(mCqes[head & mCqMask]);
+		if (cqe.user_data == IO_URING_PROBE_USER_DATA)
+		{
+			result = cqe.res;
+		}
+	}
+	__atomic_store_n(mCqHead, head, __ATOMIC_RELEASE);
+	return result;
+}
+
+bool IoUringSocketPoller::CanUpdatePolls()
+{
+	// Update a poll request that does not exist: kernels that know about
+	// updates answer -ENOENT, older ones reject the request with -EINVAL
+	io_uring_sqe *sqe = GetSqe();
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = IO_URING_IGNORED_USER_DATA;
+	sqe->len = IORING_POLL_UPDATE_EVENTS;
+	sqe->poll32_events = POLLIN;
+	sqe->user_data = IO_URING_PROBE_USER_DATA;
+	return RunProbe() != -EINVAL;
+}
+
+bool IoUringSocketPoller::CanReceiveMultishot()
+{
+	// Same with a multishot receive on an invalid descriptor: -EBADF if
+	// the kernel knows about them, -EINVAL otherwise
+	io_uring_sqe *sqe = GetSqe();
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = -1;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = IO_URING_RECEIVE_BUFFER_GROUP;
+	sqe->user_data = IO_URING_PROBE_USER_DATA;
+	return RunProbe() != -EINVAL;
+}
+
+bool IoUringSocketPoller::RegisterReceiveBuffers()
+{
+	const size_t ringSize = IO_URING_RECEIVE_BUFFER_COUNT * sizeof(io_uring_buf);
+	mBufferRing = static_cast<io_uring_buf*>(mmap(nullptr, ringSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	mBuffers = static_cast<char*>(mmap(nullptr, IO_URING_RECEIVE_BUFFER_COUNT * IO_URING_RECEIVE_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	if (mBufferRing == MAP_FAILED || mBuffers == MAP_FAILED)
+	{
+		SocketUtil::ReportError("IoUringSocketPoller::RegisterReceiveBuffers");
+		return false;
+	}
+
+	io_uring_buf_reg registration;
+	memset(&registration, 0, sizeof(registration));
+	registration.ring_addr = (uint64_t)(uintptr_t)mBufferRing;
+	registration.ring_entries = IO_URING_RECEIVE_BUFFER_COUNT;
+	registration.bgid = IO_URING_RECEIVE_BUFFER_GROUP;
+	if (io_uring_register(mRing, IORING_REGISTER_PBUF_RING, &registration, 1) < 0)
+	{
+		return false; // Before Linux 5.19
+	}
+
+	for (uint32_t buffer = 0; buffer < IO_URING_RECEIVE_BUFFER_COUNT; ++buffer)
+	{
+		RecycleReceiveBuffer((uint16_t)buffer);
+	}
+	return true;
+}
+
+void IoUringSocketPoller::UnregisterReceiveBuffers()
+{
+	// Otherwise the kernel forgets about them along with the ring
+	if (mRing != -1 && mBufferRing != MAP_FAILED)
+	{
+		io_uring_buf_reg registration;
+		memset(&registration, 0, sizeof(registration));
+		registration.bgid = IO_URING_RECEIVE_BUFFER_GROUP;
+		io_uring_register(mRing, IORING_UNREGISTER_PBUF_RING, &registration, 1);
+	}
+
+	if (mBufferRing != MAP_FAILED)
+	{
+		munmap(mBufferRing, IO_URING_RECEIVE_BUFFER_COUNT * sizeof(io_uring_buf));
+		mBufferRing = static_cast<io_uring_buf*>(MAP_FAILED);
+	}
+	if (mBuffers != MAP_FAILED)
+	{
+		munmap(mBuffers, IO_URING_RECEIVE_BUFFER_COUNT * IO_URING_RECEIVE_BUFFER_SIZE);
+		mBuffers = static_cast<char*>(MAP_FAILED);
+	}
+}
+
+void IoUringSocketPoller::AddSocket(const TCPSocketPtr &socket)
+{
+	const int fd = socket->mSocket;
+	if (mSocketsByFd.size() <= (size_t)fd)
+	{
+		mSocketsByFd.resize(fd + 1);
+	}
+
+	Registration &registration = mSocketsByFd[fd];
+	registration.socket = socket;
+	registration.armed = false;
+	registration.writeInterest = false;
+	registration.sending = false;
+	registration.throttled = false;
+	registration.starved = false;
+	registration.peerClosed = false;
+	registration.receiveError = 0;
+	registration.pollEvents = 0;
+	mPendingArms.push_back(fd);
+
+	AttachSocket(*socket, this);
+}
+
+void IoUringSocketPoller::RemoveSocket(const TCPSocketPtr &socket)
+{
+	const int fd = socket->mSocket;
+	if ((size_t)fd >= mSocketsByFd.size() || mSocketsByFd[fd].socket != socket)
+	{
+		return; // Not registered
+	}
+
+	Registration &registration = mSocketsByFd[fd];
+	if (registration.armed)
+	{
+		CancelRequest(UserData(fd, registration.armedType));
+	}
+	if (registration.sending)
+	{
+		// The kernel may still read the packets being sent, which belong
+		// to the socket: wait until it is done with them
+		CancelRequest(UserData(fd, RequestSend));
+		while (registration.sending)
+		{
+			Enter(1, -1);
+			ProcessCompletions();
+		}
+	}
+	else if (registration.armed)
+	{
+		// Submit it right away: the request keeps the socket open in the
+		// kernel, even after the descriptor is closed
+		Enter(0, 0);
+	}
+
+	// Give back what the socket did not take
+	for (SOCKET acceptedSocket : registration.acceptedSockets)
+	{
+		close(acceptedSocket);
+	}
+	registration.acceptedSockets.clear();
+	for (const ReceivedData &data : registration.receivedData)
+	{
+		RecycleReceiveBuffer(data.buffer);
+	}
+	registration.receivedData.clear();
+
+	// Completions still on their way will not match anymore
+	registration.socket = nullptr;
+	registration.generation = (registration.generation + 1) & IO_URING_GENERATION_MASK;
+	registration.armed = false;
+	DetachSocket(*socket);
+}
+
+void IoUringSocketPoller::SetWriteInterest(TCPSocket &socket, bool enable)
+{
+	const int fd = socket.mSocket;
+	Registration &registration = mSocketsByFd[fd];
+	if (registration.writeInterest == enable)
+	{
+		return;
+	}
+	registration.writeInterest = enable;
+
+	// Connected sockets can hand over a send right away
+	if (enable && mDoesIO)
+	{
+		MarkReady(fd);
+	}
+
+	// If the poll request already completed, it is armed again with the
+	// new events. If it is still in the kernel, its events are updated.
+	// The update fails harmlessly if the request completes meanwhile.
+	if (registration.armed && registration.armedType == RequestPoll)
+	{
+		io_uring_sqe *sqe = GetSqe();
+		sqe->opcode = IORING_OP_POLL_REMOVE;
+		sqe->fd = -1;
+		sqe->addr = UserData(fd, RequestPoll);
+		sqe->len = IORING_POLL_UPDATE_EVENTS;
+		sqe->poll32_events = PollEvents(registration);
+		sqe->user_data = IO_URING_IGNORED_USER_DATA;
+	}
+}
+
+int IoUringSocketPoller::Poll(
+		std::vector<TCPSocket*> &outReadableSockets,
+		std::vector<TCPSocket*> &outWritableSockets,
+		int timeoutMillis)
+{
+	// The sockets that ran out of buffers receive again once some are
+	// given back (until then they read from the socket themselves)
+	if (mBuffersGivenBack && !mStarvedSockets.empty())
+	{
+		for (int fd : mStarvedSockets)
+		{
+			mSocketsByFd[fd].starved = false;
+			mPendingArms.push_back(fd);
+		}
+		mStarvedSockets.clear();
+	}
+
+	// Queue the requests of the new sockets and of the ones that
+	// completed last time. They are submitted along with the wait below.
+	for (int fd : mPendingArms)
+	{
+		ArmRequest(fd);
+	}
+	mPendingArms.clear();
+
+	// Forget the sockets that have nothing left to report, and do not
+	// wait if the others or the completions have something
+	size_t readyCount = 0;
+	for (int fd : mReadySockets)
+	{
+		Registration &registration = mSocketsByFd[fd];
+		if (IsReady(registration))
+		{
+			mReadySockets[readyCount++] = fd;
+		}
+		else
+		{
+			registration.listed = false;
+		}
+	}
+	mReadySockets.resize(readyCount);
+	const bool ready = readyCount > 0 || __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE) != *mCqHead;
+	Enter(ready || timeoutMillis == 0 ? 0 : 1, timeoutMillis);
+
+	ProcessCompletions();
+
+	int eventCount = 0;
+	for (int fd : mReadySockets)
+	{
+		Registration &registration = mSocketsByFd[fd];
+		if (!IsReady(registration))
+		{
+			continue; // Forgotten next time
+		}
+
+		// A poll request reports its events only once
+		const uint32_t events = registration.pollEvents;
+		registration.pollEvents = 0;
+		eventCount++;
+
+		TCPSocket *socket = registration.socket.get();
+
+		// Connects in progress complete (or fail) through the write path
+		if (socket->IsConnecting())
+		{
+			if (events & (POLLOUT | POLLERR | POLLHUP))
+			{
+				outWritableSockets.push_back(socket);
+			}
+			continue;
+		}
+
+		// Errors and hang ups are reported through the read path,
+		// where recv() will tell the socket it was disconnected
+		const bool hasReceived = !registration.acceptedSockets.empty() || !registration.receivedData.empty() ||
+			registration.peerClosed || registration.receiveError != 0;
+		if (hasReceived || (events & (POLLIN | POLLERR | POLLHUP)))
+		{
+			outReadableSockets.push_back(socket);
+		}
+		const bool canSend = mDoesIO && registration.writeInterest && !registration.sending;
+		if (canSend || (events & POLLOUT))
+		{
+			outWritableSockets.push_back(socket);
+		}
+	}
+
+	return eventCount;
+}
+
+SOCKET IoUringSocketPoller::TakeAcceptedSocket(TCPSocket &listenSocket)
+{
+	Registration &registration = mSocketsByFd[listenSocket.mSocket];
+	if (registration.acceptedSockets.empty())
+	{
+		return INVALID_SOCKET;
+	}
+
+	const SOCKET acceptedSocket = registration.acceptedSockets.front();
+	registration.acceptedSockets.pop_front();
+	return acceptedSocket;
+}
+
+int IoUringSocketPoller::Receive(TCPSocket &socket, const RingBufferRegion *regions, int regionCount)
+{
+	Registration &registration = mSocketsByFd[socket.mSocket];
+
+	// Fill the regions in order with the data received in order
+	int receivedBytes = 0;
+	for (int i = 0; i < regionCount; ++i)
+	{
+		uint32_t regionOffset = 0;
+		while (regionOffset < regions[i].size && !registration.receivedData.empty())
+		{
+			ReceivedData &data = registration.receivedData.front();
+			const uint32_t size = std::min(regions[i].size - regionOffset, data.size);
+			memcpy(regions[i].data + regionOffset, mBuffers + data.buffer * IO_URING_RECEIVE_BUFFER_SIZE + data.offset, size);
+			regionOffset += size;
+			receivedBytes += size;
+			data.offset += size;
+			data.size -= size;
+			if (data.size == 0)
+			{
+				RecycleReceiveBuffer(data.buffer);
+				registration.receivedData.pop_front();
+			}
+		}
+	}
+
+	if (receivedBytes == 0 && registration.starved)
+	{
+		iovec buffers[2];
+		for (int i = 0; i < regionCount; ++i)
+		{
+			buffers[i].iov_base = regions[i].data;
+			buffers[i].iov_len = regions[i].size;
+		}
+		return (int)readv(socket.mSocket, buffers, regionCount);
+	}
+
+	if (registration.throttled && registration.receivedData.size() <= IO_URING_SOCKET_RECEIVE_BUFFERS / 2)
+	{
+		registration.throttled = false;
+		if (!registration.armed)
+		{
+			mPendingArms.push_back(socket.mSocket);
+		}
+	}
+
+	// The end of the stream and errors come after the data
+	if (receivedBytes > 0 || registration.peerClosed)
+	{
+		return receivedBytes;
+	}
+	errno = registration.receiveError != 0 ? registration.receiveError : WSAEWOULDBLOCK;
+	return -1;
+}
+
+void IoUringSocketPoller::Send(TCPSocket &socket, const RingBufferRegion *regions, int regionCount)
+{
+	const int fd = socket.mSocket;
+	Registration &registration = mSocketsByFd[fd];
+	if (registration.sendRequest == nullptr)
+	{
+		registration.sendRequest.reset(new SendRequest());
+	}
+
+	SendRequest &request = *registration.sendRequest;
+	request.size = 0;
+	for (int i = 0; i < regionCount; ++i)
+	{
+		request.buffers[i].iov_base = regions[i].data;
+		request.buffers[i].iov_len = regions[i].size;
+		request.size += regions[i].size;
+	}
+	memset(&request.message, 0, sizeof(request.message));
+	request.message.msg_iov = request.buffers;
+	request.message.msg_iovlen = regionCount;
+
+	io_uring_sqe *sqe = GetSqe();
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t)&request.message;
+	sqe->len = 1;
+	sqe->msg_flags = SEND_FLAGS;
+	sqe->user_data = UserData(fd, RequestSend);
+	registration.sending = true;
+}
+
+io_uring_sqe *IoUringSocketPoller::GetSqe()
+{
+	// Make room by submitting what is queued if the ring is full
+	if (mSqLocalTail - __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE) == mSqEntries)
+	{
+		Enter(0, 0);
+	}
+
+	const uint32_t index = mSqLocalTail & mSqMask;
+	io_uring_sqe *sqe = &mSqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	mSqArray[index] = index;
+	mSqLocalTail++;
+	return sqe;
+}
+
+void IoUringSocketPoller::ArmRequest(int fd)
+{
+	Registration &registration = mSocketsByFd[fd];
+	if (registration.socket == nullptr || registration.armed)
+	{
+		return;
+	}
+
+	const TCPSocket &socket(*registration.socket);
+	io_uring_sqe *sqe = GetSqe();
+	sqe->fd = fd;
+	if (!mDoesIO || socket.IsConnecting() || registration.starved)
+	{
+		// One-shot requests: arming checks the socket state right away,
+		// so data that was left unread is reported again (like
+		// level-triggered epoll, which the accept and read paths rely on)
+		registration.armedType = RequestPoll;
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->poll32_events = PollEvents(registration);
+	}
+	else if (socket.IsListening())
+	{
+		// Accepts until canceled, without the peer addresses
+		registration.armedType = RequestAccept;
+		sqe->opcode = IORING_OP_ACCEPT;
+		sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	}
+	else
+	{
+		// Receives until canceled, into buffers picked by the kernel
+		registration.armedType = RequestReceive;
+		sqe->opcode = IORING_OP_RECV;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = IO_URING_RECEIVE_BUFFER_GROUP;
+	}
+	sqe->user_data = UserData(fd, registration.armedType);
+	registration.armed = true;
+}
+
+void IoUringSocketPoller::CancelRequest(uint64_t userData)
+{
+	io_uring_sqe *sqe = GetSqe();
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = userData;
+	sqe->user_data = IO_URING_IGNORED_USER_DATA;
+}
+
+void IoUringSocketPoller::Enter(uint32_t minComplete, int timeoutMillis)
+{
+	__atomic_store_n(mSqTail, mSqLocalTail, __ATOMIC_RELEASE);
+	const uint32_t toSubmit = mSqLocalTail - __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+
+	if (toSubmit == 0 && minComplete == 0)
+	{
+		return;
+	}
+
+	__kernel_timespec timeout;
+	timeout.tv_sec = timeoutMillis / 1000;
+	timeout.tv_nsec = (timeoutMillis % 1000) * 1000000ll;
+
+	io_uring_getevents_arg arg;
+	memset(&arg, 0, sizeof(arg));
+	arg.ts = timeoutMillis >= 0 ? (uint64_t)(uintptr_t)&timeout : 0;
+
+	const uint32_t flags = minComplete > 0 ? (IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG) : 0;
+	if (io_uring_enter(mRing, toSubmit, minComplete, flags, flags != 0 ? &arg : nullptr, flags != 0 ? sizeof(arg) : 0) < 0)
+	{
+		if (errno != EINTR && errno != ETIME && errno != EBUSY)
+		{
+			SocketUtil::ReportError("IoUringSocketPoller::Enter");
+		}
+	}
+}
+
+void IoUringSocketPoller::ProcessCompletions()
+{
+	uint32_t head = *mCqHead;
+	const uint32_t tail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+	for (; head != tail; ++head)
+	{
+		ProcessCompletion(mCqes[head & mCqMask]);
+	}
+	__atomic_store_n(mCqHead, head, __ATOMIC_RELEASE);
+}
+
+void IoUringSocketPoller::ProcessCompletion(const io_uring_cqe &cqe)
+{
+	if (cqe.user_data == IO_URING_IGNORED_USER_DATA || cqe.user_data == IO_URING_PROBE_USER_DATA)
+	{
+		return;
+	}
+
+	const int fd = (int)(cqe.user_data & 0xffffffff);
+	const RequestType type = (RequestType)((cqe.user_data >> 32) & 0xff);
+	const uint32_t generation = (uint32_t)(cqe.user_data >> 40);
+	const bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+	Registration *registration = &mSocketsByFd[fd];
+	if (registration->generation != generation || registration->socket == nullptr)
+	{
+		registration = nullptr; // From an unregistered socket
+	}
+
+	switch (type)
+	{
+	case RequestPoll:
+		if (registration != nullptr)
+		{
+			// A failed poll request is reported as an error on the socket
+			registration->armed = false;
+			registration->pollEvents |= cqe.res < 0 ? POLLERR : (uint32_t)cqe.res;
+			mPendingArms.push_back(fd);
+			MarkReady(fd);
+		}
+		break;
+
+	case RequestAccept:
+		if (registration == nullptr)
+		{
+			if (cqe.res >= 0)
+			{
+				close(cqe.res); // Nobody will take it
+			}
+			break;
+		}
+		if (cqe.res >= 0)
+		{
+			registration->acceptedSockets.push_back(cqe.res);
+			MarkReady(fd);
+		}
+		else if (cqe.res != -ECANCELED)
+		{
+			errno = -cqe.res;
+			SocketUtil::ReportError("IoUringSocketPoller::Accept");
+		}
+		if (!more)
+		{
+			registration->armed = false;
+			mPendingArms.push_back(fd);
+		}
+		break;
+
+	case RequestReceive:
+		if (cqe.flags & IORING_CQE_F_BUFFER)
+		{
+			const uint16_t buffer = (uint16_t)(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+			if (registration != nullptr && cqe.res > 0)
+			{
+				registration->receivedData.push_back(ReceivedData{ buffer, 0, (uint32_t)cqe.res });
+				if (registration->receivedData.size() >= IO_URING_SOCKET_RECEIVE_BUFFERS && more && !registration->throttled)
+				{
+					CancelRequest(UserData(fd, RequestReceive));
+					registration->throttled = true;
+				}
+			}
+			else
+			{
+				RecycleReceiveBuffer(buffer);
+			}
+		}
+		if (registration == nullptr)
+		{
+			break;
+		}
+		if (cqe.res == 0)
+		{
+			registration->peerClosed = true;
+		}
+		else if (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED)
+		{
+			registration->receiveError = -cqe.res;
+		}
+		MarkReady(fd);
+		if (!more)
+		{
+			// Armed again when some buffers are given back, when the
+			// socket takes its data, or right away if it just stopped
+			registration->armed = false;
+			if (cqe.res == -ENOBUFS)
+			{
+				// Read from the socket itself (right away, and whenever it
+				// is readable) until some buffers are given back
+				registration->starved = true;
+				registration->pollEvents |= POLLIN;
+				mBuffersGivenBack = false;
+				mStarvedSockets.push_back(fd);
+				mPendingArms.push_back(fd);
+			}
+			else if ((cqe.res > 0 || cqe.res == -ECANCELED) && !registration->throttled)
+			{
+				mPendingArms.push_back(fd);
+			}
+		}
+		break;
+
+	case RequestSend:
+		// Sockets are not unregistered before their sends complete
+		registration->sending = false;
+		CompleteSend(*registration->socket, registration->sendRequest->size, cqe.res);
+		MarkReady(fd);
+		break;
+	}
+}
+
+void IoUringSocketPoller::RecycleReceiveBuffer(uint16_t buffer)
+{
+	// The tail of the ring overlays the reserved field of its first
+	// entry (io_uring_buf_ring, whose flexible array is misplaced in C++)
+	io_uring_buf &ringEntry = mBufferRing[mBufferRingTail & (IO_URING_RECEIVE_BUFFER_COUNT - 1)];
+	ringEntry.addr = (uint64_t)(uintptr_t)(mBuffers + buffer * IO_URING_RECEIVE_BUFFER_SIZE);
+	ringEntry.len = IO_URING_RECEIVE_BUFFER_SIZE;
+	ringEntry.bid = buffer;
+	mBufferRingTail++;
+	__atomic_store_n(&mBufferRing[0].resv, mBufferRingTail, __ATOMIC_RELEASE);
+
+	mBuffersGivenBack = true;
+}
+
+void IoUringSocketPoller::MarkReady(int fd)
+{
+	Registration &registration = mSocketsByFd[fd];
+	if (!registration.listed)
+	{
+		registration.listed = true;
+		mReadySockets.push_back(fd);
+	}
+}
+
+bool IoUringSocketPoller::IsReady(const Registration &registration) const
+{
+	if (registration.socket == nullptr || registration.socket->IsDisconnected())
+	{
+		return false;
+	}
+	return registration.pollEvents != 0 ||
+		!registration.acceptedSockets.empty() ||
+		!registration.receivedData.empty() ||
+		registration.peerClosed ||
+		registration.receiveError != 0 ||
+		(mDoesIO && registration.writeInterest && !registration.sending && !registration.socket->IsConnecting());
+}
+
+uint64_t IoUringSocketPoller::UserData(int fd, RequestType type) const
+{
+	return ((uint64_t)mSocketsByFd[fd].generation << 40) | ((uint64_t)type << 32) | (uint32_t)fd;
+}
+
+uint32_t IoUringSocketPoller::PollEvents(const Registration &registration) const
+{
+	// Connected sockets send through requests of their own
+	const bool pollOut = registration.writeInterest && (!mDoesIO || registration.socket->IsConnecting());
+	return pollOut ? (POLLIN | POLLOUT) : POLLIN;
+}
+
+#endif // HAS_IO_URING
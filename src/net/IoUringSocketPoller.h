@@ -0,0 +1,152 @@
+#ifndef IO_URING_SOCKET_POLLER_H
+#define IO_URING_SOCKET_POLLER_H
+
+#if defined(HAS_IO_URING)
+
+/**
+ * Linux backend built on top of io_uring.
+ * On Linux 6.0 and later it also does the I/O of its sockets: every
+ * listen socket has one multishot accept request in the kernel, and
+ * every connected socket one multishot receive request, which fills
+ * buffers registered with the kernel. The sends are handed over as
+ * requests too. All the requests queued between two calls of Poll()
+ * (like the replies sent while handling the packets received) are
+ * submitted by the same system call that waits for the completions.
+ * On older kernels it only waits for readiness, with one poll request
+ * per socket, and the sockets make the system calls themselves.
+ * It needs Linux 5.13 (poll updates); on older kernels it is not valid
+ * and SocketUtil::CreateSocketPoller falls back to epoll.
+ */
+class IoUringSocketPoller : public SocketPoller
+{
+public:
+
+	IoUringSocketPoller();
+	~IoUringSocketPoller() override;
+
+	bool IsValid() const { return mRing != -1; }
+
+	void AddSocket(const TCPSocketPtr &socket) override;
+	void RemoveSocket(const TCPSocketPtr &socket) override;
+	void SetWriteInterest(TCPSocket &socket, bool enable) override;
+
+	int Poll(
+			std::vector<TCPSocket*> &outReadableSockets,
+			std::vector<TCPSocket*> &outWritableSockets,
+			int timeoutMillis) override;
+
+	SocketPollerBackend GetBackend() const override { return SocketPollerBackend::IoUring; }
+	const char *GetName() const override { return "io_uring"; }
+
+	bool DoesIO() const override { return mDoesIO; }
+	SOCKET TakeAcceptedSocket(TCPSocket &listenSocket) override;
+	int Receive(TCPSocket &socket, const RingBufferRegion *regions, int regionCount) override;
+	void Send(TCPSocket &socket, const RingBufferRegion *regions, int regionCount) override;
+
+private:
+
+	// Kinds of requests, told apart by their user data
+	enum RequestType
+	{
+		RequestPoll,
+		RequestAccept,
+		RequestReceive,
+		RequestSend
+	};
+
+	// Part of a receive buffer not taken by the socket yet
+	struct ReceivedData
+	{
+		uint16_t buffer;
+		uint32_t offset;
+		uint32_t size;
+	};
+
+	// Send in progress. It is allocated apart, so that it does not move
+	// while the kernel uses it.
+	struct SendRequest
+	{
+		msghdr message;
+		iovec buffers[MAX_SEND_REGIONS];
+		uint32_t size;
+	};
+
+	struct Registration
+	{
+		TCPSocketPtr socket;
+		uint32_t generation = 0;   /**< Tells apart completions of earlier sockets with the same descriptor. */
+		bool armed = false;        /**< It has a poll, accept or receive request in the kernel. */
+		RequestType armedType = RequestPoll;
+		bool writeInterest = false;
+		bool listed = false;       /**< It is in mReadySockets. */
+		bool sending = false;      /**< It has a send request in the kernel. */
+		bool throttled = false;    /**< Its receive request was canceled until it takes its data. */
+		bool starved = false;      /**< Its receive request ran out of buffers. */
+		bool peerClosed = false;   /**< The receive request found the end of the stream. */
+		int receiveError = 0;      /**< Error found by the receive request. */
+		uint32_t pollEvents = 0;   /**< Events of the last poll request, not reported yet. */
+		std::deque<SOCKET> acceptedSockets;
+		std::deque<ReceivedData> receivedData;
+		std::unique_ptr<SendRequest> sendRequest;
+	};
+
+	bool MapRings(int ring, const io_uring_params &params);
+	void UnmapRings();
+	int RunProbe();
+	bool CanUpdatePolls();
+	bool CanReceiveMultishot();
+	bool RegisterReceiveBuffers();
+	void UnregisterReceiveBuffers();
+
+	io_uring_sqe *GetSqe();
+	void ArmRequest(int fd);
+	void CancelRequest(uint64_t userData);
+	void Enter(uint32_t minComplete, int timeoutMillis);
+	void ProcessCompletions();
+	void ProcessCompletion(const io_uring_cqe &cqe);
+	void RecycleReceiveBuffer(uint16_t buffer);
+
+	void MarkReady(int fd);
+	bool IsReady(const Registration &registration) const;
+
+	uint64_t UserData(int fd, RequestType type) const;
+	uint32_t PollEvents(const Registration &registration) const;
+
+	int mRing; /**< The io_uring instance. */
+	bool mDoesIO; /**< It accepts, receives and sends (Linux 6.0). */
+
+	// Submission queue (shared with the kernel)
+	void *mSqRing;
+	size_t mSqRingSize;
+	uint32_t *mSqHead;
+	uint32_t *mSqTail;
+	uint32_t mSqMask;
+	uint32_t mSqEntries;
+	uint32_t *mSqArray;
+	io_uring_sqe *mSqes;
+	size_t mSqesSize;
+
+	// Completion queue (shared with the kernel)
+	void *mCqRing;
+	size_t mCqRingSize;
+	uint32_t *mCqHead;
+	uint32_t *mCqTail;
+	uint32_t mCqMask;
+	io_uring_cqe *mCqes;
+
+	// Receive buffers, handed to the kernel through a ring of their own
+	io_uring_buf *mBufferRing;
+	char *mBuffers;
+	uint16_t mBufferRingTail;
+	bool mBuffersGivenBack; /**< Since a receive request last ran out of them. */
+
+	uint32_t mSqLocalTail;                 /**< Submissions queued, published to the kernel on Enter(). */
+	std::vector<Registration> mSocketsByFd; /**< Registered sockets, indexed by descriptor. */
+	std::vector<int> mPendingArms;         /**< Descriptors whose request completed. */
+	std::vector<int> mStarvedSockets;      /**< Descriptors whose receive request ran out of buffers. */
+	std::vector<int> mReadySockets;        /**< Descriptors that may have something to report. */
+};
+
+#endif // HAS_IO_URING
+
+#endif // IO_URING_SOCKET_POLLER_H
@@ -19,11 +19,67 @@ void OutputMemoryStream::Write(const void *inData, size_t inByteCount)
 	mHead = resultHead;
 }
 
+void OutputMemoryStream::WriteSwapped(const void *inData, size_t inCount, size_t inElementSize)
+{
+	const uint32_t resultHead = mHead + static_cast<uint32_t>(inCount * inElementSize);
+	if (resultHead > mCapacity)
+	{
+		ReallocBuffer(std::max(mCapacity * 2, resultHead));
+	}
+
+	// Swapped straight into the buffer
+	ByteSwapArray(mBuffer + mHead, inData, inCount, inElementSize);
+
+	mHead = resultHead;
+}
+
+void OutputMemoryStream::WriteVarint(uint64_t inValue)
+{
+	// 7 bits per byte, least significant first, the highest bit tells
+	// whether more bytes follow
+	uint8_t bytes[10];
+	uint32_t byteCount = 0;
+	do
+	{
+		bytes[byteCount] = static_cast<uint8_t>(inValue & 0x7f);
+		inValue >>= 7;
+		if (inValue != 0) {
+			bytes[byteCount] |= 0x80;
+		}
+		byteCount++;
+	} while (inValue != 0);
+
+	Write(bytes, byteCount);
+}
+
+void OutputMemoryStream::WriteBit(bool inValue)
+{
+	// Up to 8 bools share the byte written by the first one
+	if (mBitCount == 0 || mBitCount == 8)
+	{
+		const uint8_t bits = 0;
+		mBitsOffset = mHead;
+		mBitCount = 0;
+		Write(&bits, sizeof(bits));
+	}
+
+	if (inValue) {
+		mBuffer[mBitsOffset] |= static_cast<char>(1 << mBitCount);
+	}
+	mBitCount++;
+}
+
 void OutputMemoryStream::ReallocBuffer(uint32_t inNewLength)
 {
-	mBuffer = static_cast<char*>(std::realloc(mBuffer, inNewLength));
-	assert(mBuffer != nullptr && "OutputMemoryStream::ReallocBuffer() - std::realloc() failed.");
-	mCapacity = inNewLength;
+	// Move to a pooled buffer of the size class that fits
+	uint32_t newCapacity;
+	char *newBuffer = StreamBufferPool::Acquire(inNewLength, newCapacity);
+	if (mHead > 0) {
+		std::memcpy(newBuffer, mBuffer, mHead);
+	}
+	StreamBufferPool::Release(mBuffer);
+	mBuffer = newBuffer;
+	mCapacity = newCapacity;
 }
 
 void InputMemoryStream::Read(void *outData, size_t inByteCount)
@@ -33,3 +89,43 @@ void InputMemoryStream::Read(void *outData, size_t inByteCount)
 	std::memcpy(outData, mBuffer + mHead, inByteCount);
 	mHead = resultHead;
 }
+
+void InputMemoryStream::Peek(void *outData, size_t inByteCount) const
+{
+	assert(mHead + inByteCount <= mCapacity && "InputMemoryStream::Peek() - trying to read more data than available.");
+	std::memcpy(outData, mBuffer + mHead, inByteCount);
+}
+
+void InputMemoryStream::ReadSwapped(void *outData, size_t inCount, size_t inElementSize)
+{
+	const uint32_t resultHead = mHead + static_cast<uint32_t>(inCount * inElementSize);
+	assert(resultHead <= mCapacity && "InputMemoryStream::ReadSwapped() - trying to read more data than available.");
+	ByteSwapArray(outData, mBuffer + mHead, inCount, inElementSize);
+	mHead = resultHead;
+}
+
+uint64_t InputMemoryStream::ReadVarint()
+{
+	uint64_t value = 0;
+	for (uint32_t shift = 0; shift < 64; shift += 7)
+	{
+		uint8_t byte;
+		Read(&byte, sizeof(byte));
+		value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0) {
+			break;
+		}
+	}
+	return value;
+}
+
+bool InputMemoryStream::ReadBit()
+{
+	if (mBitCount == 0 || mBitCount == 8)
+	{
+		Read(&mBits, sizeof(mBits));
+		mBitCount = 0;
+	}
+
+	return (mBits >> mBitCount++) & 1;
+}
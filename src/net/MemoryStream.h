@@ -2,7 +2,11 @@
 #define MEMORY_STREAM_H
 
 #include "ByteSwap.h"
+#include "StreamBufferPool.h"
 #include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
 #include <vector>
 
 enum class Endianness {
@@ -18,18 +22,100 @@ constexpr Endianness PLATFORM_ENDIANNESS = Endianness::LittleEndian;
 // Minimum IP and TCP header sizes are 20 bytes each
 constexpr uint32_t DEFAULT_STREAM_SIZE = 1460;
 
+// Encodings of the primitive values written with the generic methods
+enum class StreamEncoding {
+	Fixed,  // Full width, STREAM_ENDIANNESS
+	Native, // Full width, PLATFORM_ENDIANNESS (no swaps, for peers of the same endianness)
+	Compact // Integers as LEB128 varints (zig-zag if signed), bools as bits
+};
+
+// How each primitive type is written in the compact encoding
+struct CompactAsIs { };
+struct CompactAsBit { };
+struct CompactAsVarint { };
+
+template< typename T >
+struct CompactEncodingOf
+{
+	typedef typename std::conditional<
+			std::is_same< T, bool >::value,
+			CompactAsBit,
+			typename std::conditional<
+					( ( std::is_integral< T >::value || std::is_enum< T >::value ) && sizeof( T ) > 1 ),
+					CompactAsVarint,
+					CompactAsIs >::type >::type type;
+};
+
+// Whether arrays of T can be streamed as a block of memory
+// (std::vector<bool> packs its elements, so bools cannot)
+template< typename T >
+struct IsBulkStreamable : std::integral_constant< bool,
+		( std::is_arithmetic< T >::value || std::is_enum< T >::value ) &&
+		!std::is_same< T, bool >::value > { };
+
+// Integer type behind an integer or enum type
+template< typename T, bool = std::is_enum< T >::value >
+struct StreamIntegerOf { typedef T type; };
+
+template< typename T >
+struct StreamIntegerOf< T, true > { typedef typename std::underlying_type< T >::type type; };
+
+// Zig-zag mapping of signed values, so that small magnitudes get short varints
+template< typename T >
+uint64_t ToVarintValue( T inData )
+{
+	typedef typename StreamIntegerOf< T >::type Integer;
+	const Integer value = static_cast< Integer >( inData );
+	if( std::is_signed< Integer >::value )
+	{
+		const int64_t signedValue = static_cast< int64_t >( value );
+		return ( static_cast< uint64_t >( signedValue ) << 1 ) ^ static_cast< uint64_t >( signedValue >> 63 );
+	}
+	return static_cast< uint64_t >( value );
+}
+
+template< typename T >
+T FromVarintValue( uint64_t inValue )
+{
+	typedef typename StreamIntegerOf< T >::type Integer;
+	if( std::is_signed< Integer >::value )
+	{
+		const int64_t signedValue = static_cast< int64_t >( inValue >> 1 ) ^ -static_cast< int64_t >( inValue & 1 );
+		return static_cast< T >( static_cast< Integer >( signedValue ) );
+	}
+	return static_cast< T >( static_cast< Integer >( inValue ) );
+}
+
+// Bytes taken by a value written as a varint
+inline uint32_t VarintSize( uint64_t inValue )
+{
+	uint32_t size = 1;
+	while( inValue >= 0x80 )
+	{
+		inValue >>= 7;
+		size++;
+	}
+	return size;
+}
+
 class OutputMemoryStream
 {
 public:
 
-	// Constructor
+	// Constructor (with no size, the buffer is allocated on first write).
+	// Buffers come from the StreamBufferPool.
 	OutputMemoryStream(uint32_t inSize = DEFAULT_STREAM_SIZE):
-		mBuffer(nullptr), mCapacity(0), mHead(0)
-	{ ReallocBuffer(inSize); }
+		mBuffer(nullptr), mCapacity(0), mHead(0),
+		mEncoding(StreamEncoding::Fixed), mBitsOffset(0), mBitCount(0)
+	{ if (inSize > 0) ReallocBuffer(inSize); }
 
 	// Destructor
 	~OutputMemoryStream()
-	{ std::free(mBuffer); }
+	{ StreamBufferPool::Release(mBuffer); }
+
+	// Not copyable
+	OutputMemoryStream(const OutputMemoryStream &) = delete;
+	OutputMemoryStream &operator=(const OutputMemoryStream &) = delete;
 
 	// Get pointer to the data in the stream
 	const char *GetBufferPtr() const { return mBuffer; }
@@ -37,9 +123,33 @@ public:
 	uint32_t GetSize() const { return mHead; }
 
 	// Clear the stream state
-	void Clear() { mHead = 0; }
+	void Clear() { mHead = 0; mBitCount = 0; }
+
+	// Encoding of the values written from now on
+	void SetEncoding(StreamEncoding inEncoding) { mEncoding = inEncoding; }
+	StreamEncoding GetEncoding() const { return mEncoding; }
+
+	// Make room for inByteCount more bytes at once
+	void Reserve(uint32_t inByteCount)
+	{
+		if (mHead + inByteCount > mCapacity) {
+			ReallocBuffer(mHead + inByteCount);
+		}
+	}
+
+	// Hands the buffer over to the caller.
+	// The stream is left empty and allocates a new buffer on next write.
+	PooledBuffer ReleaseBuffer()
+	{
+		char *buffer = mBuffer;
+		mBuffer = nullptr;
+		mCapacity = 0;
+		mHead = 0;
+		mBitCount = 0;
+		return PooledBuffer::Adopt(buffer);
+	}
 
-	// Write method
+	// Write method (raw bytes, whatever the encoding)
 	void Write(const void *inData, size_t inByteCount);
 
 	// Generic write for arithmetic types
@@ -51,14 +161,13 @@ public:
 				std::is_enum< T >::value,
 				"Generic Write only supports primitive data types" );
 
-		if( STREAM_ENDIANNESS == PLATFORM_ENDIANNESS )
+		if( mEncoding == StreamEncoding::Compact )
 		{
-			Write( &inData, sizeof( inData ) );
+			WriteCompact( inData, typename CompactEncodingOf< T >::type() );
 		}
 		else
 		{
-			T swappedData = ByteSwap( inData );
-			Write( &swappedData, sizeof( swappedData ) );
+			WriteFixed( inData );
 		}
 	}
 
@@ -68,10 +177,7 @@ public:
 	{
 		uint32_t elementCount = static_cast<uint32_t>(inVector.size());
 		Write( elementCount );
-		for( const T& element : inVector )
-		{
-			Write( element );
-		}
+		WriteElements( inVector, IsBulkStreamable< T >() );
 	}
 
 	// Write for strings
@@ -85,12 +191,76 @@ public:
 
 private:
 
+	template< typename T >
+	void WriteFixed( T inData )
+	{
+		if( STREAM_ENDIANNESS != PLATFORM_ENDIANNESS && mEncoding != StreamEncoding::Native )
+		{
+			inData = ByteSwap( inData );
+		}
+
+		// Copied in place when it fits, without calling out
+		if( mHead + sizeof( inData ) <= mCapacity )
+		{
+			std::memcpy( mBuffer + mHead, &inData, sizeof( inData ) );
+			mHead += sizeof( inData );
+		}
+		else
+		{
+			Write( &inData, sizeof( inData ) );
+		}
+	}
+
+	template< typename T >
+	void WriteCompact( T inData, CompactAsIs ) { WriteFixed( inData ); }
+	void WriteCompact( bool inData, CompactAsBit ) { WriteBit( inData ); }
+	template< typename T >
+	void WriteCompact( T inData, CompactAsVarint ) { WriteVarint( ToVarintValue( inData ) ); }
+
+	template< typename T >
+	void WriteElements( const std::vector< T >& inVector, std::false_type )
+	{
+		for( const T& element : inVector )
+		{
+			Write( element );
+		}
+	}
+
+	template< typename T >
+	void WriteElements( const std::vector< T >& inVector, std::true_type )
+	{
+		if( inVector.empty() )
+		{
+			return;
+		}
+		if( mEncoding == StreamEncoding::Compact )
+		{
+			WriteElements( inVector, std::false_type() );
+		}
+		else if( sizeof( T ) == 1 || STREAM_ENDIANNESS == PLATFORM_ENDIANNESS || mEncoding == StreamEncoding::Native )
+		{
+			Write( inVector.data(), inVector.size() * sizeof( T ) );
+		}
+		else
+		{
+			WriteSwapped( inVector.data(), inVector.size(), sizeof( T ) );
+		}
+	}
+
+	void WriteSwapped(const void *inData, size_t inCount, size_t inElementSize);
+	void WriteVarint(uint64_t inValue);
+	void WriteBit(bool inValue);
+
 	// Resize the buffer
 	void ReallocBuffer(uint32_t inNewLength);
 
 	char *mBuffer;
 	uint32_t mCapacity;
 	uint32_t mHead;
+
+	StreamEncoding mEncoding;
+	uint32_t mBitsOffset; /**< Byte holding the bools being packed. */
+	uint32_t mBitCount;   /**< Bools already packed in that byte (8 when full). */
 };
 
 class InputMemoryStream
@@ -99,12 +269,30 @@ public:
 
 	// Constructor
 	InputMemoryStream(uint32_t inSize = DEFAULT_STREAM_SIZE) :
-		mBuffer(static_cast<char*>(std::malloc(inSize))), mCapacity(inSize), mHead(0)
+		mBuffer(PooledBuffer(inSize).Detach()), mCapacity(inSize), mHead(0), mOwnsBuffer(true),
+		mEncoding(StreamEncoding::Fixed), mBits(0), mBitCount(0)
+	{ }
+
+	// Constructor taking over a pooled buffer holding inSize bytes of data
+	InputMemoryStream(PooledBuffer &&inBuffer, uint32_t inSize) :
+		mBuffer(inBuffer.Detach()), mCapacity(inSize), mHead(0), mOwnsBuffer(true),
+		mEncoding(StreamEncoding::Fixed), mBits(0), mBitCount(0)
+	{ }
+
+	// Constructor for a read-only view over external data (not copied).
+	// The data must outlive the stream.
+	InputMemoryStream(const char *inData, uint32_t inSize) :
+		mBuffer(const_cast<char*>(inData)), mCapacity(inSize), mHead(0), mOwnsBuffer(false),
+		mEncoding(StreamEncoding::Fixed), mBits(0), mBitCount(0)
 	{ }
 
 	// Destructor
 	~InputMemoryStream()
-	{ std::free(mBuffer); }
+	{ if (mOwnsBuffer) StreamBufferPool::Release(mBuffer); }
+
+	// Not copyable
+	InputMemoryStream(const InputMemoryStream &) = delete;
+	InputMemoryStream &operator=(const InputMemoryStream &) = delete;
 
 	// Get pointer to the data in the stream
 	char *GetBufferPtr() const { return mBuffer; }
@@ -112,11 +300,18 @@ public:
 	uint32_t GetSize() const { return mHead; }
 
 	// Clear the stream state
-	void Clear() { mHead = 0; }
+	void Clear() { mHead = 0; mBitCount = 0; }
+
+	// Encoding of the values read from now on
+	void SetEncoding(StreamEncoding inEncoding) { mEncoding = inEncoding; }
+	StreamEncoding GetEncoding() const { return mEncoding; }
 
-	// Read method
+	// Read method (raw bytes, whatever the encoding)
 	void Read(void *outData, size_t inByteCount);
 
+	// Copy out raw bytes without moving the head
+	void Peek(void *outData, size_t inByteCount) const;
+
 	// Generic read for arithmetic types
 	template< typename T >
 	void Read( T& outData )
@@ -126,15 +321,13 @@ public:
 				std::is_enum< T >::value,
 				"Generic Read only supports primitive data types" );
 
-		if( STREAM_ENDIANNESS == PLATFORM_ENDIANNESS )
+		if( mEncoding == StreamEncoding::Compact )
 		{
-			Read( &outData, sizeof( outData ) );
+			ReadCompact( outData, typename CompactEncodingOf< T >::type() );
 		}
 		else
 		{
-			T unswappedData;
-			Read( &unswappedData, sizeof( unswappedData ) );
-			outData = ByteSwap(unswappedData);
+			ReadFixed( outData );
 		}
 	}
 
@@ -145,10 +338,7 @@ public:
 		uint32_t elementCount;
 		Read( elementCount );
 		outVector.resize( elementCount );
-		for( const T& element : outVector )
-		{
-			Read( element );
-		}
+		ReadElements( outVector, IsBulkStreamable< T >() );
 	}
 
 	// Read for strings
@@ -157,16 +347,83 @@ public:
 		uint32_t elementCount;
 		Read( elementCount );
 		inString.resize(elementCount);
-		for (auto &character : inString) {
-			Read(character);
+		if (elementCount > 0) {
+			Read( &inString[0], elementCount * sizeof( char ) );
 		}
 	}
 
 private:
 
+	template< typename T >
+	void ReadFixed( T& outData )
+	{
+		// Copied in place when available, without calling out
+		if( mHead + sizeof( outData ) <= mCapacity )
+		{
+			std::memcpy( &outData, mBuffer + mHead, sizeof( outData ) );
+			mHead += sizeof( outData );
+		}
+		else
+		{
+			Read( &outData, sizeof( outData ) );
+		}
+
+		if( STREAM_ENDIANNESS != PLATFORM_ENDIANNESS && mEncoding != StreamEncoding::Native )
+		{
+			outData = ByteSwap( outData );
+		}
+	}
+
+	template< typename T >
+	void ReadCompact( T& outData, CompactAsIs ) { ReadFixed( outData ); }
+	void ReadCompact( bool& outData, CompactAsBit ) { outData = ReadBit(); }
+	template< typename T >
+	void ReadCompact( T& outData, CompactAsVarint ) { outData = FromVarintValue< T >( ReadVarint() ); }
+
+	template< typename T >
+	void ReadElements( std::vector< T >& outVector, std::false_type )
+	{
+		for( auto&& element : outVector )
+		{
+			T value;
+			Read( value );
+			element = value;
+		}
+	}
+
+	template< typename T >
+	void ReadElements( std::vector< T >& outVector, std::true_type )
+	{
+		if( outVector.empty() )
+		{
+			return;
+		}
+		if( mEncoding == StreamEncoding::Compact )
+		{
+			ReadElements( outVector, std::false_type() );
+		}
+		else if( sizeof( T ) == 1 || STREAM_ENDIANNESS == PLATFORM_ENDIANNESS || mEncoding == StreamEncoding::Native )
+		{
+			Read( outVector.data(), outVector.size() * sizeof( T ) );
+		}
+		else
+		{
+			ReadSwapped( outVector.data(), outVector.size(), sizeof( T ) );
+		}
+	}
+
+	void ReadSwapped(void *outData, size_t inCount, size_t inElementSize);
+	uint64_t ReadVarint();
+	bool ReadBit();
+
 	char *mBuffer;
 	uint32_t mCapacity;
 	uint32_t mHead;
+	bool mOwnsBuffer;
+
+	StreamEncoding mEncoding;
+	uint8_t mBits;      /**< Byte holding the bools being unpacked. */
+	uint32_t mBitCount; /**< Bools already unpacked from that byte (8 when done). */
 };
 
 #endif // MEMORY_STREAM_H
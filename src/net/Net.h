@@ -10,6 +10,7 @@
 	typedef int socklen_t;
 	//typedef char* receiveBufer_t;
 	#define s_addr S_un.S_addr
+	const int SEND_FLAGS = 0;
 #else
 	#include <sys/socket.h>
 	#include <netinet/in.h>
@@ -18,13 +19,39 @@
 	#include <errno.h>
 	#include <fcntl.h>
 	#include <unistd.h>
+	#include <sys/uio.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#define HAS_SHARED_MEMORY
+	#if defined(__linux__)
+		#include <sys/epoll.h>
+		#if defined(__has_include)
+			#if __has_include(<linux/io_uring.h>)
+				#include <linux/io_uring.h>
+				#include <sys/syscall.h>
+				#include <poll.h>
+				// Headers of Linux 6.0 or later (multishot receives)
+				#if defined(IORING_RECV_MULTISHOT)
+					#define HAS_IO_URING
+				#endif
+			#endif
+		#endif
+	#endif
 	//typedef void* receiveBufer_t;
 	typedef int SOCKET;
 	const int NO_ERROR = 0;
 	const int INVALID_SOCKET = -1;
 	const int WSAECONNRESET = ECONNRESET;
 	const int WSAEWOULDBLOCK = EAGAIN;
+	const int WSAEINPROGRESS = EINPROGRESS;
 	const int SOCKET_ERROR = -1;
+	// Sending to a peer which reset the connection fails with EPIPE
+	// instead of raising SIGPIPE
+	#ifdef MSG_NOSIGNAL
+		const int SEND_FLAGS = MSG_NOSIGNAL;
+	#else
+		const int SEND_FLAGS = 0;
+	#endif
 #endif
 
 #include <cstdlib>
@@ -35,16 +62,36 @@
 #include <vector>
 #include <string>
 #include <list>
+#include <deque>
 #include <set>
+#include <map>
+#include <chrono>
+#include <algorithm>
+#include <utility>
+#include <atomic>
+#include <thread>
 #include <cassert>
 
 #include "StringUtils.h"
 #include "SocketAddress.h"
 #include "UDPSocket.h"
+#include "RingBuffer.h"
+#include "StreamBufferPool.h"
+#include "SharedMemoryChannel.h"
+#include "TransportStats.h"
+#include "SocketHandle.h"
 #include "TCPSocket.h"
+#include "SocketTable.h"
+#include "SocketPoller.h"
+#include "SelectSocketPoller.h"
+#include "EpollSocketPoller.h"
+#include "IoUringSocketPoller.h"
 #include "SocketUtil.h"
 #include "ByteSwap.h"
 #include "MemoryStream.h"
+#include "UDPRpcChannel.h"
+#include "SPSCQueue.h"
+#include "NetworkThread.h"
 #include "TCPNetworkManager.h"
 
 #endif // MULTIPLAYER_H
@@ -0,0 +1,206 @@
+#include "Net.h"
+
+NetworkThread::NetworkThread(TCPNetworkManager &manager) :
+	mManager(manager),
+	mStopRequested(false),
+	mFinished(false),
+	mEvents(NETWORK_THREAD_QUEUE_SIZE),
+	mCommands(NETWORK_THREAD_QUEUE_SIZE),
+	mLatencySamples(NETWORK_THREAD_LATENCY_SAMPLES, 0.0f),
+	mLatencySampleCount(0)
+{
+}
+
+NetworkThread::~NetworkThread()
+{
+	assert(!mThread.joinable() && "NetworkThread::~NetworkThread() - the thread was not stopped.");
+}
+
+void NetworkThread::Start()
+{
+	mStopRequested = false;
+	mFinished = false;
+	mThread = std::thread(&NetworkThread::Run, this);
+}
+
+void NetworkThread::Stop(TCPNetworkManagerDelegate *delegate)
+{
+	if (!mThread.joinable()) {
+		return;
+	}
+
+	// Keep delivering events meanwhile, the network thread may be
+	// waiting for room in the queue
+	mStopRequested = true;
+	while (!mFinished) {
+		DispatchEvents(delegate);
+		std::this_thread::yield();
+	}
+	mThread.join();
+
+	// Leftovers are handled in this thread, now the only one
+	RunCommands();
+	for (NetworkCommand &command : mPendingCommands) {
+		RunCommand(command);
+	}
+	mPendingCommands.clear();
+	DispatchEvents(delegate);
+}
+
+void NetworkThread::Run()
+{
+	while (!mStopRequested)
+	{
+		RunCommands();
+		mManager.HandleSocketOperations(NETWORK_THREAD_POLL_MILLIS);
+	}
+	RunCommands();
+	mFinished = true;
+}
+
+void NetworkThread::RunCommands()
+{
+	NetworkCommand command;
+	while (mCommands.Pop(command))
+	{
+		RunCommand(command);
+	}
+}
+
+void NetworkThread::RunCommand(NetworkCommand &command)
+{
+	switch (command.type)
+	{
+	case NetworkCommand::AddSocket:
+		mManager.RegisterSocket(command.socket);
+		break;
+	case NetworkCommand::AddLocalPair:
+		mManager.RegisterLocalPair(command.socket, command.peer);
+		break;
+	case NetworkCommand::SendPacket:
+		// The main thread checked the room left with the bytes queued
+		// back then, the packet may not fit anymore
+		if (!command.socket->QueuePacket(std::move(command.data), command.size, command.priority)) {
+			command.socket->CountPacketDropped();
+		}
+		break;
+	case NetworkCommand::UpdateSendImmediately:
+		mManager.UpdateSendImmediately();
+		break;
+	}
+}
+
+void NetworkThread::PostEvent(NetworkEvent::Type type, const TCPSocketPtr &socket, const char *data, uint32_t size)
+{
+	NetworkEvent event;
+	event.type = type;
+	event.socket = socket;
+	if (data != nullptr)
+	{
+		event.data = PooledBuffer(size);
+		std::memcpy(event.data.Get(), data, size);
+		event.size = size;
+	}
+	event.time = std::chrono::steady_clock::now();
+
+	// Wait for the main thread to make room
+	while (!mEvents.Push(std::move(event))) {
+		std::this_thread::yield();
+	}
+}
+
+void NetworkThread::PostCommand(NetworkCommand &&command)
+{
+	// Never waits for the network thread, which may be waiting itself
+	// for room in the event queue. Behind the ones already waiting, if any.
+	PostPendingCommands();
+	if (mPendingCommands.empty() && mCommands.Push(std::move(command))) {
+		return;
+	}
+	mPendingCommands.push_back(std::move(command));
+}
+
+bool NetworkThread::PostSend(const TCPSocketPtr &socket, PooledBuffer &&data, uint32_t size, PacketPriority priority)
+{
+	NetworkCommand command;
+	command.type = NetworkCommand::SendPacket;
+	command.socket = socket;
+	command.data = std::move(data);
+	command.size = size;
+	command.priority = priority;
+
+	// Behind the ones already waiting, if any
+	PostPendingCommands();
+	if (mPendingCommands.empty() && mCommands.Push(std::move(command))) {
+		return true;
+	}
+	if (mPendingCommands.size() >= NETWORK_THREAD_QUEUE_SIZE) {
+		return false;
+	}
+	mPendingCommands.push_back(std::move(command));
+	return true;
+}
+
+void NetworkThread::PostPendingCommands()
+{
+	while (!mPendingCommands.empty() && mCommands.Push(std::move(mPendingCommands.front()))) {
+		mPendingCommands.pop_front();
+	}
+}
+
+void NetworkThread::DispatchEvents(TCPNetworkManagerDelegate *delegate)
+{
+	PostPendingCommands();
+
+	const auto now = std::chrono::steady_clock::now();
+
+	NetworkEvent event;
+	while (mEvents.Pop(event))
+	{
+		switch (event.type)
+		{
+		case NetworkEvent::Accepted:
+			mManager.mDelegateSockets.Insert(event.socket);
+			delegate->OnAccepted(event.socket->GetHandle());
+			break;
+		case NetworkEvent::PacketReceived:
+		{
+			const std::chrono::duration<float, std::milli> latency = now - event.time;
+			mLatencySamples[mLatencySampleCount++ % NETWORK_THREAD_LATENCY_SAMPLES] = latency.count();
+
+			InputMemoryStream stream(std::move(event.data), event.size);
+			delegate->OnPacketReceived(event.socket->GetHandle(), stream);
+			break;
+		}
+		case NetworkEvent::ReceiveBatchEnd:
+			delegate->OnReceiveBatchEnd(event.socket->GetHandle());
+			break;
+		case NetworkEvent::Disconnected:
+			mManager.RemoveConnection(event.socket);
+			delegate->OnDisconnected(event.socket->GetHandle());
+			mManager.ReleaseSocket(event.socket);
+			break;
+		case NetworkEvent::Connected:
+			delegate->OnConnected(event.socket->GetHandle());
+			break;
+		case NetworkEvent::ConnectFailed:
+			mManager.RemoveConnection(event.socket);
+			delegate->OnConnectFailed(event.socket->GetHandle());
+			mManager.ReleaseSocket(event.socket);
+			break;
+		}
+	}
+}
+
+double NetworkThread::HandoffLatencyP99() const
+{
+	const uint32_t count = std::min(mLatencySampleCount, NETWORK_THREAD_LATENCY_SAMPLES);
+	if (count == 0) {
+		return 0.0;
+	}
+
+	std::vector<float> samples(mLatencySamples.begin(), mLatencySamples.begin() + count);
+	auto percentile = samples.begin() + (count * 99) / 100;
+	std::nth_element(samples.begin(), percentile, samples.end());
+	return *percentile;
+}
@@ -0,0 +1,104 @@
+#ifndef NETWORK_THREAD_H
+#define NETWORK_THREAD_H
+
+class TCPNetworkManager;
+class TCPNetworkManagerDelegate;
+
+// Max time the network thread waits for socket readiness, which bounds
+// how long a command posted by the main thread can wait to be run
+constexpr int NETWORK_THREAD_POLL_MILLIS = 1;
+
+// Capacity of the queues between the main thread and the network thread
+constexpr uint32_t NETWORK_THREAD_QUEUE_SIZE = 16 * 1024;
+
+// Number of packet hand-off latencies kept to compute percentiles
+constexpr uint32_t NETWORK_THREAD_LATENCY_SAMPLES = 1024;
+
+// Something that happened in the network thread, for the main thread
+struct NetworkEvent
+{
+	enum Type {
+		Accepted,
+		PacketReceived,
+		ReceiveBatchEnd,
+		Disconnected,
+		Connected,
+		ConnectFailed
+	};
+
+	Type type = Accepted;
+	TCPSocketPtr socket;    /**< Kept alive until the event is dispatched. */
+	PooledBuffer data;      /**< Packet, owned by the event. */
+	uint32_t size = 0;
+	std::chrono::steady_clock::time_point time; /**< When it was posted. */
+};
+
+// Something the main thread wants the network thread to do
+struct NetworkCommand
+{
+	enum Type {
+		AddSocket,
+		AddLocalPair,
+		SendPacket,
+		UpdateSendImmediately
+	};
+
+	Type type = AddSocket;
+	TCPSocketPtr socket;    /**< Kept alive until the event is dispatched. */
+	TCPSocketPtr peer;      /**< Other end, for AddLocalPair. */
+	PooledBuffer data;      /**< Packet, owned by the command. */
+	uint32_t size = 0;
+	PacketPriority priority = PacketPriority::Normal; /**< Lane of the packet, for SendPacket. */
+};
+
+// It runs the socket operations of a TCPNetworkManager in a thread of
+// its own. Both threads only talk through two single-producer /
+// single-consumer queues: events for the main thread, and commands for
+// the network thread.
+class NetworkThread
+{
+public:
+
+	NetworkThread(TCPNetworkManager &manager);
+	~NetworkThread();
+
+	// Stop delivers to the delegate the events still in the queue
+	void Start();
+	void Stop(TCPNetworkManagerDelegate *delegate);
+
+	// Network thread
+	void PostEvent(NetworkEvent::Type type, const TCPSocketPtr &socket, const char *data = nullptr, uint32_t size = 0);
+
+	// Main thread, neither of them blocks. Commands which do not fit in
+	// the command queue wait in this thread, in order, until the network
+	// thread makes room. Packets are only kept while there are fewer than
+	// NETWORK_THREAD_QUEUE_SIZE commands waiting, then PostSend fails.
+	void PostCommand(NetworkCommand &&command);
+	bool PostSend(const TCPSocketPtr &socket, PooledBuffer &&data, uint32_t size, PacketPriority priority);
+	void DispatchEvents(TCPNetworkManagerDelegate *delegate);
+
+	// Main thread: time between a packet being read by the network thread
+	// and being delivered to the delegate (99th percentile, in millis)
+	double HandoffLatencyP99() const;
+
+private:
+
+	void Run();
+	void RunCommands();
+	void RunCommand(NetworkCommand &command);
+	void PostPendingCommands();
+
+	TCPNetworkManager &mManager;
+	std::thread mThread;
+	std::atomic<bool> mStopRequested;
+	std::atomic<bool> mFinished;
+
+	SPSCQueue<NetworkEvent> mEvents;     /**< Network thread -> main thread. */
+	SPSCQueue<NetworkCommand> mCommands; /**< Main thread -> network thread. */
+	std::deque<NetworkCommand> mPendingCommands; /**< Commands waiting for room in mCommands (main thread). */
+
+	std::vector<float> mLatencySamples;  /**< Ring of hand-off latencies (millis). */
+	uint32_t mLatencySampleCount;
+};
+
+#endif // NETWORK_THREAD_H
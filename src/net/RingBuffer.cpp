@@ -0,0 +1,168 @@
+#include "RingBuffer.h"
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+
+RingBuffer::RingBuffer(uint32_t inCapacity) :
+	mBuffer(nullptr), mCapacity(inCapacity), mReadHead(0), mSize(0)
+{
+}
+
+RingBuffer::~RingBuffer()
+{
+	std::free(mBuffer);
+}
+
+bool RingBuffer::SetCapacity(uint32_t inCapacity)
+{
+	if (mSize > 0)
+	{
+		return false;
+	}
+
+	std::free(mBuffer);
+	mBuffer = nullptr;
+	mCapacity = inCapacity;
+	mReadHead = 0;
+	return true;
+}
+
+bool RingBuffer::Write(const void *inData, uint32_t inByteCount)
+{
+	if (inByteCount > GetFreeSpace())
+	{
+		return false;
+	}
+
+	RingBufferRegion regions[2];
+	const int regionCount = GetWriteRegions(regions);
+
+	const char *src = static_cast<const char*>(inData);
+	uint32_t remaining = inByteCount;
+	for (int i = 0; i < regionCount && remaining > 0; ++i)
+	{
+		const uint32_t chunk = remaining < regions[i].size ? remaining : regions[i].size;
+		std::memcpy(regions[i].data, src, chunk);
+		src += chunk;
+		remaining -= chunk;
+	}
+
+	Commit(inByteCount);
+	return true;
+}
+
+bool RingBuffer::Peek(void *outData, uint32_t inByteCount, uint32_t inOffset) const
+{
+	if (inOffset + inByteCount > mSize)
+	{
+		return false;
+	}
+
+	char *dst = static_cast<char*>(outData);
+	uint32_t position = mReadHead + inOffset;
+	if (position >= mCapacity) position -= mCapacity;
+
+	const uint32_t firstChunk = mCapacity - position < inByteCount ? mCapacity - position : inByteCount;
+	std::memcpy(dst, mBuffer + position, firstChunk);
+	std::memcpy(dst + firstChunk, mBuffer, inByteCount - firstChunk);
+	return true;
+}
+
+bool RingBuffer::Read(void *outData, uint32_t inByteCount)
+{
+	if (!Peek(outData, inByteCount))
+	{
+		return false;
+	}
+	Consume(inByteCount);
+	return true;
+}
+
+const char *RingBuffer::GetContiguousData(uint32_t inOffset, uint32_t inByteCount) const
+{
+	if (inOffset + inByteCount > mSize)
+	{
+		return nullptr;
+	}
+
+	uint32_t position = mReadHead + inOffset;
+	if (position >= mCapacity) position -= mCapacity;
+
+	return (position + inByteCount <= mCapacity) ? mBuffer + position : nullptr;
+}
+
+void RingBuffer::Consume(uint32_t inByteCount)
+{
+	assert(inByteCount <= mSize && "RingBuffer::Consume() - consuming more data than available.");
+	mSize -= inByteCount;
+	mReadHead += inByteCount;
+	if (mReadHead >= mCapacity) mReadHead -= mCapacity;
+
+	// Keep the data contiguous as long as possible
+	if (mSize == 0) mReadHead = 0;
+}
+
+int RingBuffer::GetReadRegions(RingBufferRegion outRegions[2]) const
+{
+	if (mSize == 0)
+	{
+		return 0;
+	}
+
+	const uint32_t firstChunk = mCapacity - mReadHead;
+	if (mSize <= firstChunk)
+	{
+		outRegions[0].data = mBuffer + mReadHead;
+		outRegions[0].size = mSize;
+		return 1;
+	}
+
+	outRegions[0].data = mBuffer + mReadHead;
+	outRegions[0].size = firstChunk;
+	outRegions[1].data = mBuffer;
+	outRegions[1].size = mSize - firstChunk;
+	return 2;
+}
+
+int RingBuffer::GetWriteRegions(RingBufferRegion outRegions[2])
+{
+	if (mSize == mCapacity)
+	{
+		return 0;
+	}
+
+	Allocate();
+
+	uint32_t writeHead = mReadHead + mSize;
+	if (writeHead >= mCapacity) writeHead -= mCapacity;
+
+	const uint32_t freeSpace = mCapacity - mSize;
+	const uint32_t firstChunk = mCapacity - writeHead;
+	if (freeSpace <= firstChunk)
+	{
+		outRegions[0].data = mBuffer + writeHead;
+		outRegions[0].size = freeSpace;
+		return 1;
+	}
+
+	outRegions[0].data = mBuffer + writeHead;
+	outRegions[0].size = firstChunk;
+	outRegions[1].data = mBuffer;
+	outRegions[1].size = freeSpace - firstChunk;
+	return 2;
+}
+
+void RingBuffer::Commit(uint32_t inByteCount)
+{
+	assert(inByteCount <= GetFreeSpace() && "RingBuffer::Commit() - committing more data than free space.");
+	mSize += inByteCount;
+}
+
+void RingBuffer::Allocate()
+{
+	if (mBuffer == nullptr)
+	{
+		mBuffer = static_cast<char*>(std::malloc(mCapacity));
+		assert(mBuffer != nullptr && "RingBuffer::Allocate() - std::malloc() failed.");
+	}
+}
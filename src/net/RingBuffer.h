@@ -0,0 +1,77 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <cstdint>
+
+/** Contiguous span of a ring buffer, used for vectored I/O. */
+struct RingBufferRegion
+{
+	char *data;
+	uint32_t size;
+};
+
+/**
+ * Fixed-capacity circular byte buffer.
+ * Data is never moved once written: the readable and the writable
+ * areas are exposed as (at most) two contiguous regions each, so that
+ * they can be used directly with readv / writev across the wrap point.
+ * The storage is allocated on first use.
+ */
+class RingBuffer
+{
+public:
+
+	// Constructor
+	RingBuffer(uint32_t inCapacity);
+
+	// Destructor
+	~RingBuffer();
+
+	// Not copyable
+	RingBuffer(const RingBuffer &) = delete;
+	RingBuffer &operator=(const RingBuffer &) = delete;
+
+	// Sizes
+	uint32_t GetCapacity() const { return mCapacity; }
+	uint32_t GetSize() const { return mSize; }
+	uint32_t GetFreeSpace() const { return mCapacity - mSize; }
+	bool IsEmpty() const { return mSize == 0; }
+
+	// It changes the capacity (only if the buffer is empty)
+	bool SetCapacity(uint32_t inCapacity);
+
+	// Copy in (all or nothing)
+	bool Write(const void *inData, uint32_t inByteCount);
+
+	// Copy out without consuming, starting inOffset bytes after the read head
+	bool Peek(void *outData, uint32_t inByteCount, uint32_t inOffset = 0) const;
+
+	// Copy out and consume
+	bool Read(void *outData, uint32_t inByteCount);
+
+	// Pointer to inByteCount readable bytes starting inOffset bytes after
+	// the read head, or nullptr if they are split by the wrap point
+	const char *GetContiguousData(uint32_t inOffset, uint32_t inByteCount) const;
+
+	// Discard inByteCount bytes from the read head
+	void Consume(uint32_t inByteCount);
+
+	// Readable data as up to 2 regions. It returns the number of regions.
+	int GetReadRegions(RingBufferRegion outRegions[2]) const;
+
+	// Free space as up to 2 regions. It returns the number of regions.
+	// Call Commit() with the number of bytes actually written into them.
+	int GetWriteRegions(RingBufferRegion outRegions[2]);
+	void Commit(uint32_t inByteCount);
+
+private:
+
+	void Allocate();
+
+	char *mBuffer;      /**< Storage (allocated on first write). */
+	uint32_t mCapacity; /**< Size of the storage. */
+	uint32_t mReadHead; /**< Offset of the first readable byte. */
+	uint32_t mSize;     /**< Number of readable bytes. */
+};
+
+#endif // RING_BUFFER_H
@@ -0,0 +1,69 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one
+// consumer thread. Push is only called by the producer and Pop only
+// by the consumer.
+template <typename T>
+class SPSCQueue
+{
+public:
+
+	// Constructor
+	explicit SPSCQueue(uint32_t inCapacity) :
+		mSlots(inCapacity + 1), mHead(0), mTail(0)
+	{ }
+
+	// Not copyable
+	SPSCQueue(const SPSCQueue &) = delete;
+	SPSCQueue &operator=(const SPSCQueue &) = delete;
+
+	// Producer: it returns false if the queue is full (the item is
+	// not moved then)
+	bool Push(T &&inItem)
+	{
+		const uint32_t tail = mTail.load(std::memory_order_relaxed);
+		const uint32_t nextTail = Next(tail);
+		if (nextTail == mHead.load(std::memory_order_acquire)) {
+			return false;
+		}
+		mSlots[tail] = std::move(inItem);
+		mTail.store(nextTail, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer: it returns false if the queue is empty
+	bool Pop(T &outItem)
+	{
+		const uint32_t head = mHead.load(std::memory_order_relaxed);
+		if (head == mTail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		outItem = std::move(mSlots[head]);
+		mSlots[head] = T();
+		mHead.store(Next(head), std::memory_order_release);
+		return true;
+	}
+
+	bool IsEmpty() const
+	{
+		return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_acquire);
+	}
+
+private:
+
+	uint32_t Next(uint32_t inIndex) const
+	{
+		return (inIndex + 1 == mSlots.size()) ? 0 : inIndex + 1;
+	}
+
+	std::vector<T> mSlots;                /**< One slot is always left empty. */
+	alignas(64) std::atomic<uint32_t> mHead; /**< Next slot to pop (consumer). */
+	alignas(64) std::atomic<uint32_t> mTail; /**< Next slot to push (producer). */
+};
+
+#endif // SPSC_QUEUE_H
@@ -0,0 +1,68 @@
+#include "Net.h"
+
+void SelectSocketPoller::AddSocket(const TCPSocketPtr &socket)
+{
+	mSockets.push_back(socket);
+	AttachSocket(*socket, this);
+}
+
+void SelectSocketPoller::RemoveSocket(const TCPSocketPtr &socket)
+{
+	for (size_t i = 0; i < mSockets.size(); ++i)
+	{
+		if (mSockets[i] == socket)
+		{
+			mSockets[i] = mSockets.back();
+			mSockets.pop_back();
+			DetachSocket(*socket);
+			break;
+		}
+	}
+}
+
+void SelectSocketPoller::SetWriteInterest(TCPSocket &, bool)
+{
+	// Nothing to do, the write set is rebuilt on every Poll()
+}
+
+int SelectSocketPoller::Poll(
+		std::vector<TCPSocket*> &outReadableSockets,
+		std::vector<TCPSocket*> &outWritableSockets,
+		int timeoutMillis)
+{
+	// Preselect sockets for reading and writing
+	mReadSet.clear();
+	mWriteSet.clear();
+	mExceptSet.clear();
+	for (const TCPSocketPtr &socket : mSockets)
+	{
+		if (socket->IsConnecting())
+		{
+			// Windows reports failed connects through the except set
+			mWriteSet.push_back(socket.get());
+			mExceptSet.push_back(socket.get());
+		}
+		else if (!socket->IsDisconnected())
+		{
+			mReadSet.push_back(socket.get());
+			if (socket->HasOutgoingData())
+			{
+				mWriteSet.push_back(socket.get());
+			}
+		}
+	}
+
+	mFailedSet.clear();
+	const int res = SocketUtil::Select(&mReadSet, &outReadableSockets, &mWriteSet, &outWritableSockets, &mExceptSet, &mFailedSet, timeoutMillis);
+
+	// Completed (failed) connects are handled through the write path
+	for (TCPSocket *socket : mFailedSet)
+	{
+		if (std::find(outWritableSockets.begin(), outWritableSockets.end(), socket) == outWritableSockets.end())
+		{
+			outWritableSockets.push_back(socket);
+		}
+	}
+
+	return res > 0 ? res : 0;
+}
@@ -0,0 +1,33 @@
+#ifndef SELECT_SOCKET_POLLER_H
+#define SELECT_SOCKET_POLLER_H
+
+/**
+ * Portable readiness backend built on top of SocketUtil::Select.
+ * Its cost per frame grows linearly with the number of sockets.
+ */
+class SelectSocketPoller : public SocketPoller
+{
+public:
+
+	void AddSocket(const TCPSocketPtr &socket) override;
+	void RemoveSocket(const TCPSocketPtr &socket) override;
+	void SetWriteInterest(TCPSocket &socket, bool enable) override;
+
+	int Poll(
+			std::vector<TCPSocket*> &outReadableSockets,
+			std::vector<TCPSocket*> &outWritableSockets,
+			int timeoutMillis) override;
+
+	SocketPollerBackend GetBackend() const override { return SocketPollerBackend::Select; }
+	const char *GetName() const override { return "select"; }
+
+private:
+
+	std::vector<TCPSocketPtr> mSockets;
+	std::vector<TCPSocket*> mReadSet; /**< Sets rebuilt every Poll(), registered sockets only. */
+	std::vector<TCPSocket*> mWriteSet;
+	std::vector<TCPSocket*> mExceptSet;
+	std::vector<TCPSocket*> mFailedSet;
+};
+
+#endif // SELECT_SOCKET_POLLER_H
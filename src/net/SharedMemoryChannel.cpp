@@ -0,0 +1,221 @@
+#include "Net.h"
+
+SharedMemoryChannelPtr SharedMemoryChannel::Create(uint32_t inCapacity)
+{
+#if defined(HAS_SHARED_MEMORY)
+	// Power of two, so that positions can be masked
+	uint32_t ringSize = 4096;
+	while (ringSize < inCapacity) {
+		ringSize *= 2;
+	}
+
+	static std::atomic<uint32_t> sChannelCount(0);
+	const std::string name = "/sisimex-" + std::to_string(getpid()) + "-" + std::to_string(sChannelCount++);
+
+	const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	if (fd == -1)
+	{
+		SocketUtil::ReportError("SharedMemoryChannel::Create");
+		return nullptr;
+	}
+
+	// The new pages are zero-filled: both rings start empty
+	void *segment = MAP_FAILED;
+	if (ftruncate(fd, SegmentSize(ringSize)) == 0)
+	{
+		segment = mmap(nullptr, SegmentSize(ringSize), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+
+	if (segment == MAP_FAILED)
+	{
+		SocketUtil::ReportError("SharedMemoryChannel::Create");
+		shm_unlink(name.c_str());
+		return nullptr;
+	}
+
+	SegmentHeader *header = static_cast<SegmentHeader*>(segment);
+	header->ringSize = ringSize;
+	return SharedMemoryChannelPtr(new SharedMemoryChannel(name, header, true));
+#else
+	return nullptr;
+#endif
+}
+
+SharedMemoryChannelPtr SharedMemoryChannel::Open(const std::string &inName)
+{
+#if defined(HAS_SHARED_MEMORY)
+	const int fd = shm_open(inName.c_str(), O_RDWR, 0);
+	if (fd == -1)
+	{
+		SocketUtil::ReportError("SharedMemoryChannel::Open");
+		return nullptr;
+	}
+
+	// The size of the segment has to match the one in its header
+	struct stat status;
+	SegmentHeader header;
+	void *segment = MAP_FAILED;
+	if (fstat(fd, &status) == 0 && status.st_size >= (off_t)sizeof(header) &&
+		pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+		header.ringSize != 0 && (header.ringSize & (header.ringSize - 1)) == 0 &&
+		status.st_size == (off_t)SegmentSize(header.ringSize))
+	{
+		segment = mmap(nullptr, status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+
+	if (segment == MAP_FAILED)
+	{
+		SocketUtil::ReportError("SharedMemoryChannel::Open");
+		return nullptr;
+	}
+
+	return SharedMemoryChannelPtr(new SharedMemoryChannel(inName, static_cast<SegmentHeader*>(segment), false));
+#else
+	return nullptr;
+#endif
+}
+
+SharedMemoryChannel::SharedMemoryChannel(const std::string &inName, SegmentHeader *inSegment, bool inCreator) :
+	mName(inName),
+	mSegment(inSegment),
+	mRingSize(inSegment->ringSize),
+	mOutgoing(&inSegment->rings[inCreator ? 0 : 1]),
+	mIncoming(&inSegment->rings[inCreator ? 1 : 0]),
+	mOutgoingData(RingData(inCreator ? 0 : 1)),
+	mIncomingData(RingData(inCreator ? 1 : 0)),
+	mLinked(true)
+{
+}
+
+SharedMemoryChannel::~SharedMemoryChannel()
+{
+#if defined(HAS_SHARED_MEMORY)
+	// The peer keeps its own mapping until it is done with the data
+	Unlink();
+	munmap(mSegment, SegmentSize(mRingSize));
+#endif
+}
+
+void SharedMemoryChannel::Unlink()
+{
+#if defined(HAS_SHARED_MEMORY)
+	if (mLinked)
+	{
+		// It fails if the peer unlinked it first (nothing to do then)
+		shm_unlink(mName.c_str());
+		mLinked = false;
+	}
+#endif
+}
+
+bool SharedMemoryChannel::WritePacket(const void *inData, uint32_t inSize)
+{
+	const uint32_t head = mOutgoing->head.load(std::memory_order_acquire);
+	const uint32_t tail = mOutgoing->tail.load(std::memory_order_relaxed);
+	if (mRingSize - (tail - head) < sizeof(inSize) + inSize)
+	{
+		return false;
+	}
+
+	// Same framing as the TCP stream
+	CopyIn(mOutgoingData, tail, &inSize, sizeof(inSize));
+	CopyIn(mOutgoingData, tail + sizeof(inSize), inData, inSize);
+
+	// Ordered with the check of consumerWaiting (see TakeConsumerWaiting)
+	mOutgoing->tail.store(tail + sizeof(inSize) + inSize, std::memory_order_seq_cst);
+	return true;
+}
+
+bool SharedMemoryChannel::TakeConsumerWaiting()
+{
+	return mOutgoing->consumerWaiting.load(std::memory_order_seq_cst) != 0 &&
+		mOutgoing->consumerWaiting.exchange(0, std::memory_order_seq_cst) != 0;
+}
+
+bool SharedMemoryChannel::PeekPacket(const char *&outData, uint32_t &outSize)
+{
+	// Do we have a complete packet?
+	const uint32_t head = mIncoming->head.load(std::memory_order_relaxed);
+	const uint32_t tail = mIncoming->tail.load(std::memory_order_acquire);
+	uint32_t packetSize;
+	if (tail - head < sizeof(packetSize))
+	{
+		return false;
+	}
+
+	CopyOut(mIncomingData, head, &packetSize, sizeof(packetSize));
+	if (tail - head - sizeof(packetSize) < packetSize)
+	{
+		return false;
+	}
+
+	const uint32_t position = (head + sizeof(packetSize)) & (mRingSize - 1);
+	if (position + packetSize <= mRingSize)
+	{
+		outData = mIncomingData + position;
+	}
+	else
+	{
+		// The packet straddles the end of the ring, fall back to a copy
+		mPacketScratch.resize(packetSize);
+		CopyOut(mIncomingData, position, mPacketScratch.data(), packetSize);
+		outData = mPacketScratch.data();
+	}
+
+	outSize = packetSize;
+	return true;
+}
+
+void SharedMemoryChannel::ConsumePacket(uint32_t inPacketSize)
+{
+	const uint32_t head = mIncoming->head.load(std::memory_order_relaxed);
+	mIncoming->head.store(head + sizeof(uint32_t) + inPacketSize, std::memory_order_release);
+}
+
+bool SharedMemoryChannel::SetConsumerWaiting(bool inWaiting)
+{
+	if (!inWaiting)
+	{
+		mIncoming->consumerWaiting.store(0, std::memory_order_relaxed);
+		return true;
+	}
+
+	// Announce it before checking for data: a producer writing meanwhile
+	// either sees the announcement or its data is seen here
+	mIncoming->consumerWaiting.store(1, std::memory_order_seq_cst);
+	const uint32_t head = mIncoming->head.load(std::memory_order_relaxed);
+	if (mIncoming->tail.load(std::memory_order_seq_cst) != head)
+	{
+		mIncoming->consumerWaiting.store(0, std::memory_order_relaxed);
+		return false;
+	}
+	return true;
+}
+
+size_t SharedMemoryChannel::SegmentSize(uint32_t inRingSize)
+{
+	return sizeof(SegmentHeader) + 2 * (size_t)inRingSize;
+}
+
+char *SharedMemoryChannel::RingData(int inRing) const
+{
+	return reinterpret_cast<char*>(mSegment) + sizeof(SegmentHeader) + inRing * (size_t)mRingSize;
+}
+
+void SharedMemoryChannel::CopyIn(char *outRingData, uint32_t inPosition, const void *inData, uint32_t inSize) const
+{
+	const uint32_t position = inPosition & (mRingSize - 1);
+	const uint32_t firstSize = std::min(inSize, mRingSize - position);
+	std::memcpy(outRingData + position, inData, firstSize);
+	std::memcpy(outRingData, static_cast<const char*>(inData) + firstSize, inSize - firstSize);
+}
+
+void SharedMemoryChannel::CopyOut(const char *inRingData, uint32_t inPosition, void *outData, uint32_t inSize) const
+{
+	const uint32_t position = inPosition & (mRingSize - 1);
+	const uint32_t firstSize = std::min(inSize, mRingSize - position);
+	std::memcpy(outData, inRingData + position, firstSize);
+	std::memcpy(static_cast<char*>(outData) + firstSize, inRingData, inSize - firstSize);
+}
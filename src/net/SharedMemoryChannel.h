@@ -0,0 +1,91 @@
+#ifndef SHARED_MEMORY_CHANNEL_H
+#define SHARED_MEMORY_CHANNEL_H
+
+class SharedMemoryChannel;
+
+typedef std::unique_ptr<SharedMemoryChannel> SharedMemoryChannelPtr;
+
+/**
+ * Pair of single-producer / single-consumer byte rings in a shared
+ * memory segment, one for each direction, carrying the same length
+ * prefixed packets as a TCP stream. It lets two processes of the same
+ * host exchange packets without going through the loopback interface.
+ * The process that creates the segment writes into the first ring and
+ * the one that opens it by name writes into the second one.
+ * Only available on POSIX systems (Create and Open fail elsewhere).
+ */
+class SharedMemoryChannel
+{
+public:
+
+	// Factories, they return nullptr on failure. The creator chooses the
+	// capacity of both rings (rounded up to a power of two).
+	static SharedMemoryChannelPtr Create(uint32_t inCapacity);
+	static SharedMemoryChannelPtr Open(const std::string &inName);
+
+	// Destructor
+	~SharedMemoryChannel();
+
+	// Not copyable
+	SharedMemoryChannel(const SharedMemoryChannel &) = delete;
+	SharedMemoryChannel &operator=(const SharedMemoryChannel &) = delete;
+
+	const std::string &GetName() const { return mName; }
+
+	// Remove the name of the segment, once both processes mapped it
+	void Unlink();
+
+	// Producer: it returns false if the packet does not fit
+	bool WritePacket(const void *inData, uint32_t inSize);
+
+	// Largest packet that fits in an empty ring
+	uint32_t GetMaxPacketSize() const { return mRingSize - sizeof(uint32_t); }
+
+	// Producer: it returns true (once) if the consumer announced it was
+	// going to block, so it has to be woken up by other means
+	bool TakeConsumerWaiting();
+
+	// Consumer: same contract as TCPSocket::PeekPacket / ConsumePacket
+	bool PeekPacket(const char *&outData, uint32_t &outSize);
+	void ConsumePacket(uint32_t inPacketSize);
+
+	// Consumer: announce it is going to block (or that it woke up).
+	// It returns false if there is data to read already.
+	bool SetConsumerWaiting(bool inWaiting);
+
+private:
+
+	struct Ring
+	{
+		alignas(64) std::atomic<uint32_t> head;            /**< Read position (consumer). */
+		alignas(64) std::atomic<uint32_t> tail;            /**< Write position (producer). */
+		alignas(64) std::atomic<uint32_t> consumerWaiting; /**< Set by the consumer before blocking. */
+	};
+
+	// Layout of the segment: this header, then the data of both rings
+	struct SegmentHeader
+	{
+		alignas(64) uint32_t ringSize;
+		Ring rings[2];
+	};
+
+	SharedMemoryChannel(const std::string &inName, SegmentHeader *inSegment, bool inCreator);
+
+	static size_t SegmentSize(uint32_t inRingSize);
+
+	char *RingData(int inRing) const;
+	void CopyIn(char *outRingData, uint32_t inPosition, const void *inData, uint32_t inSize) const;
+	void CopyOut(const char *inRingData, uint32_t inPosition, void *outData, uint32_t inSize) const;
+
+	std::string mName;
+	SegmentHeader *mSegment;
+	uint32_t mRingSize;
+	Ring *mOutgoing;
+	Ring *mIncoming;
+	char *mOutgoingData;
+	char *mIncomingData;
+	bool mLinked;                   /**< The name of the segment still exists. */
+	std::vector<char> mPacketScratch; /**< Copy of the current packet when it is split by the wrap point. */
+};
+
+#endif // SHARED_MEMORY_CHANNEL_H
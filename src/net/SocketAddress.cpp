@@ -1,7 +1,28 @@
 #include "Net.h"
+#include <mutex>
+
+namespace
+{
+	// Addresses resolved so far, by "host:port"
+	std::mutex gResolverCacheMutex;
+	std::map<std::string, sockaddr> gResolverCache;
+}
 
 SocketAddress::SocketAddress(const std::string &inString)
 {
+	// Left as is (not valid) if the name cannot be resolved
+	memset(&mSockAddr, 0, sizeof(mSockAddr));
+
+	{
+		std::lock_guard<std::mutex> lock(gResolverCacheMutex);
+		auto it = gResolverCache.find(inString);
+		if (it != gResolverCache.end())
+		{
+			memcpy(&mSockAddr, &it->second, sizeof(mSockAddr));
+			return;
+		}
+	}
+
 	// Parse inString
 	const auto pos = inString.find_last_of(':');
 	std::string host, service;
@@ -38,6 +59,10 @@ SocketAddress::SocketAddress(const std::string &inString)
 		if (result && result->ai_addr) {
 			const sockaddr &addr(*result->ai_addr);
 			memcpy(&mSockAddr, &addr, sizeof(addr));
+
+			// Failed lookups are not cached, they are tried again
+			std::lock_guard<std::mutex> lock(gResolverCacheMutex);
+			gResolverCache[inString] = mSockAddr;
 		}
 	}
 
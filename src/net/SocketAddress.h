@@ -29,7 +29,12 @@ public:
 		GetAsSockAddrIn()->sin_port = htons(inPort);
 	}
 
-	/** Parameterized constructor using an IP addreass and a port. */
+	/**
+	 * Parameterized constructor using an IP addreass and a port.
+	 * Names are resolved once, later addresses with the same string
+	 * are taken from a cache. If the name cannot be resolved, the
+	 * address is not valid.
+	 */
 	SocketAddress(const std::string &inAddresAndPort);
 	
 	/** Copy constructor. */
@@ -53,6 +58,34 @@ public:
 	*/
 	std::string GetIPString() const;
 
+	/**
+	 * It returns the IPv4 address in host byte order.
+	 */
+	uint32_t GetIPv4Address() const { return ntohl(GetAsSockAddrIn()->sin_addr.s_addr); }
+
+	/**
+	 * It returns the port in host byte order.
+	 */
+	uint16_t GetPort() const { return ntohs(GetAsSockAddrIn()->sin_port); }
+
+	/**
+	 * Tells whether or not the address can be used as a destination
+	 * (a name that could not be resolved, or a missing port, cannot).
+	 */
+	bool IsValid() const
+	{
+		return mSockAddr.sa_family == AF_INET && GetAsSockAddrIn()->sin_port != 0;
+	}
+
+	/**
+	 * Tells whether or not the address refers to this machine
+	 * through the loopback interface (127.x.x.x).
+	 */
+	bool IsLoopback() const
+	{
+		return (ntohl(GetAsSockAddrIn()->sin_addr.s_addr) >> 24) == 127;
+	}
+
 	/**
 	 * Tells whether or not two addresses are the same.
 	 */
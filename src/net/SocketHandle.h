@@ -0,0 +1,30 @@
+#ifndef SOCKET_HANDLE_H
+#define SOCKET_HANDLE_H
+
+#include <cstdint>
+
+/**
+ * Reference to a socket of a TCPNetworkManager which does not keep it
+ * alive: the index of its slot in the socket tables of the manager, and
+ * the generation of that slot. Slots are reused once their socket is
+ * gone, with a new generation, so stale handles are detected (see
+ * TCPNetworkManager::GetSocket).
+ */
+struct SocketHandle
+{
+	static constexpr uint32_t INVALID_INDEX = 0xFFFFFFFF;
+
+	uint32_t index = INVALID_INDEX;
+	uint32_t generation = 0;
+
+	bool IsValid() const { return index != INVALID_INDEX; }
+
+	bool operator==(const SocketHandle &other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const SocketHandle &other) const { return !(*this == other); }
+	bool operator<(const SocketHandle &other) const
+	{
+		return index < other.index || (index == other.index && generation < other.generation);
+	}
+};
+
+#endif // SOCKET_HANDLE_H
@@ -0,0 +1,91 @@
+#ifndef SOCKET_POLLER_H
+#define SOCKET_POLLER_H
+
+/**
+ * Readiness notification mechanisms that TCPNetworkManager can use
+ * to find out which of its sockets can be read or written.
+ */
+enum class SocketPollerBackend
+{
+	Select, // Portable, rebuilds the fd_sets every frame
+	Epoll,  // Linux only, sockets are registered once
+	IoUring // Linux only, poll requests are submitted in batches
+};
+
+/**
+ * Interface of a readiness backend.
+ * Sockets are registered once and are always watched for reading.
+ * Write interest is toggled by the sockets themselves whenever their
+ * outgoing data state changes (see TCPSocket::UpdateWriteInterest).
+ */
+class SocketPoller
+{
+public:
+
+	virtual ~SocketPoller() { }
+
+	// Register / unregister a socket
+	virtual void AddSocket(const TCPSocketPtr &socket) = 0;
+	virtual void RemoveSocket(const TCPSocketPtr &socket) = 0;
+
+	// Start / stop watching a registered socket for writing
+	virtual void SetWriteInterest(TCPSocket &socket, bool enable) = 0;
+
+	// Wait for up to timeoutMillis and append the ready sockets
+	// to the output vectors (not owned, they are valid until removed).
+	// It returns the number of events.
+	virtual int Poll(
+			std::vector<TCPSocket*> &outReadableSockets,
+			std::vector<TCPSocket*> &outWritableSockets,
+			int timeoutMillis) = 0;
+
+	virtual SocketPollerBackend GetBackend() const = 0;
+	virtual const char *GetName() const = 0;
+
+	// Completion backends accept, receive and send by themselves. Their
+	// sockets take the connections and data from them instead of making
+	// the system calls (see TCPSocket::Accept, ReceiveV and
+	// HandleOutgoingData). Listen sockets are reported readable while
+	// there are connections to take, and connected sockets while there
+	// is data to take, and writable while they can hand over a send.
+	virtual bool DoesIO() const { return false; }
+
+	// The next accepted connection, or INVALID_SOCKET if there is none
+	virtual SOCKET TakeAcceptedSocket(TCPSocket &) { return INVALID_SOCKET; }
+
+	// Copy received data like readv() would do (setting errno on errors)
+	virtual int Receive(TCPSocket &, const RingBufferRegion *, int) { return -1; }
+
+	// Start sending the regions. They must stay valid until the backend
+	// calls CompleteSend on the socket.
+	virtual void Send(TCPSocket &, const RingBufferRegion *, int) { }
+
+protected:
+
+	// Helpers to let backends attach themselves to the sockets
+	static void AttachSocket(TCPSocket &socket, SocketPoller *poller);
+	static void DetachSocket(TCPSocket &socket);
+	static void CompleteSend(TCPSocket &socket, uint32_t requestedBytes, int result);
+};
+
+typedef std::unique_ptr<SocketPoller> SocketPollerPtr;
+
+inline void SocketPoller::AttachSocket(TCPSocket &socket, SocketPoller *poller)
+{
+	socket.mPoller = poller;
+	socket.mFlags &= ~TCPSocket::FlagWriteInterest;
+	socket.UpdateWriteInterest();
+}
+
+inline void SocketPoller::DetachSocket(TCPSocket &socket)
+{
+	socket.mPoller = nullptr;
+	socket.mFlags &= ~TCPSocket::FlagWriteInterest;
+}
+
+inline void SocketPoller::CompleteSend(TCPSocket &socket, uint32_t requestedBytes, int result)
+{
+	socket.CompleteSend(requestedBytes, result);
+}
+
+#endif // SOCKET_POLLER_H
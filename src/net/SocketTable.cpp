@@ -0,0 +1,85 @@
+#include "Net.h"
+
+SocketHandle SocketHandleAllocator::Acquire()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	SocketHandle handle;
+	if (mFreeIndices.empty())
+	{
+		handle.index = (uint32_t)mGenerations.size();
+		mGenerations.push_back(0);
+	}
+	else
+	{
+		handle.index = mFreeIndices.back();
+		mFreeIndices.pop_back();
+	}
+	handle.generation = mGenerations[handle.index];
+	return handle;
+}
+
+void SocketHandleAllocator::Release(SocketHandle inHandle)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	assert(inHandle.index < mGenerations.size() && mGenerations[inHandle.index] == inHandle.generation);
+	mGenerations[inHandle.index]++;
+	mFreeIndices.push_back(inHandle.index);
+}
+
+void SocketTable::Insert(const TCPSocketPtr &inSocket)
+{
+	const SocketHandle handle = inSocket->GetHandle();
+	assert(handle.IsValid());
+	if (handle.index >= mSlots.size())
+	{
+		mSlots.resize(handle.index + 1);
+	}
+
+	Slot &slot = mSlots[handle.index];
+	assert(slot.position == NO_POSITION && "SocketTable::Insert() - the slot is in use.");
+	slot.generation = handle.generation;
+	slot.position = (uint32_t)mSockets.size();
+	mSockets.push_back(inSocket);
+}
+
+void SocketTable::Erase(SocketHandle inHandle)
+{
+	if (Get(inHandle) == nullptr)
+	{
+		return;
+	}
+
+	// The last socket takes the place of the erased one
+	Slot &slot = mSlots[inHandle.index];
+	const uint32_t position = slot.position;
+	if (position != mSockets.size() - 1)
+	{
+		mSockets[position] = std::move(mSockets.back());
+		mSlots[mSockets[position]->GetHandle().index].position = position;
+	}
+	mSockets.pop_back();
+	slot.position = NO_POSITION;
+}
+
+void SocketTable::Clear()
+{
+	mSlots.clear();
+	mSockets.clear();
+}
+
+TCPSocket *SocketTable::Get(SocketHandle inHandle) const
+{
+	if (inHandle.index >= mSlots.size())
+	{
+		return nullptr;
+	}
+
+	const Slot &slot = mSlots[inHandle.index];
+	if (slot.position == NO_POSITION || slot.generation != inHandle.generation)
+	{
+		return nullptr;
+	}
+	return mSockets[slot.position].get();
+}
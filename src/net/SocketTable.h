@@ -0,0 +1,60 @@
+#ifndef SOCKET_TABLE_H
+#define SOCKET_TABLE_H
+
+#include <mutex>
+
+// It hands out the socket handles of a network manager. Safe to call
+// from any thread: sockets are created by the main thread (connections,
+// listen sockets) and by the thread doing the socket operations
+// (accepted connections).
+class SocketHandleAllocator
+{
+public:
+
+	// The index of a released handle is reused with the next generation
+	SocketHandle Acquire();
+	void Release(SocketHandle inHandle);
+
+private:
+
+	std::mutex mMutex;
+	std::vector<uint32_t> mGenerations; /**< Current generation of each index. */
+	std::vector<uint32_t> mFreeIndices;
+};
+
+// Sockets kept contiguous, so that the loops over all of them walk a
+// dense array, and found by handle in constant time. Removing a socket
+// moves the last one into its place. Not thread safe, each table is
+// owned by one thread.
+class SocketTable
+{
+public:
+
+	// The socket is kept at the index of its handle (see TCPSocket::GetHandle)
+	void Insert(const TCPSocketPtr &inSocket);
+	void Erase(SocketHandle inHandle);
+	void Clear();
+
+	// It returns nullptr if the handle is stale (or not in this table)
+	TCPSocket *Get(SocketHandle inHandle) const;
+
+	size_t Size() const { return mSockets.size(); }
+	bool IsEmpty() const { return mSockets.empty(); }
+	const TCPSocketPtr &operator[](size_t inPosition) const { return mSockets[inPosition]; }
+	std::vector<TCPSocketPtr>::const_iterator begin() const { return mSockets.begin(); }
+	std::vector<TCPSocketPtr>::const_iterator end() const { return mSockets.end(); }
+
+private:
+
+	static constexpr uint32_t NO_POSITION = 0xFFFFFFFF;
+
+	struct Slot {
+		uint32_t generation = 0;
+		uint32_t position = NO_POSITION; /**< Index into mSockets, if in use. */
+	};
+
+	std::vector<Slot> mSlots;            /**< By handle index. */
+	std::vector<TCPSocketPtr> mSockets;  /**< Dense, in no particular order. */
+};
+
+#endif // SOCKET_TABLE_H
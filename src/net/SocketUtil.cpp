@@ -81,12 +81,59 @@ TCPSocketPtr SocketUtil::CreateTCPSocket(SocketAddressFamily inFamily)
 	}
 }
 
-fd_set* SocketUtil::FillSetFromVector(fd_set& outSet, const std::vector< TCPSocketPtr >* inSockets, int& ioNaxNfds)
+void SocketUtil::CreateLocalTCPSocketPair(TCPSocketPtr &outFirst, TCPSocketPtr &outSecond)
+{
+	outFirst = TCPSocketPtr(new TCPSocket(INVALID_SOCKET));
+	outSecond = TCPSocketPtr(new TCPSocket(INVALID_SOCKET));
+	outFirst->mFlags |= TCPSocket::FlagLocal;
+	outSecond->mFlags |= TCPSocket::FlagLocal;
+	outFirst->mPeer = outSecond;
+	outSecond->mPeer = outFirst;
+}
+
+SocketPollerPtr SocketUtil::CreateSocketPoller(SocketPollerBackend inBackend)
+{
+#if defined(HAS_IO_URING)
+	if (inBackend == SocketPollerBackend::IoUring)
+	{
+		std::unique_ptr<IoUringSocketPoller> poller(new IoUringSocketPoller());
+		if (poller->IsValid())
+		{
+			return SocketPollerPtr(poller.release());
+		}
+
+		// Kernel too old, epoll is the next best thing
+		inBackend = SocketPollerBackend::Epoll;
+	}
+#endif
+#if defined(__linux__)
+	if (inBackend == SocketPollerBackend::Epoll)
+	{
+		std::unique_ptr<EpollSocketPoller> poller(new EpollSocketPoller());
+		if (poller->IsValid())
+		{
+			return SocketPollerPtr(poller.release());
+		}
+	}
+#endif
+	return SocketPollerPtr(new SelectSocketPoller());
+}
+
+SocketPollerBackend SocketUtil::DefaultSocketPollerBackend()
+{
+#if defined(__linux__)
+	return SocketPollerBackend::Epoll;
+#else
+	return SocketPollerBackend::Select;
+#endif
+}
+
+fd_set* SocketUtil::FillSetFromVector(fd_set& outSet, const std::vector< TCPSocket* >* inSockets, int& ioNaxNfds)
 {
 	if (inSockets)
 	{
 		FD_ZERO(&outSet);
-		for (const TCPSocketPtr& socket : *inSockets)
+		for (TCPSocket *socket : *inSockets)
 		{
 			FD_SET(socket->mSocket, &outSet);
 #if !_WIN32
@@ -101,7 +148,7 @@ fd_set* SocketUtil::FillSetFromVector(fd_set& outSet, const std::vector< TCPSock
 	}
 }
 
-fd_set* SocketUtil::FillSetFromVectorRange(fd_set& outSet, const std::vector< TCPSocketPtr >* inSockets, int& ioNaxNfds, int begin, int end)
+fd_set* SocketUtil::FillSetFromVectorRange(fd_set& outSet, const std::vector< TCPSocket* >* inSockets, int& ioNaxNfds, int begin, int end)
 {
 	if (inSockets)
 	{
@@ -109,7 +156,7 @@ fd_set* SocketUtil::FillSetFromVectorRange(fd_set& outSet, const std::vector< TC
 		FD_ZERO(&outSet);
 		for (unsigned int i = begin; i < end && i < inSockets->size(); ++i)
 		{
-			const TCPSocketPtr &socket((*inSockets)[i]);
+			TCPSocket *socket = (*inSockets)[i];
 
 			FD_SET(socket->mSocket, &outSet);
 #if !_WIN32
@@ -124,12 +171,12 @@ fd_set* SocketUtil::FillSetFromVectorRange(fd_set& outSet, const std::vector< TC
 	}
 }
 
-void SocketUtil::FillVectorFromSet(std::vector< TCPSocketPtr >* outSockets, const std::vector< TCPSocketPtr >* inSockets, const fd_set& inSet)
+void SocketUtil::FillVectorFromSet(std::vector< TCPSocket* >* outSockets, const std::vector< TCPSocket* >* inSockets, const fd_set& inSet)
 {
 	if (inSockets && outSockets)
 	{
 		outSockets->clear();
-		for (const TCPSocketPtr& socket : *inSockets)
+		for (TCPSocket *socket : *inSockets)
 		{
 			if (FD_ISSET(socket->mSocket, &inSet))
 			{
@@ -139,13 +186,13 @@ void SocketUtil::FillVectorFromSet(std::vector< TCPSocketPtr >* outSockets, cons
 	}
 }
 
-void SocketUtil::AddToVectorFromSetRange(std::vector<TCPSocketPtr>* outSockets, const std::vector<TCPSocketPtr>* inSockets, const fd_set & inSet, int begin, int end)
+void SocketUtil::AddToVectorFromSetRange(std::vector<TCPSocket*>* outSockets, const std::vector<TCPSocket*>* inSockets, const fd_set & inSet, int begin, int end)
 {
 	if (inSockets && outSockets)
 	{
 		for (unsigned int i = begin; i < end && i < inSockets->size(); ++i)
 		{
-			const TCPSocketPtr &socket((*inSockets)[i]);
+			TCPSocket *socket = (*inSockets)[i];
 
 			if (FD_ISSET(socket->mSocket, &inSet))
 			{
@@ -157,12 +204,12 @@ void SocketUtil::AddToVectorFromSetRange(std::vector<TCPSocketPtr>* outSockets,
 
 #if 1
 
-int SocketUtil::Select(const std::vector< TCPSocketPtr >* inReadSet,
-	std::vector< TCPSocketPtr >* outReadSet,
-	const std::vector< TCPSocketPtr >* inWriteSet,
-	std::vector< TCPSocketPtr >* outWriteSet,
-	const std::vector< TCPSocketPtr >* inExceptSet,
-	std::vector< TCPSocketPtr >* outExceptSet,
+int SocketUtil::Select(const std::vector< TCPSocket* >* inReadSet,
+	std::vector< TCPSocket* >* outReadSet,
+	const std::vector< TCPSocket* >* inWriteSet,
+	std::vector< TCPSocket* >* outWriteSet,
+	const std::vector< TCPSocket* >* inExceptSet,
+	std::vector< TCPSocket* >* outExceptSet,
 	int timeoutMillis)
 {
 	// Maximum number of sockets supported by select()
@@ -211,12 +258,12 @@ int SocketUtil::Select(const std::vector< TCPSocketPtr >* inReadSet,
 
 #else
 
-int SocketUtil::Select(const std::vector< TCPSocketPtr >* inReadSet,
-	std::vector< TCPSocketPtr >* outReadSet,
-	const std::vector< TCPSocketPtr >* inWriteSet,
-	std::vector< TCPSocketPtr >* outWriteSet,
-	const std::vector< TCPSocketPtr >* inExceptSet,
-	std::vector< TCPSocketPtr >* outExceptSet,
+int SocketUtil::Select(const std::vector< TCPSocket* >* inReadSet,
+	std::vector< TCPSocket* >* outReadSet,
+	const std::vector< TCPSocket* >* inWriteSet,
+	std::vector< TCPSocket* >* outWriteSet,
+	const std::vector< TCPSocket* >* inExceptSet,
+	std::vector< TCPSocket* >* outExceptSet,
 	int timeoutMillis)
 {
 	//build up some sets from our vectors
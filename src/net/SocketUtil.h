@@ -18,23 +18,32 @@ public:
 	static int  GetLastError();
 
 	static int  Select(
-			const std::vector< TCPSocketPtr >* inReadSet,
-			std::vector< TCPSocketPtr >* outReadSet,
-			const std::vector< TCPSocketPtr >* inWriteSet,
-			std::vector< TCPSocketPtr >* outWriteSet,
-			const std::vector< TCPSocketPtr >* inExceptSet,
-			std::vector< TCPSocketPtr >* outExceptSet,
+			const std::vector< TCPSocket* >* inReadSet,
+			std::vector< TCPSocket* >* outReadSet,
+			const std::vector< TCPSocket* >* inWriteSet,
+			std::vector< TCPSocket* >* outWriteSet,
+			const std::vector< TCPSocket* >* inExceptSet,
+			std::vector< TCPSocket* >* outExceptSet,
 			int timeoutMillis = 0);
 
 	static UDPSocketPtr	CreateUDPSocket(SocketAddressFamily inFamily);
 	static TCPSocketPtr	CreateTCPSocket(SocketAddressFamily inFamily);
 
+	// Connected pair of sockets within this process, without descriptors
+	// (what is sent through one of them is received by the other one)
+	static void CreateLocalTCPSocketPair(TCPSocketPtr &outFirst, TCPSocketPtr &outSecond);
+
+	// Readiness backend used by TCPNetworkManager (io_uring falls back to
+	// epoll on older kernels, anything else not available falls back to select)
+	static SocketPollerPtr CreateSocketPoller(SocketPollerBackend inBackend);
+	static SocketPollerBackend DefaultSocketPollerBackend();
+
 private:
 
-	static fd_set* FillSetFromVector(fd_set& outSet, const std::vector< TCPSocketPtr >* inSockets, int& ioNaxNfds);
-	static fd_set* FillSetFromVectorRange(fd_set& outSet, const std::vector< TCPSocketPtr >* inSockets, int& ioNaxNfds, int begin, int end);
-	static void FillVectorFromSet(std::vector< TCPSocketPtr >* outSockets, const std::vector< TCPSocketPtr >* inSockets, const fd_set& inSet);
-	static void AddToVectorFromSetRange(std::vector< TCPSocketPtr >* outSockets, const std::vector< TCPSocketPtr >* inSockets, const fd_set& inSet, int begin, int end);
+	static fd_set* FillSetFromVector(fd_set& outSet, const std::vector< TCPSocket* >* inSockets, int& ioNaxNfds);
+	static fd_set* FillSetFromVectorRange(fd_set& outSet, const std::vector< TCPSocket* >* inSockets, int& ioNaxNfds, int begin, int end);
+	static void FillVectorFromSet(std::vector< TCPSocket* >* outSockets, const std::vector< TCPSocket* >* inSockets, const fd_set& inSet);
+	static void AddToVectorFromSetRange(std::vector< TCPSocket* >* outSockets, const std::vector< TCPSocket* >* inSockets, const fd_set& inSet, int begin, int end);
 };
 
 #endif // SOCKET_UTIL_H
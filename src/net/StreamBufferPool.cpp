@@ -0,0 +1,141 @@
+#include "StreamBufferPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+	// Every buffer is preceded by its size class (kept aligned)
+	constexpr size_t BUFFER_HEADER_SIZE = 16;
+	constexpr uint32_t UNPOOLED_SIZE_CLASS = STREAM_BUFFER_SIZE_CLASS_COUNT;
+
+	struct FreeLists
+	{
+		FreeLists()
+		{
+			for (auto &buffers : sizeClasses) {
+				buffers.reserve(STREAM_BUFFER_POOL_MAX_FREE);
+			}
+		}
+
+		~FreeLists();
+
+		std::vector<char*> sizeClasses[STREAM_BUFFER_SIZE_CLASS_COUNT];
+	};
+
+	thread_local FreeLists tFreeLists;
+	thread_local bool tFreeListsDestroyed = false; /**< Buffers released later are freed. */
+
+	// Buffers moved at once between the thread lists and the shared ones
+	constexpr uint32_t BATCH_SIZE = STREAM_BUFFER_POOL_MAX_FREE / 2;
+
+	struct SharedFreeLists
+	{
+		~SharedFreeLists()
+		{
+			for (auto &buffers : sizeClasses) {
+				for (char *buffer : buffers) {
+					std::free(buffer - BUFFER_HEADER_SIZE);
+				}
+			}
+		}
+
+		std::mutex mutex;
+		std::vector<char*> sizeClasses[STREAM_BUFFER_SIZE_CLASS_COUNT];
+	};
+
+	SharedFreeLists gSharedFreeLists;
+
+	std::atomic<uint64_t> gAcquireCount(0);
+	std::atomic<uint64_t> gSystemAllocationCount(0);
+
+	FreeLists::~FreeLists()
+	{
+		tFreeListsDestroyed = true;
+		for (auto &buffers : sizeClasses) {
+			for (char *buffer : buffers) {
+				std::free(buffer - BUFFER_HEADER_SIZE);
+			}
+		}
+	}
+}
+
+char *StreamBufferPool::Acquire(uint32_t inSize, uint32_t &outCapacity)
+{
+	gAcquireCount.fetch_add(1, std::memory_order_relaxed);
+
+	uint32_t sizeClass = 0;
+	while (sizeClass < STREAM_BUFFER_SIZE_CLASS_COUNT && STREAM_BUFFER_SIZE_CLASSES[sizeClass] < inSize) {
+		sizeClass++;
+	}
+
+	if (sizeClass != UNPOOLED_SIZE_CLASS && !tFreeListsDestroyed)
+	{
+		std::vector<char*> &buffers = tFreeLists.sizeClasses[sizeClass];
+		if (buffers.empty())
+		{
+			std::lock_guard<std::mutex> lock(gSharedFreeLists.mutex);
+			std::vector<char*> &shared = gSharedFreeLists.sizeClasses[sizeClass];
+			const size_t count = std::min<size_t>(shared.size(), BATCH_SIZE);
+			buffers.insert(buffers.end(), shared.end() - count, shared.end());
+			shared.resize(shared.size() - count);
+		}
+		if (!buffers.empty())
+		{
+			char *buffer = buffers.back();
+			buffers.pop_back();
+			outCapacity = STREAM_BUFFER_SIZE_CLASSES[sizeClass];
+			return buffer;
+		}
+	}
+
+	const uint32_t capacity = (sizeClass != UNPOOLED_SIZE_CLASS) ? STREAM_BUFFER_SIZE_CLASSES[sizeClass] : inSize;
+	char *block = static_cast<char*>(std::malloc(BUFFER_HEADER_SIZE + capacity));
+	assert(block != nullptr && "StreamBufferPool::Acquire() - std::malloc() failed.");
+	gSystemAllocationCount.fetch_add(1, std::memory_order_relaxed);
+
+	*reinterpret_cast<uint32_t*>(block) = sizeClass;
+	outCapacity = capacity;
+	return block + BUFFER_HEADER_SIZE;
+}
+
+void StreamBufferPool::Release(char *inBuffer)
+{
+	if (inBuffer == nullptr) {
+		return;
+	}
+
+	char *block = inBuffer - BUFFER_HEADER_SIZE;
+	const uint32_t sizeClass = *reinterpret_cast<uint32_t*>(block);
+	if (sizeClass != UNPOOLED_SIZE_CLASS && !tFreeListsDestroyed)
+	{
+		std::vector<char*> &buffers = tFreeLists.sizeClasses[sizeClass];
+		if (buffers.size() == STREAM_BUFFER_POOL_MAX_FREE)
+		{
+			std::lock_guard<std::mutex> lock(gSharedFreeLists.mutex);
+			std::vector<char*> &shared = gSharedFreeLists.sizeClasses[sizeClass];
+			const size_t count = std::min<size_t>(STREAM_BUFFER_POOL_MAX_SHARED - shared.size(), BATCH_SIZE);
+			shared.insert(shared.end(), buffers.end() - count, buffers.end());
+			buffers.resize(buffers.size() - count);
+		}
+		if (buffers.size() < STREAM_BUFFER_POOL_MAX_FREE)
+		{
+			buffers.push_back(inBuffer);
+			return;
+		}
+	}
+	std::free(block);
+}
+
+uint64_t StreamBufferPool::AcquireCount()
+{
+	return gAcquireCount.load(std::memory_order_relaxed);
+}
+
+uint64_t StreamBufferPool::SystemAllocationCount()
+{
+	return gSystemAllocationCount.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,94 @@
+#ifndef STREAM_BUFFER_POOL_H
+#define STREAM_BUFFER_POOL_H
+
+#include <cstdint>
+
+// Capacities of the pooled buffers (bigger ones are not pooled)
+constexpr uint32_t STREAM_BUFFER_SIZE_CLASSES[] = { 256, 2048, 16 * 1024, 64 * 1024 };
+constexpr uint32_t STREAM_BUFFER_SIZE_CLASS_COUNT = sizeof(STREAM_BUFFER_SIZE_CLASSES) / sizeof(STREAM_BUFFER_SIZE_CLASSES[0]);
+
+// Free buffers kept per size class and thread
+constexpr uint32_t STREAM_BUFFER_POOL_MAX_FREE = 64;
+
+// Free buffers kept per size class in the lists shared by all threads,
+// the rest go back to the system
+constexpr uint32_t STREAM_BUFFER_POOL_MAX_SHARED = 1024;
+
+// Free lists of the buffers of the memory streams and queued packets,
+// so that the send and receive paths do not call the system allocator
+// once warmed up. Each thread has its own lists, which need no locks.
+// A buffer can be released by a different thread than the one which
+// acquired it (e.g. a packet sent from the main thread is released by
+// the network thread), it goes to the lists of the releasing thread.
+// Full thread lists move half their buffers to the shared lists, and
+// empty ones take buffers back from there, so that a thread which only
+// releases a size class feeds the one which only acquires it.
+class StreamBufferPool
+{
+public:
+
+	// It returns a buffer of at least inSize bytes, and its capacity
+	static char *Acquire(uint32_t inSize, uint32_t &outCapacity);
+
+	// Give back a buffer returned by Acquire (nullptr is ignored)
+	static void Release(char *inBuffer);
+
+	// Counters of all threads since the start
+	static uint64_t AcquireCount();
+	static uint64_t SystemAllocationCount();
+};
+
+// Buffer acquired from the StreamBufferPool, released when destroyed
+class PooledBuffer
+{
+public:
+
+	PooledBuffer() : mData(nullptr) { }
+
+	explicit PooledBuffer(uint32_t inSize)
+	{
+		uint32_t capacity;
+		mData = StreamBufferPool::Acquire(inSize, capacity);
+	}
+
+	// It takes over a buffer returned by StreamBufferPool::Acquire
+	static PooledBuffer Adopt(char *inData)
+	{
+		PooledBuffer buffer;
+		buffer.mData = inData;
+		return buffer;
+	}
+
+	~PooledBuffer() { StreamBufferPool::Release(mData); }
+
+	// Movable, not copyable
+	PooledBuffer(PooledBuffer &&inOther) : mData(inOther.mData) { inOther.mData = nullptr; }
+	PooledBuffer &operator=(PooledBuffer &&inOther)
+	{
+		if (this != &inOther)
+		{
+			StreamBufferPool::Release(mData);
+			mData = inOther.mData;
+			inOther.mData = nullptr;
+		}
+		return *this;
+	}
+	PooledBuffer(const PooledBuffer &) = delete;
+	PooledBuffer &operator=(const PooledBuffer &) = delete;
+
+	char *Get() const { return mData; }
+
+	// Hands the buffer over to the caller, who must release it
+	char *Detach()
+	{
+		char *data = mData;
+		mData = nullptr;
+		return data;
+	}
+
+private:
+
+	char *mData;
+};
+
+#endif // STREAM_BUFFER_POOL_H
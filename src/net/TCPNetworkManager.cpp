@@ -6,12 +6,28 @@
 
 
 TCPNetworkManager::TCPNetworkManager() :
-	mDelegate(nullptr)
+	mDelegate(nullptr),
+	mPoller(SocketUtil::CreateSocketPoller(SocketUtil::DefaultSocketPollerBackend())),
+	mFirstReadable(INVALID_SOCKET),
+	mSharedMemoryEnabled(true),
+	mOutgoingBudget(std::make_shared<OutgoingBudget>(DEFAULT_OUTGOING_BUDGET)),
+	mStats(std::make_shared<ConnectionStats>()),
+	mReadBudget(DEFAULT_READ_BUDGET),
+	mAcceptBudget(DEFAULT_ACCEPT_BUDGET),
+	mSendImmediately(true),
+	mSocketCount(0),
+	mLocalSocketCount(0),
+	mSharedMemorySocketCount(0),
+	mBackingUpSocketCount(0)
 {
 }
 
 TCPNetworkManager::~TCPNetworkManager()
 {
+	StopThread();
+
+	for (auto socket : mSockets)
+		mPoller->RemoveSocket(socket);
 }
 
 void TCPNetworkManager::SetDelegate(TCPNetworkManagerDelegate * delegate)
@@ -19,96 +35,702 @@ void TCPNetworkManager::SetDelegate(TCPNetworkManagerDelegate * delegate)
 	mDelegate = delegate;
 }
 
-void TCPNetworkManager::AddSocket(TCPSocketPtr socket)
+void TCPNetworkManager::SetPollerBackend(SocketPollerBackend backend)
 {
-	mSockets.push_back(socket);
+	// The sockets cannot change hands while the thread uses them
+	const bool threaded = IsThreaded();
+	StopThread();
+
+	// Move all the sockets to the new backend
+	SocketPollerPtr poller = SocketUtil::CreateSocketPoller(backend);
+	for (auto socket : mSockets)
+	{
+		mPoller->RemoveSocket(socket);
+		poller->AddSocket(socket);
+	}
+	mPoller.swap(poller);
+
+	if (threaded) {
+		StartThread();
+	}
 }
 
-void TCPNetworkManager::HandleSocketOperations(int timeoutMillis)
+void TCPNetworkManager::AddSocket(const TCPSocketPtr &socket)
 {
-	// Preselect sockets for reading and writing
-	std::vector<TCPSocketPtr> potentiallyReadableSockets;
-	std::vector<TCPSocketPtr> potentiallyWritableSockets;
-	for (auto socket : mSockets)
+	if (socket->IsListening())
+	{
+		// Connections are accepted until it would block
+		socket->SetNonBlockingMode(true);
+		mListenSockets.push_back(socket);
+	}
+
+	// Before the socket can be used from another thread
+	socket->mHandle = mHandles.Acquire();
+	socket->mBudget = mOutgoingBudget;
+	socket->mManagerStats = mStats;
+	if (mSendImmediately) {
+		socket->mFlags |= TCPSocket::FlagSendImmediately;
+	}
+	mDelegateSockets.Insert(socket);
+
+	if (IsThreaded())
+	{
+		socket->mThread = mThread.get();
+
+		NetworkCommand command;
+		command.type = NetworkCommand::AddSocket;
+		command.socket = socket;
+		mThread->PostCommand(std::move(command));
+	}
+	else
+	{
+		RegisterSocket(socket);
+	}
+}
+
+void TCPNetworkManager::SetSendImmediately(bool enabled)
+{
+	mSendImmediately = enabled;
+
+	// The sockets are owned by the thread doing the socket operations
+	if (IsThreaded())
+	{
+		NetworkCommand command;
+		command.type = NetworkCommand::UpdateSendImmediately;
+		mThread->PostCommand(std::move(command));
+	}
+	else
+	{
+		UpdateSendImmediately();
+	}
+}
+
+void TCPNetworkManager::UpdateSendImmediately()
+{
+	// The flag of a socket is atomic, the main thread may be sending
+	const bool enabled = mSendImmediately;
+	for (const TCPSocketPtr &socket : mSockets)
+	{
+		if (enabled) {
+			socket->mFlags |= TCPSocket::FlagSendImmediately;
+		} else {
+			socket->mFlags &= ~TCPSocket::FlagSendImmediately;
+		}
+	}
+}
+
+void TCPNetworkManager::RegisterSocket(const TCPSocketPtr &socket)
+{
+	// Sockets added by the main thread have it set already, and it
+	// cannot be written here while that thread may be sending
+	mSockets.Insert(socket);
+	mPoller->AddSocket(socket);
+}
+
+void TCPNetworkManager::RegisterLocalPair(const TCPSocketPtr &socket, const TCPSocketPtr &peer)
+{
+	mLocalSockets.Insert(socket);
+	mLocalSockets.Insert(peer);
+}
+
+TCPSocketPtr TCPNetworkManager::GetConnection(const std::string &host, uint16_t port)
+{
+	return GetConnection(SocketAddress(host + ":" + std::to_string(port)));
+}
+
+TCPSocketPtr TCPNetworkManager::GetConnection(const SocketAddress &address)
+{
+	// Reuse the pooled connection if it is still alive
+	auto it = mConnections.find(address);
+	if (it != mConnections.end())
+	{
+		const TCPSocketPtr &socket(it->second);
+		if (!socket->IsDisconnected() && !socket->ToDisconnect())
+		{
+			return socket;
+		}
+		mConnections.erase(it);
+	}
+
+	// Otherwise create a new one
+	TCPSocketPtr listenSocket = FindListenSocket(address);
+	if (listenSocket != nullptr)
+	{
+		TCPSocketPtr socket = CreateLocalConnection(address, listenSocket);
+		mConnections[address] = socket;
+		return socket;
+	}
+
+	TCPSocketPtr socket = SocketUtil::CreateTCPSocket(SocketAddressFamily::INET);
+	if (socket == nullptr)
+	{
+		return nullptr;
+	}
+
+	socket->SetNonBlockingMode(true);
+	if (socket->Connect(address) != NO_ERROR)
+	{
+		return nullptr;
+	}
+
+	// Another process of this host: packets go through shared memory
+	// once connected
+	if (mSharedMemoryEnabled && address.IsLoopback())
+	{
+		socket->mFlags |= TCPSocket::FlagOfferSharedMemory;
+	}
+
+	AddSocket(socket);
+	mConnections[address] = socket;
+	return socket;
+}
+
+bool TCPNetworkManager::IsLocalAddress(const std::string &host, uint16_t port)
+{
+	return IsLocalAddress(SocketAddress(host + ":" + std::to_string(port)));
+}
+
+bool TCPNetworkManager::IsLocalAddress(const SocketAddress &address)
+{
+	auto it = mConnections.find(address);
+	if (it != mConnections.end())
 	{
-		if (!socket->IsDisconnected())
+		return it->second->IsLocal();
+	}
+
+	return FindListenSocket(address) != nullptr;
+}
+
+TCPSocketPtr TCPNetworkManager::FindListenSocket(const SocketAddress &address) const
+{
+	if (address.IsLoopback())
+	{
+		for (auto &socket : mListenSockets)
 		{
-			potentiallyReadableSockets.push_back(socket);
-			if (socket->HasOutgoingData())
+			if (socket->LocalAddress().GetPort() == address.GetPort())
 			{
-				potentiallyWritableSockets.push_back(socket);
+				return socket;
 			}
 		}
 	}
+	return nullptr;
+}
+
+TCPSocketPtr TCPNetworkManager::CreateLocalConnection(const SocketAddress &address, const TCPSocketPtr &listenSocket)
+{
+	TCPSocketPtr clientSocket, serverSocket;
+	SocketUtil::CreateLocalTCPSocketPair(clientSocket, serverSocket);
+	clientSocket->mRemoteAddress = address;
+	serverSocket->mRemoteAddress = address;
+	clientSocket->mHandle = mHandles.Acquire();
+	serverSocket->mHandle = mHandles.Acquire();
+	mDelegateSockets.Insert(clientSocket);
+	mDelegateSockets.Insert(serverSocket);
 
-	// Select readable and writable sockets
-	std::vector<TCPSocketPtr> readableSockets;
-	std::vector<TCPSocketPtr> writableSockets;
-	SocketUtil::Select(&potentiallyReadableSockets, &readableSockets, &potentiallyWritableSockets, &writableSockets, nullptr, nullptr, timeoutMillis);
+	// Same limits as the sockets accepted by the listen socket
+	serverSocket->SetBufferLimits(listenSocket->mIncomingData.GetCapacity(), listenSocket->mHighWaterMark);
+	clientSocket->mBudget = mOutgoingBudget;
+	serverSocket->mBudget = mOutgoingBudget;
+	clientSocket->mManagerStats = mStats;
+	serverSocket->mManagerStats = mStats;
 
-	// Handle reading
-	for (auto socket : readableSockets)
+	if (IsThreaded())
 	{
+		clientSocket->mThread = mThread.get();
+		serverSocket->mThread = mThread.get();
+
+		NetworkCommand command;
+		command.type = NetworkCommand::AddLocalPair;
+		command.socket = clientSocket;
+		command.peer = serverSocket;
+		mThread->PostCommand(std::move(command));
+	}
+	else
+	{
+		RegisterLocalPair(clientSocket, serverSocket);
+	}
+
+	// The server end is accepted as any other incoming connection
+	mStats->CountConnect();
+	mStats->CountAccept();
+	mDelegate->OnAccepted(serverSocket->GetHandle());
+	return clientSocket;
+}
+
+void TCPNetworkManager::RemoveConnection(const TCPSocketPtr &socket)
+{
+	for (auto it = mConnections.begin(); it != mConnections.end(); ++it)
+	{
+		if (it->second == socket)
+		{
+			mConnections.erase(it);
+			break;
+		}
+	}
+}
+
+void TCPNetworkManager::ReleaseSocket(const TCPSocketPtr &socket)
+{
+	// The thread doing the socket operations dropped it already, so the
+	// slot can be reused from now on
+	mDelegateSockets.Erase(socket->GetHandle());
+	mHandles.Release(socket->GetHandle());
+}
+
+TCPSocket *TCPNetworkManager::GetSocket(SocketHandle handle) const
+{
+	return mDelegateSockets.Get(handle);
+}
+
+bool TCPNetworkManager::SendPacket(SocketHandle handle, OutputMemoryStream &&stream, PacketPriority priority)
+{
+	TCPSocket *socket = mDelegateSockets.Get(handle);
+	if (socket == nullptr)
+	{
+		return false;
+	}
+	return socket->SendPacket(std::move(stream), priority);
+}
+
+bool TCPNetworkManager::CompareDescriptors(const TCPSocket *a, const TCPSocket *b)
+{
+	return a->mSocket < b->mSocket;
+}
+
+bool TCPNetworkManager::CompareDescriptor(SOCKET descriptor, const TCPSocket *socket)
+{
+	return descriptor < socket->mSocket;
+}
+
+void TCPNetworkManager::HandleSocketOperations(int timeoutMillis)
+{
+	// Ask the backend for readable and writable sockets
+	mReadableSockets.clear();
+	mWritableSockets.clear();
+	if (timeoutMillis != 0 && !PrepareSharedMemoryWait())
+	{
+		timeoutMillis = 0; // Packets in shared memory already
+	}
+	mPoller->Poll(mReadableSockets, mWritableSockets, timeoutMillis);
+
+	// Handle reading in descriptor order, starting after the socket that
+	// went first last time (round robin, whatever sockets are ready)
+	if (!mReadableSockets.empty())
+	{
+		std::sort(mReadableSockets.begin(), mReadableSockets.end(), CompareDescriptors);
+		auto first = std::upper_bound(mReadableSockets.begin(), mReadableSockets.end(), mFirstReadable, CompareDescriptor);
+		if (first == mReadableSockets.end())
+		{
+			first = mReadableSockets.begin();
+		}
+		mFirstReadable = (*first)->mSocket;
+		std::rotate(mReadableSockets.begin(), first, mReadableSockets.end());
+	}
+	for (TCPSocket *readableSocket : mReadableSockets)
+	{
+		// Only the sockets with something to do are referenced
+		const TCPSocketPtr socket = readableSocket->shared_from_this();
 		if (socket->IsListening())
 		{
-			SocketAddress fromAddress;
-			TCPSocketPtr connectedSocket = socket->Accept(fromAddress);
-			if (connectedSocket != nullptr)
-			{
-				mSockets.push_back(connectedSocket);
-				mDelegate->OnAccepted(connectedSocket);
-			}
+			AcceptConnections(socket);
 		}
-		else
+		else if (!socket->IsConnecting() && !socket->IsBackingUp())
 		{
-			socket->HandleIncomingData();
+			const bool wasSharedMemory = socket->IsSharedMemory();
 
-			if (!socket->IsDisconnected())
-			{
-				// 1) Crear in InputMemoryStream
-				InputMemoryStream inputMemoryStream;
+			// Peers whose replies are backing up are not read until they drain
+			ReadPackets(socket);
 
-				while (socket->ReceivePacket(inputMemoryStream.GetBufferPtr(), inputMemoryStream.GetCapacity()))
-				{
-					mDelegate->OnPacketReceived(socket, inputMemoryStream);
-					inputMemoryStream.Clear();
-				}
+			// The peer offered a shared memory channel
+			if (!wasSharedMemory && socket->IsSharedMemory())
+			{
+				mSharedMemorySockets.push_back(socket);
 			}
 		}
 	}
 
 	// Handle writing
-	for (auto socket : writableSockets)
+	for (TCPSocket *writableSocket : mWritableSockets)
 	{
+		const TCPSocketPtr socket = writableSocket->shared_from_this();
+		if (socket->IsConnecting())
+		{
+			if (socket->FinishConnect() == NO_ERROR)
+			{
+				if (socket->IsSharedMemory())
+				{
+					mSharedMemorySockets.push_back(socket);
+				}
+				NotifyConnected(socket);
+			}
+			else
+			{
+				continue; // Reported below, along with the disconnections
+			}
+		}
+
 		if (!socket->IsListening() && !socket->IsDisconnected()) // Maybe not needed... check
 		{
 			socket->HandleOutgoingData();
 		}
 	}
 
-	// Handle socket disconnections
-	std::vector<TCPSocketPtr> connectedSockets;
-	for (auto socket : mSockets)
+	// Deliver the packets exchanged within this process
+	DispatchLocalPackets();
+	HandleLocalDisconnections();
+
+	// And the ones written to shared memory by other processes
+	DispatchSharedMemoryPackets();
+
+	// Handle socket disconnections. Indexed loop, sockets can be added
+	// meanwhile, and the table moves the last one into the place of the
+	// ones removed.
+	int backingUpSocketCount = 0;
+	for (size_t i = 0; i < mSockets.Size();)
 	{
+		TCPSocket *socket = mSockets[i].get();
+		if (socket->ConnectTimedOut())
+		{
+			socket->mFlags |= TCPSocket::FlagConnectFailed;
+			mPoller->RemoveSocket(mSockets[i]);
+			socket->CloseSocket();
+		}
+
 		if (socket->ToDisconnect() && !socket->HasOutgoingData())
 		{
+			// Unregister before the descriptor can be reused
+			mPoller->RemoveSocket(mSockets[i]);
 			socket->CloseSocket();
 		}
 
 		if (socket->IsDisconnected())
 		{
-			mDelegate->OnDisconnected(socket);
+			const TCPSocketPtr disconnectedSocket = mSockets[i];
+			mSockets.Erase(disconnectedSocket->GetHandle());
+
+			// Its packets will never be sent, give their bytes back once
+			// the backend is done with them. The descriptor is released
+			// once unregistered.
+			mPoller->RemoveSocket(disconnectedSocket);
+			disconnectedSocket->ClearOutgoingPackets();
+			disconnectedSocket->CloseSocket();
+
+			// A connection that never opened is not reported as disconnected
+			if (disconnectedSocket->ConnectFailed()) {
+				NotifyConnectFailed(disconnectedSocket);
+			} else {
+				NotifyDisconnected(disconnectedSocket);
+			}
 		}
 		else
 		{
-			connectedSockets.push_back(socket);
+			if (socket->IsBackingUp()) {
+				backingUpSocketCount++;
+			}
+			++i;
 		}
 	}
-	mSockets.swap(connectedSockets);
+	for (const TCPSocketPtr &localSocket : mLocalSockets)
+	{
+		if (localSocket->IsBackingUp()) {
+			backingUpSocketCount++;
+		}
+	}
+
+	mSocketCount = (int)mSockets.Size();
+	mLocalSocketCount = (int)mLocalSockets.Size();
+	mSharedMemorySocketCount = (int)mSharedMemorySockets.size();
+	mBackingUpSocketCount = backingUpSocketCount;
+}
+
+void TCPNetworkManager::DispatchLocalPackets()
+{
+	for (int round = 0; round < MAX_LOCAL_DISPATCH_ROUNDS; ++round)
+	{
+		bool delivered = false;
+
+		// Packets left waiting for room in their peer, which the
+		// previous round may have made
+		for (const TCPSocketPtr &localSocket : mLocalSockets)
+		{
+			if (localSocket->HasOutgoingData() && localSocket->HandleLocalOutgoingData()) {
+				delivered = true;
+			}
+		}
+
+		// Indexed loop, new local connections can be created meanwhile.
+		// As with remote peers, the ones whose replies are backing up are
+		// not read until they drain.
+		for (size_t i = 0; i < mLocalSockets.Size(); ++i)
+		{
+			const char *packetData;
+			uint32_t packetSize;
+			TCPSocket *localSocket = mLocalSockets[i].get();
+			if (localSocket->IsDisconnected() || localSocket->IsBackingUp() || !localSocket->PeekPacket(packetData, packetSize)) {
+				continue;
+			}
+
+			// Referenced only if there is something to deliver
+			TCPSocketPtr socket = mLocalSockets[i];
+			do
+			{
+				NotifyPacketReceived(socket, packetData, packetSize);
+				socket->ConsumePacket(packetSize);
+			}
+			while (!socket->IsDisconnected() && socket->PeekPacket(packetData, packetSize));
+
+			NotifyReceiveBatchEnd(socket);
+			delivered = true;
+		}
+
+		// With a network thread, replies come back through the command queue
+		if (!delivered || IsThreaded()) {
+			break;
+		}
+	}
+}
+
+void TCPNetworkManager::HandleLocalDisconnections()
+{
+	for (size_t i = 0; i < mLocalSockets.Size();)
+	{
+		TCPSocket *localSocket = mLocalSockets[i].get();
+		const bool flushed = !localSocket->HasOutgoingData();
+		if (localSocket->IsDisconnected() || (localSocket->ToDisconnect() && flushed) || localSocket->IsPeerClosed())
+		{
+			// Dropped before the delegate is told, which frees its handle
+			TCPSocketPtr socket = mLocalSockets[i];
+			mLocalSockets.Erase(socket->GetHandle());
+			socket->CloseSocket();
+
+			// Its packets will never be delivered, give their bytes back
+			socket->ClearOutgoingPackets();
+			NotifyDisconnected(socket);
+		}
+		else
+		{
+			++i;
+		}
+	}
+}
+
+bool TCPNetworkManager::PrepareSharedMemoryWait()
+{
+	// Peers only knock on the TCP connection if they are told that
+	// this end is going to block
+	for (auto &socket : mSharedMemorySockets)
+	{
+		if (!socket->mSharedMemory->SetConsumerWaiting(true))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void TCPNetworkManager::DispatchSharedMemoryPackets()
+{
+	for (size_t i = 0; i < mSharedMemorySockets.size();)
+	{
+		TCPSocket *sharedMemorySocket = mSharedMemorySockets[i].get();
+		sharedMemorySocket->mSharedMemory->SetConsumerWaiting(false);
+
+		// Packets written before the peer closed the connection are
+		// still delivered
+		const char *packetData;
+		uint32_t packetSize;
+		if (sharedMemorySocket->PeekPacket(packetData, packetSize))
+		{
+			// Referenced only if there is something to deliver
+			const TCPSocketPtr socket = mSharedMemorySockets[i];
+			do
+			{
+				NotifyPacketReceived(socket, packetData, packetSize);
+				socket->ConsumePacket(packetSize);
+			}
+			while (socket->PeekPacket(packetData, packetSize));
+
+			NotifyReceiveBatchEnd(socket);
+		}
+
+		if (sharedMemorySocket->IsDisconnected() || sharedMemorySocket->ToDisconnect())
+		{
+			mSharedMemorySockets[i] = mSharedMemorySockets.back();
+			mSharedMemorySockets.pop_back();
+		}
+		else
+		{
+			++i;
+		}
+	}
+}
+
+void TCPNetworkManager::AcceptConnections(const TCPSocketPtr &listenSocket)
+{
+	const uint32_t acceptBudget = mAcceptBudget;
+	for (uint32_t accepted = 0; accepted < acceptBudget; ++accepted)
+	{
+		SocketAddress fromAddress;
+		TCPSocketPtr connectedSocket = listenSocket->Accept(fromAddress);
+		if (connectedSocket == nullptr)
+		{
+			break; // No more pending connections
+		}
+
+		// Read until it would block too
+		connectedSocket->SetNonBlockingMode(true);
+		connectedSocket->mHandle = mHandles.Acquire();
+		connectedSocket->mBudget = mOutgoingBudget;
+		connectedSocket->mManagerStats = mStats;
+		connectedSocket->mThread = mThread.get();
+		if (mSendImmediately) {
+			connectedSocket->mFlags |= TCPSocket::FlagSendImmediately;
+		}
+		RegisterSocket(connectedSocket);
+		NotifyAccepted(connectedSocket);
+	}
+}
+
+void TCPNetworkManager::ReadPackets(const TCPSocketPtr &socket)
+{
+	const uint32_t readBudget = mReadBudget;
+	uint32_t readBytes = 0;
+	bool mayHaveMore;
+	do
+	{
+		readBytes += socket->HandleIncomingData(mayHaveMore);
+		if (socket->IsDisconnected())
+		{
+			break;
+		}
+
+		// Packets are decoded straight from the receive buffer, which
+		// makes room for the next read
+		bool delivered = false;
+		const char *packetData;
+		uint32_t packetSize;
+		while (socket->PeekPacket(packetData, packetSize))
+		{
+			NotifyPacketReceived(socket, packetData, packetSize);
+			socket->ConsumePacket(packetSize);
+			delivered = true;
+		}
+		if (delivered)
+		{
+			NotifyReceiveBatchEnd(socket);
+		}
+	}
+	while (mayHaveMore && readBytes < readBudget && !socket->IsBackingUp());
+}
+
+void TCPNetworkManager::NotifyAccepted(const TCPSocketPtr &socket)
+{
+	mStats->CountAccept();
+	if (IsThreaded()) {
+		mThread->PostEvent(NetworkEvent::Accepted, socket);
+	} else {
+		mDelegateSockets.Insert(socket);
+		mDelegate->OnAccepted(socket->GetHandle());
+	}
+}
+
+void TCPNetworkManager::NotifyPacketReceived(const TCPSocketPtr &socket, const char *data, uint32_t size)
+{
+	if (IsThreaded()) {
+		mThread->PostEvent(NetworkEvent::PacketReceived, socket, data, size);
+	} else {
+		InputMemoryStream inputMemoryStream(data, size);
+		mDelegate->OnPacketReceived(socket->GetHandle(), inputMemoryStream);
+	}
+}
+
+void TCPNetworkManager::NotifyReceiveBatchEnd(const TCPSocketPtr &socket)
+{
+	if (IsThreaded()) {
+		mThread->PostEvent(NetworkEvent::ReceiveBatchEnd, socket);
+	} else {
+		mDelegate->OnReceiveBatchEnd(socket->GetHandle());
+	}
+}
+
+void TCPNetworkManager::NotifyDisconnected(const TCPSocketPtr &socket)
+{
+	mStats->CountDisconnect(socket->GetLifetimeMillis());
+	if (IsThreaded()) {
+		mThread->PostEvent(NetworkEvent::Disconnected, socket);
+	} else {
+		RemoveConnection(socket);
+		mDelegate->OnDisconnected(socket->GetHandle());
+		ReleaseSocket(socket);
+	}
+}
+
+void TCPNetworkManager::NotifyConnected(const TCPSocketPtr &socket)
+{
+	mStats->CountConnect();
+	if (IsThreaded()) {
+		mThread->PostEvent(NetworkEvent::Connected, socket);
+	} else {
+		mDelegate->OnConnected(socket->GetHandle());
+	}
+}
+
+void TCPNetworkManager::NotifyConnectFailed(const TCPSocketPtr &socket)
+{
+	mStats->CountConnectFailure();
+	if (IsThreaded()) {
+		mThread->PostEvent(NetworkEvent::ConnectFailed, socket);
+	} else {
+		RemoveConnection(socket);
+		mDelegate->OnConnectFailed(socket->GetHandle());
+		ReleaseSocket(socket);
+	}
+}
+
+void TCPNetworkManager::StartThread()
+{
+	if (IsThreaded()) {
+		return;
+	}
+
+	mThread.reset(new NetworkThread(*this));
+	for (auto &socket : mSockets)
+		socket->mThread = mThread.get();
+	for (auto &socket : mLocalSockets)
+		socket->mThread = mThread.get();
+	mThread->Start();
+}
+
+void TCPNetworkManager::StopThread()
+{
+	if (!IsThreaded()) {
+		return;
+	}
+
+	mThread->Stop(mDelegate);
+	for (auto &socket : mSockets)
+		socket->mThread = nullptr;
+	for (auto &socket : mLocalSockets)
+		socket->mThread = nullptr;
+	mThread.reset();
+}
+
+void TCPNetworkManager::DispatchThreadEvents()
+{
+	if (IsThreaded()) {
+		mThread->DispatchEvents(mDelegate);
+	}
+}
+
+double TCPNetworkManager::ThreadHandoffLatencyP99() const
+{
+	return IsThreaded() ? mThread->HandoffLatencyP99() : 0.0;
 }
 
 void TCPNetworkManager::Finalize()
 {
+	StopThread();
+
 	// Finish sending pending outgoing data
 	for (int i = 0; i < 100 ; ++i) {
 		bool pendingPackets = false;
@@ -127,10 +749,19 @@ void TCPNetworkManager::Finalize()
 	// Disconnect all sockets
 	for (auto socket : mSockets)
 		socket->Disconnect();
+	for (auto socket : mLocalSockets)
+		socket->Disconnect();
 
 	// Handle last disconnections
 	HandleSocketOperations();
 
 	// Clear sockets
-	mSockets.clear();
+	for (auto socket : mSockets)
+		mPoller->RemoveSocket(socket);
+	mConnections.clear();
+	mListenSockets.clear();
+	mSockets.Clear();
+	mLocalSockets.Clear();
+	mDelegateSockets.Clear();
+	mSharedMemorySockets.clear();
 }
@@ -1,15 +1,38 @@
 #pragma once
 #include "Net.h"
 
+// Max rounds of local packet delivery per HandleSocketOperations call
+// (each round delivers the replies to the packets of the previous one)
+constexpr int MAX_LOCAL_DISPATCH_ROUNDS = 16;
+
+// Default limit of the outgoing bytes queued by all the sockets
+constexpr uint64_t DEFAULT_OUTGOING_BUDGET = 32 * 1024 * 1024;
+
+// Default bytes read from each socket, and connections accepted by
+// each listen socket, per HandleSocketOperations call
+constexpr uint32_t DEFAULT_READ_BUDGET = 256 * 1024;
+constexpr uint32_t DEFAULT_ACCEPT_BUDGET = 64;
+
 class TCPNetworkManagerDelegate
 {
 public:
 
 	virtual ~TCPNetworkManagerDelegate() { }
 
-	virtual void OnAccepted(TCPSocketPtr socket) = 0;
-	virtual void OnPacketReceived(TCPSocketPtr socket, InputMemoryStream &stream) = 0;
-	virtual void OnDisconnected(TCPSocketPtr socket) = 0;
+	// Sockets are passed by handle (see TCPNetworkManager::GetSocket),
+	// which stays valid until OnDisconnected or OnConnectFailed returns
+	virtual void OnAccepted(SocketHandle socket) = 0;
+	virtual void OnPacketReceived(SocketHandle socket, InputMemoryStream &stream) = 0;
+	virtual void OnDisconnected(SocketHandle socket) = 0;
+
+	// Completion of non-blocking connects
+	virtual void OnConnected(SocketHandle) { }
+	virtual void OnConnectFailed(SocketHandle) { }
+
+	// Called after the packets received from a socket in one go (e.g.
+	// in a single read) were passed to OnPacketReceived, so that they
+	// can be processed as a batch
+	virtual void OnReceiveBatchEnd(SocketHandle) { }
 };
 
 class TCPNetworkManager
@@ -21,19 +44,157 @@ public:
 
 	void SetDelegate(TCPNetworkManagerDelegate *delegate);
 
-	void AddSocket(TCPSocketPtr socket);
+	// Readiness backend (select, epoll...)
+	void SetPollerBackend(SocketPollerBackend backend);
+	SocketPollerBackend PollerBackend() const { return mPoller->GetBackend(); }
+	const char *PollerName() const { return mPoller->GetName(); }
+
+	void AddSocket(const TCPSocketPtr &socket);
+
+	// Sockets added or accepted, by handle (see TCPSocket::GetHandle). A
+	// handle is valid from the moment its socket is added, or reported
+	// to the delegate as accepted, until the delegate is told that it
+	// was disconnected. Stale handles give nullptr, and SendPacket
+	// returns false for them (the stream is left as is then).
+	TCPSocket *GetSocket(SocketHandle handle) const;
+	bool SendPacket(SocketHandle handle, OutputMemoryStream &&stream, PacketPriority priority = PacketPriority::Normal);
+
+	// It returns a long-lived connection to host:port, shared by all
+	// the callers. The connection is created on the first request and
+	// is kept open until the remote host closes it. New connections are
+	// established asynchronously (see TCPSocket::IsConnecting).
+	// Connections to a listen socket of this manager are local socket
+	// pairs that bypass the network (see TCPSocket::IsLocal), and the
+	// ones to other processes of this host exchange their packets
+	// through shared memory (see TCPSocket::IsSharedMemory).
+	// Host names are resolved once (see SocketAddress), the overloads
+	// taking a SocketAddress do no resolution at all.
+	TCPSocketPtr GetConnection(const std::string &host, uint16_t port);
+	TCPSocketPtr GetConnection(const SocketAddress &address);
+
+	// Whether or not host:port is a listen socket of this manager
+	bool IsLocalAddress(const std::string &host, uint16_t port);
+	bool IsLocalAddress(const SocketAddress &address);
+
+	// Whether or not new connections to other processes of this host
+	// offer a shared memory channel (enabled by default)
+	void SetSharedMemoryEnabled(bool enabled) { mSharedMemoryEnabled = enabled; }
+	bool IsSharedMemoryEnabled() const { return mSharedMemoryEnabled; }
+
+	// Limit of the outgoing bytes queued by all the sockets together
+	// (see TCPSocket::SendPacket and TCPSocket::IsBackingUp)
+	void SetOutgoingBudget(uint64_t bytes) { mOutgoingBudget->SetLimit(bytes); }
+	uint64_t OutgoingBudgetLimit() const { return mOutgoingBudget->GetLimit(); }
+	uint64_t OutgoingBudgetUsed() const { return mOutgoingBudget->GetUsed(); }
+
+	// Each readable socket is drained until it would block or until it
+	// reaches these budgets, so that pending connections are accepted
+	// in a single call but no peer can hold the others up. The sockets
+	// take turns to go first from one call to the next.
+	void SetReadBudget(uint32_t bytes) { mReadBudget = bytes; }
+	void SetAcceptBudget(uint32_t connections) { mAcceptBudget = connections; }
+	uint32_t ReadBudget() const { return mReadBudget; }
+	uint32_t AcceptBudget() const { return mAcceptBudget; }
+
+	// Whether or not a packet sent while its socket has nothing else
+	// queued leaves in the call to TCPSocket::SendPacket itself, instead
+	// of in the next socket operations (enabled by default). It saves a
+	// frame per hop, at the cost of a send call per packet as long as
+	// the socket keeps up. It applies to the sockets added already too.
+	void SetSendImmediately(bool enabled);
+	bool SendsImmediately() const { return mSendImmediately; }
+
+	// Traffic and connection churn of all the sockets since the start
+	// (safe to call while threaded, see TCPSocket::GetStats for each one)
+	const ConnectionStats &Stats() const { return *mStats; }
 
 	void HandleSocketOperations(int timeoutMillis = 0);
 
 	void Finalize();
 
+	// Optionally, socket operations can run in a thread of their own.
+	// Then HandleSocketOperations must not be called, and the delegate
+	// is notified from DispatchThreadEvents instead (in the main thread).
+	void StartThread();
+	void StopThread();
+	bool IsThreaded() const { return mThread != nullptr; }
+	void DispatchThreadEvents();
+	double ThreadHandoffLatencyP99() const;
+
+	// Safe to call while threaded
+	int SocketCount() const { return mSocketCount; }
+	int LocalSocketCount() const { return mLocalSocketCount; }
+	int SharedMemorySocketCount() const { return mSharedMemorySocketCount; }
+	int BackingUpSocketCount() const { return mBackingUpSocketCount; }
+
 protected:
 
-	const std::vector<TCPSocketPtr> &allSockets() const { return mSockets; }
+	const std::map<SocketAddress, TCPSocketPtr> &pooledConnections() const { return mConnections; }
 
 private:
 
+	friend class NetworkThread;
+
+	// Run by the thread doing the socket operations
+	void RegisterSocket(const TCPSocketPtr &socket);
+	void RegisterLocalPair(const TCPSocketPtr &socket, const TCPSocketPtr &peer);
+	void UpdateSendImmediately();
+	void DispatchLocalPackets();
+	void HandleLocalDisconnections();
+	bool PrepareSharedMemoryWait();
+	void DispatchSharedMemoryPackets();
+	void AcceptConnections(const TCPSocketPtr &listenSocket);
+	void ReadPackets(const TCPSocketPtr &socket);
+	static bool CompareDescriptors(const TCPSocket *a, const TCPSocket *b);
+	static bool CompareDescriptor(SOCKET descriptor, const TCPSocket *socket);
+	void NotifyAccepted(const TCPSocketPtr &socket);
+	void NotifyPacketReceived(const TCPSocketPtr &socket, const char *data, uint32_t size);
+	void NotifyReceiveBatchEnd(const TCPSocketPtr &socket);
+	void NotifyDisconnected(const TCPSocketPtr &socket);
+	void NotifyConnected(const TCPSocketPtr &socket);
+	void NotifyConnectFailed(const TCPSocketPtr &socket);
+
+	// Run by the main thread
+	void RemoveConnection(const TCPSocketPtr &socket);
+	void ReleaseSocket(const TCPSocketPtr &socket); /**< Once the delegate was told that it is gone. */
+	TCPSocketPtr FindListenSocket(const SocketAddress &address) const;
+	TCPSocketPtr CreateLocalConnection(const SocketAddress &address, const TCPSocketPtr &listenSocket);
+
 	TCPNetworkManagerDelegate *mDelegate;
-	std::vector<TCPSocketPtr> mSockets;
+
+	// Owned by the thread doing the socket operations
+	SocketTable mSockets;
+	SocketTable mLocalSockets; /**< Both ends of the local connections. */
+	std::vector<TCPSocketPtr> mSharedMemorySockets; /**< Sockets with a shared memory channel. */
+	SocketPollerPtr mPoller;
+	SOCKET mFirstReadable; /**< Descriptor of the readable socket handled first last time. */
+
+	// Scratch of HandleSocketOperations, kept from one call to the next
+	// so that frames do not allocate. It holds plain pointers, the
+	// sockets are owned by mSockets for the whole call.
+	std::vector<TCPSocket*> mReadableSockets;
+	std::vector<TCPSocket*> mWritableSockets;
+
+	// Owned by the main thread
+	std::map<SocketAddress, TCPSocketPtr> mConnections; /**< Connection pool keyed by remote address. */
+	std::vector<TCPSocketPtr> mListenSockets;         /**< Listen sockets added. */
+	SocketTable mDelegateSockets; /**< The ones the delegate can refer to, for GetSocket. */
+
+	bool mSharedMemoryEnabled;
+	std::unique_ptr<NetworkThread> mThread;
+
+	// Shared by all the sockets
+	SocketHandleAllocator mHandles;
+	OutgoingBudgetPtr mOutgoingBudget;
+	ConnectionStatsPtr mStats;
+
+	std::atomic<uint32_t> mReadBudget;
+	std::atomic<uint32_t> mAcceptBudget;
+	std::atomic<bool> mSendImmediately;
+
+	std::atomic<int> mSocketCount;
+	std::atomic<int> mLocalSocketCount;
+	std::atomic<int> mSharedMemorySocketCount;
+	std::atomic<int> mBackingUpSocketCount;
 };
 
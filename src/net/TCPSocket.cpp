@@ -4,6 +4,7 @@
 TCPSocket::~TCPSocket()
 {
 	CloseSocket();
+	ClearOutgoingPackets();
 }
 
 int TCPSocket::Bind(const SocketAddress &inBindAddress)
@@ -14,6 +15,7 @@ int TCPSocket::Bind(const SocketAddress &inBindAddress)
 		SocketUtil::ReportError("TCPSocket::Bind");
 		return SocketUtil::GetLastError();
 	}
+	mLocalAddress = inBindAddress;
 	return NO_ERROR;
 }
 
@@ -32,17 +34,34 @@ int TCPSocket::Listen(int inBackLog)
 TCPSocketPtr TCPSocket::Accept(SocketAddress &inFromAddress)
 {
 	int length = inFromAddress.GetSize();
-	SOCKET newSocket = accept(mSocket, &inFromAddress.mSockAddr, &length);
+	SOCKET newSocket;
+	if (mPoller != nullptr && mPoller->DoesIO())
+	{
+		// Accepted already by the backend, without the peer address
+		newSocket = mPoller->TakeAcceptedSocket(*this);
+		if (newSocket == INVALID_SOCKET) {
+			return nullptr;
+		}
+		getpeername(newSocket, &inFromAddress.mSockAddr, &length);
+	}
+	else
+	{
+		newSocket = accept(mSocket, &inFromAddress.mSockAddr, &length);
+	}
 
 	if (newSocket != INVALID_SOCKET)
 	{
 		TCPSocketPtr socketPtr(new TCPSocket(newSocket));
 		socketPtr->mRemoteAddress = inFromAddress;
+		socketPtr->SetBufferLimits(mIncomingData.GetCapacity(), mHighWaterMark);
 		return socketPtr;
 	}
 	else
 	{
-		SocketUtil::ReportError("TCPSocket::Accept");
+		// No pending connections left on a non-blocking listen socket
+		if (SocketUtil::GetLastError() != WSAEWOULDBLOCK) {
+			SocketUtil::ReportError("TCPSocket::Accept");
+		}
 		return nullptr;
 	}
 }
@@ -52,16 +71,61 @@ int TCPSocket::Connect(const SocketAddress &inAddress)
 	int err = connect(mSocket, &inAddress.mSockAddr, inAddress.GetSize());
 	if (err < 0)
 	{
-		SocketUtil::ReportError("TCPSocket::Connect");
-		return -SocketUtil::GetLastError();
+		auto lastError = SocketUtil::GetLastError();
+		if (lastError != WSAEWOULDBLOCK && lastError != WSAEINPROGRESS) {
+			SocketUtil::ReportError("TCPSocket::Connect");
+			return -lastError;
+		}
+
+		// Non-blocking connect in progress
+		mFlags |= FlagConnecting;
+		mConnectTime = std::chrono::steady_clock::now();
+		UpdateWriteInterest();
 	}
 	mRemoteAddress = inAddress;
 	return NO_ERROR;
 }
 
+int TCPSocket::FinishConnect()
+{
+	int error = 0;
+	socklen_t length = sizeof(error);
+	if (getsockopt(mSocket, SOL_SOCKET, SO_ERROR, (char*)&error, &length) != 0)
+	{
+		error = SocketUtil::GetLastError();
+	}
+
+	mFlags &= ~FlagConnecting;
+	if (error != 0)
+	{
+		SocketUtil::ReportError("TCPSocket::FinishConnect");
+		mFlags |= FlagDisconnected | FlagConnectFailed;
+		return -error;
+	}
+
+	if (mFlags & FlagOfferSharedMemory) {
+		OfferSharedMemory();
+	}
+
+	UpdateWriteInterest();
+	return NO_ERROR;
+}
+
+bool TCPSocket::ConnectTimedOut() const
+{
+	// Checked for every socket on every call, so the clock is only read
+	// for the ones connecting
+	if (!IsConnecting()) {
+		return false;
+	}
+	const auto elapsed = std::chrono::steady_clock::now() - mConnectTime;
+	return elapsed > std::chrono::milliseconds(CONNECT_TIMEOUT_MILLIS);
+}
+
 int TCPSocket::Send(const void *inData, int inLen)
 {
-	int bytesSentCount = send(mSocket, static_cast<const char*>(inData), inLen, 0);
+	int bytesSentCount = send(mSocket, static_cast<const char*>(inData), inLen, SEND_FLAGS);
+	CountSend(static_cast<uint32_t>(inLen), bytesSentCount);
 	if (bytesSentCount < 0)
 	{
 		auto lastError = SocketUtil::GetLastError();
@@ -77,6 +141,7 @@ int TCPSocket::Send(const void *inData, int inLen)
 int TCPSocket::Receive(void *inBuffer, int inLen)
 {
 	int bytesReceivedCount = recv(mSocket, static_cast<char*>(inBuffer), inLen, 0);
+	CountReceive(bytesReceivedCount);
 	if (bytesReceivedCount < 0)
 	{
 		auto lastError = SocketUtil::GetLastError();
@@ -93,6 +158,85 @@ int TCPSocket::Receive(void *inBuffer, int inLen)
 	return bytesReceivedCount;
 }
 
+int TCPSocket::SendV(const RingBufferRegion *inRegions, int inRegionCount)
+{
+	assert(inRegionCount <= MAX_SEND_REGIONS);
+#if _WIN32
+	WSABUF buffers[MAX_SEND_REGIONS];
+	for (int i = 0; i < inRegionCount; ++i) {
+		buffers[i].buf = inRegions[i].data;
+		buffers[i].len = inRegions[i].size;
+	}
+	DWORD bytesSent = 0;
+	int result = WSASend(mSocket, buffers, inRegionCount, &bytesSent, 0, NULL, NULL);
+	int bytesSentCount = (result == 0) ? (int)bytesSent : -1;
+#else
+	iovec buffers[MAX_SEND_REGIONS];
+	for (int i = 0; i < inRegionCount; ++i) {
+		buffers[i].iov_base = inRegions[i].data;
+		buffers[i].iov_len = inRegions[i].size;
+	}
+	msghdr message = {};
+	message.msg_iov = buffers;
+	message.msg_iovlen = inRegionCount;
+	int bytesSentCount = (int)sendmsg(mSocket, &message, SEND_FLAGS);
+#endif
+	uint32_t bytesRequested = 0;
+	for (int i = 0; i < inRegionCount; ++i) {
+		bytesRequested += inRegions[i].size;
+	}
+	CountSend(bytesRequested, bytesSentCount);
+	if (bytesSentCount < 0)
+	{
+		auto lastError = SocketUtil::GetLastError();
+		if (lastError != WSAEWOULDBLOCK && lastError != WSAEINPROGRESS) {
+			SocketUtil::ReportError("TCPSocket::SendV");
+			mFlags |= FlagDisconnected;
+		}
+		return -lastError;
+	}
+	return bytesSentCount;
+}
+
+int TCPSocket::ReceiveV(const RingBufferRegion *inRegions, int inRegionCount)
+{
+#if _WIN32
+	WSABUF buffers[2];
+	for (int i = 0; i < inRegionCount; ++i) {
+		buffers[i].buf = inRegions[i].data;
+		buffers[i].len = inRegions[i].size;
+	}
+	DWORD bytesReceived = 0;
+	DWORD flags = 0;
+	int result = WSARecv(mSocket, buffers, inRegionCount, &bytesReceived, &flags, NULL, NULL);
+	int bytesReceivedCount = (result == 0) ? (int)bytesReceived : -1;
+#else
+	iovec buffers[2];
+	for (int i = 0; i < inRegionCount; ++i) {
+		buffers[i].iov_base = inRegions[i].data;
+		buffers[i].iov_len = inRegions[i].size;
+	}
+	int bytesReceivedCount = (mPoller != nullptr && mPoller->DoesIO())
+		? mPoller->Receive(*this, inRegions, inRegionCount)
+		: (int)readv(mSocket, buffers, inRegionCount);
+#endif
+	CountReceive(bytesReceivedCount);
+	if (bytesReceivedCount < 0)
+	{
+		auto lastError = SocketUtil::GetLastError();
+		if (lastError != WSAEWOULDBLOCK && lastError != WSAEINPROGRESS) {
+			SocketUtil::ReportError("TCPSocket::ReceiveV");
+			mFlags |= FlagDisconnected;
+		}
+		return -lastError;
+	}
+	if (bytesReceivedCount == 0)
+	{
+		mFlags |= FlagDisconnected;
+	}
+	return bytesReceivedCount;
+}
+
 void TCPSocket::Disconnect()
 {
 	mFlags |= FlagToDisconnect;
@@ -131,110 +275,785 @@ int TCPSocket::SetReuseAddress(bool inShouldReuseAddress)
 	return NO_ERROR;
 }
 
-void TCPSocket::SendPacket(const void *data, size_t size)
+void TCPSocket::SetBufferLimits(uint32_t inCapacity, uint32_t inHighWaterMark)
+{
+	mOutgoingCapacity = inCapacity;
+	mIncomingData.SetCapacity(inCapacity);
+	mHighWaterMark = inHighWaterMark;
+}
+
+bool TCPSocket::SendPacket(const void *data, size_t size, PacketPriority priority)
+{
+	bool sent = false;
+	const uint32_t packetSize = static_cast<uint32_t>(size);
+	if (size > MAX_PACKET_SIZE) {
+		sent = false;
+	} else if (mThread == nullptr && IsLocal()) {
+		sent = DeliverLocally(data, packetSize, priority);
+	} else if (mThread == nullptr && FitsSharedMemory(packetSize)) {
+		sent = WriteSharedMemory(data, packetSize);
+	} else {
+		PooledBuffer packetData(packetSize);
+		std::memcpy(packetData.Get(), data, packetSize);
+		sent = SendBuffer(std::move(packetData), packetSize, priority);
+	}
+
+	if (!sent) {
+		CountPacketDropped();
+	}
+	return sent;
+}
+
+bool TCPSocket::SendPacket(OutputMemoryStream &&stream, PacketPriority priority)
 {
-	// Resize outgoing data buffer
-	if (mOutgoingData.size() - mOutgoingDataHead < size + sizeof(uint32_t)) {
-		mOutgoingData.resize(mOutgoingData.size() + size + sizeof(uint32_t));
+	bool sent = false;
+	const uint32_t packetSize = stream.GetSize();
+	if (packetSize > MAX_PACKET_SIZE) {
+		sent = false;
+	} else if (mThread == nullptr && IsLocal()) {
+		sent = DeliverLocally(stream.GetBufferPtr(), packetSize, priority);
+	} else if (mThread == nullptr && FitsSharedMemory(packetSize)) {
+		sent = WriteSharedMemory(stream.GetBufferPtr(), packetSize);
+	} else {
+		sent = SendBuffer(stream.ReleaseBuffer(), packetSize, priority);
 	}
+	stream.Clear();
 
-	// Copy data size
-	*(uint32_t*)(&mOutgoingData[mOutgoingDataHead]) = static_cast<uint32_t>(size);
-	mOutgoingDataHead += sizeof(uint32_t);
+	if (!sent) {
+		CountPacketDropped();
+	}
+	return sent;
+}
 
-	// Copy data
-	memcpy((void*)&mOutgoingData[mOutgoingDataHead], data, size);
-	mOutgoingDataHead += size;
+bool TCPSocket::SendBuffer(PooledBuffer &&inData, uint32_t inSize, PacketPriority inPriority)
+{
+	if (mThread != nullptr)
+	{
+		// Early check in this thread, the network thread checks again
+		if (!IsSharedMemory() && !CanQueue(sizeof(inSize) + inSize)) {
+			return false;
+		}
+		return mThread->PostSend(shared_from_this(), std::move(inData), inSize, inPriority);
+	}
+	return QueuePacket(std::move(inData), inSize, inPriority);
 }
 
-bool TCPSocket::ReceivePacket(void *data, size_t size)
+bool TCPSocket::QueuePacket(PooledBuffer &&inData, uint32_t inSize, PacketPriority inPriority)
 {
-	bool read = false;
-	uint32_t writeHead = 0;
+	if (IsLocal()) {
+		return DeliverLocally(inData.Get(), inSize, inPriority);
+	}
 
-	if (mIncomingDataRecvHead - mIncomingDataHead > sizeof(uint32_t))
+	if (FitsSharedMemory(inSize)) {
+		return WriteSharedMemory(inData.Get(), inSize);
+	}
+
+	// Packets of shared memory sockets left for TCP are announced by a
+	// control frame, and an empty packet marks their place in the channel
+	const bool placed = IsSharedMemory() && inSize > 0;
+	const uint32_t markerSize = placed ? sizeof(CONTROL_FRAME_PLACED_PACKET) : 0;
+
+	const uint32_t queuedSize = markerSize + sizeof(inSize) + inSize;
+	if (!CanQueue(queuedSize)) {
+		return false;
+	}
+
+	if (placed && !mSharedMemory->WritePacket(&inSize, 0)) {
+		return false;
+	}
+
+	const bool hadOutgoingData = HasOutgoingData();
+
+	const PacketPriority priority = IsSharedMemory() ? PacketPriority::Normal : inPriority;
+	if (placed) {
+		PushOutgoingPacket(priority, OutgoingPacket{ CONTROL_FRAME_PLACED_PACKET, 0, PooledBuffer() });
+	}
+	PushOutgoingPacket(priority, OutgoingPacket{ inSize, inSize, std::move(inData) });
+	AddOutgoingBytes(queuedSize);
+	CountPacketSent();
+
+	if (!hadOutgoingData)
 	{
-		const uint32_t packetSize = *(uint32_t*)&mIncomingData[mIncomingDataHead];
-		const uint32_t availableSpaceInStream = (uint32_t)size - writeHead;
-		if (mIncomingDataRecvHead - (mIncomingDataHead + sizeof(uint32_t)) >= packetSize &&
-			packetSize <= availableSpaceInStream)
-		{
-			memcpy(
-				(void*)((char*)data + writeHead),
-				(const void*)&mIncomingData[mIncomingDataHead + sizeof(uint32_t)],
-				packetSize);
-			writeHead += packetSize;
-			mIncomingDataHead += packetSize + sizeof(uint32_t);
-			read = true;
+		SendFirstPacket();
+	}
+	return true;
+}
+
+bool TCPSocket::DeliverLocally(const void *inData, uint32_t inSize, PacketPriority inPriority)
+{
+	TCPSocketPtr peer = mPeer.lock();
+	if (peer == nullptr || peer->IsDisconnected()) {
+		return false;
+	}
+
+	// Straight into the peer, unless packets are waiting for room there
+	if (!HasOutgoingData() && peer->ReceiveLocally(inData, inSize))
+	{
+		CountPacketSent();
+		return true;
+	}
+
+	// Otherwise it waits in the outgoing lanes, and counts against the
+	// budget, as the packets of any other socket
+	const uint32_t queuedSize = sizeof(inSize) + inSize;
+	if (!CanQueue(queuedSize)) {
+		return false;
+	}
+
+	PooledBuffer packetData(inSize);
+	std::memcpy(packetData.Get(), inData, inSize);
+	PushOutgoingPacket(inPriority, OutgoingPacket{ inSize, inSize, std::move(packetData) });
+	AddOutgoingBytes(queuedSize);
+	CountPacketSent();
+	return true;
+}
+
+bool TCPSocket::ReceiveLocally(const void *inData, uint32_t inSize)
+{
+	if (sizeof(inSize) + inSize > mIncomingData.GetCapacity()) {
+		return DeliverLargePacketLocally(inData, inSize);
+	}
+
+	if (mIncomingData.GetFreeSpace() < sizeof(inSize) + inSize) {
+		return false;
+	}
+
+	// Same framing as the stream received from a remote peer
+	mIncomingData.Write(&inSize, sizeof(inSize));
+	mIncomingData.Write(inData, inSize);
+	return true;
+}
+
+bool TCPSocket::HandleLocalOutgoingData()
+{
+	TCPSocketPtr peer = mPeer.lock();
+	if (peer == nullptr || peer->IsDisconnected()) {
+		return false;
+	}
+
+	// By priority, as long as the peer has room for them
+	bool delivered = false;
+	int lane;
+	while ((lane = SendingLane()) >= 0)
+	{
+		OutgoingPacket &packet = mOutgoingPackets[lane].front();
+		if (!peer->ReceiveLocally(packet.data.Get(), packet.size)) {
+			break;
+		}
+		RemoveOutgoingBytes(sizeof(packet.prefix) + packet.size);
+		PopOutgoingPacket(lane);
+		delivered = true;
+	}
+	return delivered;
+}
+
+bool TCPSocket::IsPeerClosed() const
+{
+	TCPSocketPtr peer = mPeer.lock();
+	return peer == nullptr || peer->IsDisconnected() || peer->ToDisconnect();
+}
+
+bool TCPSocket::StartLargePacket(uint32_t inSize, bool inPlaced)
+{
+	if (inSize > MAX_PACKET_SIZE)
+	{
+		// Corrupt stream, nothing else is read from it
+		mIncomingData.Consume(mIncomingData.GetSize());
+		Disconnect();
+		return false;
+	}
+
+	mLargePacket = PooledBuffer(inSize);
+	mLargePacketSize = inSize;
+	mLargePacketReceived = 0;
+	mLargePacketOffset = 0;
+	mLargePacketPlaced = inPlaced;
+	return true;
+}
+
+bool TCPSocket::AssembleLargePacket()
+{
+	// Move whatever part of it is in the receive buffer
+	const uint32_t missingBytes = mLargePacketSize - mLargePacketReceived;
+	const uint32_t availableBytes = std::min(missingBytes, mIncomingData.GetSize());
+	if (availableBytes > 0)
+	{
+		mIncomingData.Read(mLargePacket.Get() + mLargePacketReceived, availableBytes);
+		mLargePacketReceived += availableBytes;
+	}
+	return mLargePacketReceived == mLargePacketSize;
+}
+
+bool TCPSocket::DeliverLargePacketLocally(const void *inData, uint32_t inSize)
+{
+	// Only one at a time, it goes after the packets already received
+	if (mLargePacketSize > 0 || !StartLargePacket(inSize, false)) {
+		return false;
+	}
+
+	std::memcpy(mLargePacket.Get(), inData, inSize);
+	mLargePacketReceived = inSize;
+	mLargePacketOffset = mIncomingData.GetSize();
+	return true;
+}
+
+void TCPSocket::PeekLargePacket(const char *&outData, uint32_t &outSize)
+{
+	outData = mLargePacket.Get();
+	outSize = mLargePacketSize;
+	mPeekedFrom = PeekedLargePacket;
+}
+
+bool TCPSocket::OfferSharedMemory()
+{
+	SharedMemoryChannelPtr channel = SharedMemoryChannel::Create(mOutgoingCapacity);
+	if (channel == nullptr) {
+		return false;
+	}
+
+	// Name of the segment, preceded by its length
+	const std::string &name(channel->GetName());
+	const uint32_t nameLength = static_cast<uint32_t>(name.size());
+	std::vector<char> offer(sizeof(nameLength) + nameLength);
+	std::memcpy(offer.data(), &nameLength, sizeof(nameLength));
+	std::memcpy(offer.data() + sizeof(nameLength), name.data(), nameLength);
+
+	// Packets queued while connecting are still sent through TCP, before
+	// the offer. The next ones are all written to the channel.
+	if (!QueueControlFrame(CONTROL_FRAME_SHARED_MEMORY, offer.data(), static_cast<uint32_t>(offer.size()))) {
+		return false;
+	}
+
+	mSharedMemory = std::move(channel);
+	mFlags |= FlagSharedMemory;
+	return true;
+}
+
+bool TCPSocket::HandleControlFrame(uint32_t inMarker)
+{
+	if (inMarker == CONTROL_FRAME_DOORBELL)
+	{
+		// Nothing else to do, the channel is read right after
+		mIncomingData.Consume(sizeof(inMarker));
+		return true;
+	}
+
+	if (inMarker == CONTROL_FRAME_PLACED_PACKET)
+	{
+		// Wait for the length of the packet, which is assembled apart
+		uint32_t packetSize;
+		if (mLargePacketSize > 0 || !mIncomingData.Peek(&packetSize, sizeof(packetSize), sizeof(inMarker))) {
+			return false;
+		}
+		mIncomingData.Consume(sizeof(inMarker) + sizeof(packetSize));
+		StartLargePacket(packetSize, true);
+		return false;
+	}
+
+	// Wait for the complete offer
+	uint32_t nameLength;
+	if (!mIncomingData.Peek(&nameLength, sizeof(nameLength), sizeof(inMarker)) ||
+		mIncomingData.GetSize() - sizeof(inMarker) - sizeof(nameLength) < nameLength)
+	{
+		return false;
+	}
+
+	std::string name(nameLength, '\0');
+	mIncomingData.Peek(&name[0], nameLength, sizeof(inMarker) + sizeof(nameLength));
+	mIncomingData.Consume(sizeof(inMarker) + sizeof(nameLength) + nameLength);
+
+	// Both processes have it mapped now, the name is not needed anymore
+	mSharedMemory = SharedMemoryChannel::Open(name);
+	if (mSharedMemory == nullptr)
+	{
+		// The peer writes its packets to the channel, so give up
+		Disconnect();
+		return true;
+	}
+	mSharedMemory->Unlink();
+	mFlags |= FlagSharedMemory;
+	return true;
+}
+
+bool TCPSocket::QueueControlFrame(uint32_t inMarker, const void *inData, uint32_t inSize)
+{
+	const uint32_t queuedSize = sizeof(inMarker) + inSize;
+	if (mOutgoingBytes + queuedSize > mOutgoingCapacity) {
+		return false;
+	}
+
+	PooledBuffer data;
+	if (inSize > 0) {
+		data = PooledBuffer(inSize);
+		std::memcpy(data.Get(), inData, inSize);
+	}
+
+	const bool hadOutgoingData = HasOutgoingData();
+
+	PushOutgoingPacket(PacketPriority::Normal, OutgoingPacket{ inMarker, inSize, std::move(data) });
+	AddOutgoingBytes(queuedSize);
+
+	if (!hadOutgoingData)
+	{
+		SendFirstPacket();
+	}
+	return true;
+}
+
+bool TCPSocket::FitsSharedMemory(uint32_t inSize) const
+{
+	// Packets bigger than the rings go through the TCP connection, and
+	// so do empty ones, which mark the place of those in the channel
+	return IsSharedMemory() && inSize > 0 && inSize <= mSharedMemory->GetMaxPacketSize();
+}
+
+bool TCPSocket::PeekSharedMemoryPacket(const char *&outData, uint32_t &outSize)
+{
+	if (mSharedMemory == nullptr || !mSharedMemory->PeekPacket(outData, outSize)) {
+		return false;
+	}
+
+	if (outSize == 0)
+	{
+		// Place of a packet sent through TCP, wait for it to be complete
+		if (mLargePacketSize == 0 || !mLargePacketPlaced || !AssembleLargePacket()) {
+			return false;
 		}
+		mSharedMemory->ConsumePacket(0);
+		PeekLargePacket(outData, outSize);
+		return true;
 	}
 
-	if (!read)
+	mPeekedFrom = PeekedSharedMemory;
+	return true;
+}
+
+bool TCPSocket::WriteSharedMemory(const void *inData, uint32_t inSize)
+{
+	if (!mSharedMemory->WritePacket(inData, inSize)) {
+		return false;
+	}
+	CountPacketSent();
+
+	// Wake the peer up if it is blocked waiting for its sockets
+	if (mSharedMemory->TakeConsumerWaiting()) {
+		QueueControlFrame(CONTROL_FRAME_DOORBELL, nullptr, 0);
+	}
+	return true;
+}
+
+void TCPSocket::ClearOutgoingPackets()
+{
+	// The packets of a send in progress must outlive it
+	assert((mFlags & FlagSending) == 0);
+	for (int lane = 0; lane < PACKET_PRIORITY_COUNT; ++lane)
+	{
+		mOutgoingPackets[lane].clear();
+		mOutgoingPacketCounts[lane] = 0;
+	}
+	RemoveOutgoingBytes(mOutgoingBytes);
+	mFrontPacketOffset = 0;
+}
+
+void TCPSocket::PushOutgoingPacket(PacketPriority inPriority, OutgoingPacket &&inPacket)
+{
+	const int lane = static_cast<int>(inPriority);
+	mOutgoingPackets[lane].push_back(std::move(inPacket));
+	mOutgoingPacketCounts[lane]++;
+}
+
+void TCPSocket::PopOutgoingPacket(int inLane)
+{
+	mOutgoingPackets[inLane].pop_front();
+	mOutgoingPacketCounts[inLane]--;
+}
+
+int TCPSocket::SendingLane() const
+{
+	if (mFrontPacketOffset > 0) {
+		return mFrontPacketLane;
+	}
+	for (int lane = 0; lane < PACKET_PRIORITY_COUNT; ++lane)
 	{
-		// Move heads to the beginning
-		if (mIncomingDataHead >= mIncomingDataRecvHead) {
-			mIncomingDataHead = 0;
-			mIncomingDataRecvHead = 0;
+		if (!mOutgoingPackets[lane].empty()) {
+			return lane;
 		}
-		else {
-			size_t remainingBytes = mIncomingDataRecvHead - mIncomingDataHead;
-			memmove((void*)&mIncomingData[0], (const void*)&mIncomingData[mIncomingDataHead], remainingBytes);
-			mIncomingDataHead = 0;
-			mIncomingDataRecvHead = remainingBytes;
+	}
+	return -1;
+}
+
+bool TCPSocket::CanQueue(uint32_t inQueuedSize) const
+{
+	// An empty buffer takes any packet, so that packets bigger than the
+	// limits can be sent, and so that no peer starves when the budget
+	// of the network manager is exhausted
+	if (mOutgoingBytes == 0) {
+		return true;
+	}
+	return mOutgoingBytes + inQueuedSize <= mOutgoingCapacity &&
+		(mBudget == nullptr || mBudget->Fits(inQueuedSize));
+}
+
+void TCPSocket::AddOutgoingBytes(uint32_t inByteCount)
+{
+	mOutgoingBytes += inByteCount;
+	if (mBudget != nullptr) {
+		mBudget->Add(inByteCount);
+	}
+}
+
+void TCPSocket::RemoveOutgoingBytes(uint32_t inByteCount)
+{
+	mOutgoingBytes -= inByteCount;
+	if (mBudget != nullptr) {
+		mBudget->Remove(inByteCount);
+	}
+}
+
+bool TCPSocket::IsBackingUp() const
+{
+	const uint32_t outgoingBytes = mOutgoingBytes;
+	return outgoingBytes > mHighWaterMark ||
+		(outgoingBytes > 0 && mBudget != nullptr && mBudget->IsExhausted());
+}
+
+uint64_t TCPSocket::GetLifetimeMillis() const
+{
+	const auto lifetime = std::chrono::steady_clock::now() - mCreationTime;
+	return std::chrono::duration_cast<std::chrono::milliseconds>(lifetime).count();
+}
+
+void TCPSocket::CountSend(uint32_t inRequested, int inResult)
+{
+	mStats.CountSend(inRequested, inResult);
+	if (mManagerStats != nullptr) {
+		mManagerStats->CountSend(inRequested, inResult);
+	}
+}
+
+void TCPSocket::CountReceive(int inResult)
+{
+	mStats.CountReceive(inResult);
+	if (mManagerStats != nullptr) {
+		mManagerStats->CountReceive(inResult);
+	}
+}
+
+void TCPSocket::CountPacketSent()
+{
+	mStats.CountPacketSent();
+	if (mManagerStats != nullptr) {
+		mManagerStats->CountPacketSent();
+	}
+}
+
+void TCPSocket::CountPacketDropped()
+{
+	mStats.CountPacketDropped();
+	if (mManagerStats != nullptr) {
+		mManagerStats->CountPacketDropped();
+	}
+}
+
+void TCPSocket::CountPacketReceived()
+{
+	mStats.CountPacketReceived();
+	if (mManagerStats != nullptr) {
+		mManagerStats->CountPacketReceived();
+	}
+}
+
+bool TCPSocket::PeekPacket(const char *&outData, uint32_t &outSize)
+{
+	// The packet assembled apart goes once the packets received before
+	// it are consumed
+	if (mLargePacketSize > 0 && mLargePacketOffset == 0)
+	{
+		if (AssembleLargePacket() && !mLargePacketPlaced)
+		{
+			PeekLargePacket(outData, outSize);
+			return true;
 		}
+
+		// Then the packets received through shared memory, if any
+		return PeekSharedMemoryPacket(outData, outSize);
+	}
+
+	// Control frames are handled here, they never reach the caller
+	uint32_t packetSize;
+	while (mIncomingData.Peek(&packetSize, sizeof(packetSize)) &&
+		packetSize >= FIRST_CONTROL_FRAME &&
+		HandleControlFrame(packetSize))
+	{
+	}
+
+	// A packet which can never fit in the receive buffer is assembled
+	// apart, as the placed packets (started by HandleControlFrame)
+	if (mLargePacketSize == 0 &&
+		mIncomingData.Peek(&packetSize, sizeof(packetSize)) &&
+		packetSize < FIRST_CONTROL_FRAME &&
+		sizeof(packetSize) + packetSize > mIncomingData.GetCapacity())
+	{
+		mIncomingData.Consume(sizeof(packetSize));
+		StartLargePacket(packetSize, false);
+	}
+	if (mLargePacketSize > 0 && mLargePacketOffset == 0) {
+		return PeekPacket(outData, outSize);
 	}
 
-	return read;
+	// Do we have a complete packet?
+	if (!mIncomingData.Peek(&packetSize, sizeof(packetSize)) ||
+		packetSize >= FIRST_CONTROL_FRAME ||
+		mIncomingData.GetSize() - sizeof(packetSize) < packetSize)
+	{
+		// Then the packets received through shared memory, if any
+		return PeekSharedMemoryPacket(outData, outSize);
+	}
+
+	const char *data = mIncomingData.GetContiguousData(sizeof(packetSize), packetSize);
+	if (data == nullptr)
+	{
+		// The packet straddles the end of the buffer, fall back to a copy
+		mPacketScratch.resize(packetSize);
+		mIncomingData.Peek(mPacketScratch.data(), packetSize, sizeof(packetSize));
+		data = mPacketScratch.data();
+	}
+
+	outData = data;
+	outSize = packetSize;
+	mPeekedFrom = PeekedIncomingData;
+	return true;
 }
 
-bool TCPSocket::HasOutgoingData() const
+void TCPSocket::ConsumePacket(uint32_t inPacketSize)
 {
-	return mOutgoingDataHead != mOutgoingDataSendHead;
+	CountPacketReceived();
+
+	switch (mPeekedFrom)
+	{
+	case PeekedSharedMemory:
+		mSharedMemory->ConsumePacket(inPacketSize);
+		break;
+	case PeekedLargePacket:
+		mLargePacket = PooledBuffer();
+		mLargePacketSize = 0;
+		break;
+	default:
+		mIncomingData.Consume(sizeof(uint32_t) + inPacketSize);
+		if (mLargePacketOffset > 0) {
+			mLargePacketOffset -= sizeof(uint32_t) + inPacketSize;
+		}
+	}
+}
+
+bool TCPSocket::GatherPacket(OutgoingPacket &inPacket, RingBufferRegion *outRegions, int &ioRegionCount, uint32_t &ioSkip)
+{
+	if (ioRegionCount + 2 > MAX_SEND_REGIONS) {
+		return false;
+	}
+
+	if (ioSkip < sizeof(inPacket.prefix)) {
+		outRegions[ioRegionCount++] = RingBufferRegion{
+			reinterpret_cast<char*>(&inPacket.prefix) + ioSkip,
+			static_cast<uint32_t>(sizeof(inPacket.prefix)) - ioSkip };
+		ioSkip = 0;
+	} else {
+		ioSkip -= sizeof(inPacket.prefix);
+	}
+
+	if (inPacket.size > ioSkip) {
+		outRegions[ioRegionCount++] = RingBufferRegion{ inPacket.data.Get() + ioSkip, inPacket.size - ioSkip };
+	}
+	ioSkip = 0;
+	return true;
 }
 
 void TCPSocket::HandleOutgoingData()
 {
-	const int sentBytes = Send((const void*)&mOutgoingData[mOutgoingDataSendHead], (int)(mOutgoingDataHead - mOutgoingDataSendHead));
-	if (sentBytes > 0)
+	// A completion backend is still sending the packets gathered last time
+	if (mFlags & FlagSending) {
+		return;
+	}
+
+	// Gather the length prefix and payload of as many queued packets
+	// as possible in the order they are sent: the packet being sent
+	// (skipping the part of it already sent), then the lanes by priority
+	RingBufferRegion regions[MAX_SEND_REGIONS];
+	int regionCount = 0;
+	uint32_t skip = mFrontPacketOffset;
+	const int frontLane = SendingLane();
+	if (frontLane >= 0)
+	{
+		GatherPacket(mOutgoingPackets[frontLane].front(), regions, regionCount, skip);
+		mGatheredPackets[frontLane]++;
+		for (int lane = 0; lane < PACKET_PRIORITY_COUNT; ++lane)
+		{
+			auto it = mOutgoingPackets[lane].begin();
+			if (lane == frontLane) {
+				++it;
+			}
+			while (it != mOutgoingPackets[lane].end() && GatherPacket(*it, regions, regionCount, skip)) {
+				mGatheredPackets[lane]++;
+				++it;
+			}
+			if (it != mOutgoingPackets[lane].end()) {
+				break;
+			}
+		}
+	}
+
+	// Completion backends send in the background: the packets are
+	// released when they are done (see CompleteSend)
+	if (regionCount > 0 && mPoller != nullptr && mPoller->DoesIO())
+	{
+		mFlags |= FlagSending;
+		mPoller->Send(*this, regions, regionCount);
+		return;
+	}
+
+	const int sentBytes = (regionCount > 0) ? SendV(regions, regionCount) : 0;
+	if (sentBytes > 0) {
+		ReleaseSentBytes(static_cast<uint32_t>(sentBytes));
+	}
+	memset(mGatheredPackets, 0, sizeof(mGatheredPackets));
+
+	if (!HasOutgoingData()) {
+		UpdateWriteInterest();
+	}
+}
+
+void TCPSocket::ReleaseSentBytes(uint32_t inSentBytes)
+{
+	// Release the packets completely sent, in the order they were
+	// gathered. Packets queued since then are not part of the send, even
+	// in lanes that go before the ones gathered last.
+	uint32_t remaining = mFrontPacketOffset + inSentBytes;
+	int lane = (mFrontPacketOffset > 0) ? mFrontPacketLane : GatheredLane();
+	while (lane >= 0)
 	{
-		mOutgoingDataSendHead += sentBytes;
+		OutgoingPacket &packet = mOutgoingPackets[lane].front();
+		const uint32_t packetBytes = sizeof(packet.prefix) + packet.size;
+		if (remaining < packetBytes) {
+			break;
+		}
+		remaining -= packetBytes;
+		PopOutgoingPacket(lane);
+		mGatheredPackets[lane]--;
+		lane = GatheredLane();
+	}
+	mFrontPacketOffset = remaining;
+	mFrontPacketLane = lane;
+	RemoveOutgoingBytes(inSentBytes);
+}
 
-		// Move heads to the beginning
-		if (mOutgoingDataSendHead >= mOutgoingDataHead) {
-			mOutgoingDataHead = 0;
-			mOutgoingDataSendHead = 0;
-		} else {
-			size_t remainingBytes = mOutgoingDataHead - mOutgoingDataSendHead;
-			memmove((void*)&mOutgoingData[0], (const void*)&mOutgoingData[mOutgoingDataSendHead], remainingBytes);
-			mOutgoingDataHead = remainingBytes;
-			mOutgoingDataSendHead = 0;
+int TCPSocket::GatheredLane() const
+{
+	for (int lane = 0; lane < PACKET_PRIORITY_COUNT; ++lane)
+	{
+		if (mGatheredPackets[lane] > 0) {
+			return lane;
 		}
 	}
+	return -1;
 }
 
-void TCPSocket::HandleIncomingData()
+void TCPSocket::CompleteSend(uint32_t inRequested, int inResult)
 {
-	// Resize incoming data buffer
-	const size_t size = 1500 * 10;
-	if (mIncomingData.size() - mIncomingDataRecvHead < size) {
-		mIncomingData.resize(mIncomingData.size() + size);
+	mFlags &= ~FlagSending;
+
+	// Nothing was sent before the socket was unregistered: the packets
+	// are sent again once it is registered somewhere else
+	if (inResult == -ECANCELED)
+	{
+		memset(mGatheredPackets, 0, sizeof(mGatheredPackets));
+		return;
 	}
 
-	const int recvBytes = Receive((void*)&mIncomingData[mIncomingDataRecvHead], size);
-	if (recvBytes > 0) {
-		mIncomingDataRecvHead += recvBytes;
+	CountSend(inRequested, inResult);
+	if (inResult < 0)
+	{
+		errno = -inResult;
+		SocketUtil::ReportError("TCPSocket::CompleteSend");
+		mFlags |= FlagDisconnected;
+	}
+	else if (inResult > 0)
+	{
+		ReleaseSentBytes(static_cast<uint32_t>(inResult));
+	}
+	memset(mGatheredPackets, 0, sizeof(mGatheredPackets));
+
+	if (!HasOutgoingData()) {
+		UpdateWriteInterest();
+	}
+}
+
+uint32_t TCPSocket::HandleIncomingData(bool &outMayHaveMore)
+{
+	outMayHaveMore = false;
+
+	RingBufferRegion regions[2];
+	const int regionCount = mIncomingData.GetWriteRegions(regions);
+	if (regionCount == 0) {
+		return 0; // Full, wait for packets to be processed
+	}
+
+	uint32_t requestedBytes = 0;
+	for (int i = 0; i < regionCount; ++i) {
+		requestedBytes += regions[i].size;
+	}
+
+	const int recvBytes = ReceiveV(regions, regionCount);
+	if (recvBytes <= 0) {
+		return 0;
+	}
+
+	// A short read means the socket is drained
+	mIncomingData.Commit(recvBytes);
+	outMayHaveMore = static_cast<uint32_t>(recvBytes) == requestedBytes;
+	return static_cast<uint32_t>(recvBytes);
+}
+
+void TCPSocket::SendFirstPacket()
+{
+	// Its descriptor may be closed already (or reused by another socket)
+	if (IsDisconnected() || IsListening())
+	{
+		return;
+	}
+
+	// Nothing was waiting, so the socket is most likely writable:
+	// the packet leaves now instead of in the next call of the
+	// network manager, and write interest is only needed for the
+	// part that did not fit
+	if ((mFlags & FlagSendImmediately) && !IsConnecting())
+	{
+		HandleOutgoingData();
+	}
+	UpdateWriteInterest();
+}
+
+void TCPSocket::UpdateWriteInterest()
+{
+	const bool wantsToWrite = WantsToWrite();
+	const bool hasWriteInterest = (mFlags & FlagWriteInterest) != 0;
+	if (mPoller != nullptr && wantsToWrite != hasWriteInterest)
+	{
+		mPoller->SetWriteInterest(*this, wantsToWrite);
+		mFlags ^= FlagWriteInterest;
 	}
 }
 
 void TCPSocket::CloseSocket()
 {
-	if ((mFlags & FlagDisconnected) == 0)
+	// Sockets disconnected by an error still hold their descriptor
+	if ((mFlags & (FlagClosed | FlagLocal)) == 0 && mSocket != INVALID_SOCKET)
 	{
 #ifdef _WIN32
 		closesocket(mSocket);
 #else
 		close(mSocket);
 #endif
-		mFlags |= FlagDisconnected;
 	}
+	mFlags |= FlagDisconnected | FlagClosed;
+	mFlags &= ~FlagConnecting;
 }
\ No newline at end of file
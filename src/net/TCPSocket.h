@@ -2,10 +2,82 @@
 #define TCP_SOCKET_H
 
 class TCPSocket;
+class SocketPoller;
+class OutputMemoryStream;
+class NetworkThread;
 
 typedef std::shared_ptr<TCPSocket> TCPSocketPtr;
 
-class TCPSocket
+// Time a non-blocking connect can stay in progress before failing
+constexpr int CONNECT_TIMEOUT_MILLIS = 5000;
+
+// Default capacity of the incoming and outgoing buffers of each socket
+constexpr uint32_t DEFAULT_SOCKET_BUFFER_SIZE = 64 * 1024;
+
+// Maximum number of buffers gathered by a single vectored send
+// (each queued packet takes two: its length prefix and its payload)
+constexpr int MAX_SEND_REGIONS = 512;
+
+// Default amount of outgoing bytes above which the socket is backing up
+constexpr uint32_t DEFAULT_SOCKET_HIGH_WATER_MARK = 48 * 1024;
+
+// Largest packet accepted. Packets which do not fit in the receive
+// buffer are assembled apart, and a bigger length prefix is taken as a
+// corrupt stream (the connection is closed).
+constexpr uint32_t MAX_PACKET_SIZE = 16 * 1024 * 1024;
+
+// Length prefixes reserved for control frames (never valid packet sizes)
+// Offer of a shared memory channel, followed by the uint32_t length of
+// the segment name and the name itself
+constexpr uint32_t CONTROL_FRAME_SHARED_MEMORY = 0xFFFFFFFF;
+// Wake up call: there are packets in the shared memory channel
+constexpr uint32_t CONTROL_FRAME_DOORBELL = 0xFFFFFFFE;
+// Packet too big for the shared memory channel, followed by the packet
+// (length prefixed) and delivered where an empty packet is in the channel
+constexpr uint32_t CONTROL_FRAME_PLACED_PACKET = 0xFFFFFFFD;
+// Lowest control frame marker
+constexpr uint32_t FIRST_CONTROL_FRAME = CONTROL_FRAME_PLACED_PACKET;
+static_assert(MAX_PACKET_SIZE < FIRST_CONTROL_FRAME, "Packet sizes overlap control frame markers");
+
+// Outgoing lanes of a socket. High priority packets (small control
+// packets) are sent ahead of the normal ones queued before them (bulk
+// replies), at packet boundaries. Sockets switched to shared memory
+// keep a single lane, so that the packets they leave for TCP stay in
+// the order of their places in the channel.
+enum class PacketPriority {
+	High,
+	Normal
+};
+constexpr int PACKET_PRIORITY_COUNT = 2;
+
+// Outgoing bytes queued by all the sockets of a network manager, and
+// the limit above which they stop queuing packets (and being read).
+// Safe to read from any thread.
+class OutgoingBudget
+{
+public:
+
+	explicit OutgoingBudget(uint64_t inLimit) : mLimit(inLimit), mUsed(0) { }
+
+	void SetLimit(uint64_t inLimit) { mLimit = inLimit; }
+	uint64_t GetLimit() const { return mLimit; }
+	uint64_t GetUsed() const { return mUsed; }
+
+	bool Fits(uint32_t inByteCount) const { return mUsed + inByteCount <= mLimit; }
+	bool IsExhausted() const { return mUsed >= mLimit; }
+
+	void Add(uint32_t inByteCount) { mUsed += inByteCount; }
+	void Remove(uint32_t inByteCount) { mUsed -= inByteCount; }
+
+private:
+
+	std::atomic<uint64_t> mLimit;
+	std::atomic<uint64_t> mUsed;
+};
+
+typedef std::shared_ptr<OutgoingBudget> OutgoingBudgetPtr;
+
+class TCPSocket : public std::enable_shared_from_this<TCPSocket>
 {
 public:
 
@@ -14,64 +86,267 @@ public:
 	int Bind(const SocketAddress &inToAddress);
 	int Listen(int inBackLog = 32);
 	TCPSocketPtr Accept(SocketAddress &inFromAddress);
+	// In non-blocking mode, it returns immediately and the socket stays
+	// in the connecting state until the network manager detects its
+	// completion (packets sent meanwhile are queued)
 	int Connect(const SocketAddress &inAddress);
 	int Send(const void *inData, int inLen);
 	int Receive(void *inBuffer, int inLen);
+	int SendV(const RingBufferRegion *inRegions, int inRegionCount);
+	int ReceiveV(const RingBufferRegion *inRegions, int inRegionCount);
 	void Disconnect();
 
 	int SetNonBlockingMode(bool inShouldBeNonBlocking);
 	int SetReuseAddress(bool inShouldReuseAddress);
 
+	// Capacity of the receive ring buffer and maximum amount of queued
+	// outgoing bytes, and the outgoing high-water mark.
+	// It only has effect before any data is sent or received.
+	// Accepted sockets inherit the limits of their listen socket.
+	void SetBufferLimits(uint32_t inCapacity, uint32_t inHighWaterMark);
+
 	bool IsListening() const { return mFlags & FlagListening; }
 	bool ToDisconnect() const { return mFlags & FlagToDisconnect; }
 	bool IsDisconnected() const { return mFlags & FlagDisconnected; }
+	bool IsConnecting() const { return mFlags & FlagConnecting; }
+	bool ConnectFailed() const { return mFlags & FlagConnectFailed; }
+	bool IsLocal() const { return mFlags & FlagLocal; }
+	bool IsSharedMemory() const { return mFlags & FlagSharedMemory; }
 	const SocketAddress &RemoteAddress() { return mRemoteAddress; }
+	const SocketAddress &LocalAddress() const { return mLocalAddress; }
+
+	// Given by the network manager when the socket is added to it (or
+	// accepted), invalid until then (see TCPNetworkManager::GetSocket)
+	SocketHandle GetHandle() const { return mHandle; }
 
 	// Use these methods instead of Send / Receive in conjunction with
 	// non-blocking methods (e.g. select)
-	void SendPacket(const void *data, size_t size);
-	bool ReceivePacket(void *data, size_t size);
+	// SendPacket returns false if the packet does not fit in the
+	// outgoing buffer or in the budget of the network manager (the
+	// packet is discarded then). An empty buffer takes any packet, even
+	// one bigger than the whole buffer. If the socket is run by a
+	// network thread, the packet is handed over to the thread: the
+	// check is done against the bytes the thread has queued so far, and
+	// it also fails if the queue to that thread is full.
+	// A packet queued while nothing else is waiting to be sent is sent
+	// right away if the socket can take it (see
+	// TCPNetworkManager::SetSendImmediately), the rest are sent by the
+	// network manager once the socket is writable.
+	bool SendPacket(const void *data, size_t size, PacketPriority priority = PacketPriority::Normal);
+	// Same as above, but the stream buffer is queued as is instead of
+	// being copied. The stream is left empty in any case.
+	bool SendPacket(OutputMemoryStream &&stream, PacketPriority priority = PacketPriority::Normal);
+
+	// It points to the next complete packet inside the receive buffer
+	// (or inside a scratch copy if the packet is split by the end of the
+	// ring buffer, or inside the buffer where packets bigger than the
+	// ring buffer are assembled). The pointer is valid until
+	// ConsumePacket is called.
+	bool PeekPacket(const char *&outData, uint32_t &outSize);
+	void ConsumePacket(uint32_t inPacketSize);
 
 	// Use these methods instead of Send / Receive in conjunction with
 	// non-blocking methods (e.g. select)
-	bool HasOutgoingData() const;
+	// Every queued packet takes some bytes (its length prefix at least)
+	bool HasOutgoingData() const { return mOutgoingBytes > 0; }
+	bool WantsToWrite() const { return HasOutgoingData() || IsConnecting(); }
+	bool IsAboveHighWaterMark() const { return mOutgoingBytes > mHighWaterMark; }
+
+	// Outgoing bytes queued and not sent yet (safe to call while threaded)
+	uint32_t GetOutgoingBytes() const { return mOutgoingBytes; }
+	// Packets (and control frames) waiting in the lane of a priority,
+	// including the one partially sent (safe to call while threaded)
+	uint32_t GetOutgoingPackets(PacketPriority priority) const { return mOutgoingPacketCounts[static_cast<int>(priority)]; }
+
+	// Whether or not the replies to this peer are backing up: it is
+	// above its high-water mark, or it has something queued and the
+	// budget of the network manager is exhausted. Such peers are not
+	// read until they drain.
+	bool IsBackingUp() const;
+
+	// Traffic of this socket (safe to call while threaded)
+	const TransportStats &GetStats() const { return mStats; }
+	uint64_t GetLifetimeMillis() const;
+
 	void HandleOutgoingData();
-	void HandleIncomingData();
+
+	// It reads as much as fits in the receive buffer, and returns the
+	// bytes read. outMayHaveMore tells whether the read filled the buffer
+	// (otherwise the socket has nothing else to read for now).
+	uint32_t HandleIncomingData(bool &outMayHaveMore);
 
 private:
 
 	friend class SocketUtil;
 
+	// Readiness backends register the descriptor and get notified
+	// whenever the socket starts or stops having outgoing data
+	friend class SocketPoller;
+	friend class EpollSocketPoller;
+	friend class IoUringSocketPoller;
+	void UpdateWriteInterest();
+	void CompleteSend(uint32_t inRequested, int inResult); /**< Of a send handed over to a completion backend. */
+
 	// Only the network manager can call this explicitly
 	friend class TCPNetworkManager;
 	void CloseSocket();
+	int FinishConnect();
+	bool ConnectTimedOut() const;
+
+	// Both take ownership of a packet held in a pooled buffer.
+	// SendBuffer hands it over to the network thread if there is one,
+	// QueuePacket queues (or delivers locally) the packet right away.
+	friend class NetworkThread;
+	bool SendBuffer(PooledBuffer &&inData, uint32_t inSize, PacketPriority inPriority);
+	bool QueuePacket(PooledBuffer &&inData, uint32_t inSize, PacketPriority inPriority);
+	void SendFirstPacket(); /**< After queueing into an empty outgoing queue. */
+	void ClearOutgoingPackets();
+	bool CanQueue(uint32_t inQueuedSize) const;
+	void AddOutgoingBytes(uint32_t inByteCount);
+	void RemoveOutgoingBytes(uint32_t inByteCount);
+
+	// Packets are sent lane after lane (highest priority first), except
+	// the one partially sent, which goes before anything else
+	struct OutgoingPacket;
+	void PushOutgoingPacket(PacketPriority inPriority, OutgoingPacket &&inPacket);
+	void PopOutgoingPacket(int inLane);
+	int SendingLane() const;
+	int GatheredLane() const; /**< First lane with packets in the last send, or -1. */
+	bool GatherPacket(OutgoingPacket &inPacket, RingBufferRegion *outRegions, int &ioRegionCount, uint32_t &ioSkip);
+	void ReleaseSentBytes(uint32_t inSentBytes);
+
+	// Counted both in mStats and in the stats of the network manager
+	void CountSend(uint32_t inRequested, int inResult);
+	void CountReceive(int inResult);
+	void CountPacketSent();
+	void CountPacketDropped();
+	void CountPacketReceived();
+
+	// Local sockets have no descriptor: packets are written straight
+	// into the receive buffer of their peer (see CreateLocalTCPSocketPair).
+	// The ones that do not fit wait in the outgoing lanes until
+	// HandleLocalOutgoingData moves them, which returns whether it did.
+	bool DeliverLocally(const void *inData, uint32_t inSize, PacketPriority inPriority);
+	bool ReceiveLocally(const void *inData, uint32_t inSize);
+	bool HandleLocalOutgoingData();
+	bool IsPeerClosed() const;
+
+	// Packets bigger than the receive buffer are moved into a buffer of
+	// their own as they arrive (local peers hand them over whole).
+	bool StartLargePacket(uint32_t inSize, bool inPlaced);
+	bool AssembleLargePacket();
+	bool DeliverLargePacketLocally(const void *inData, uint32_t inSize);
+	void PeekLargePacket(const char *&outData, uint32_t &outSize);
+
+	// Connections between processes of the same host can move their
+	// packets to a shared memory channel. The connecting end offers it
+	// as soon as it is connected (if FlagOfferSharedMemory is set), and
+	// both ends switch to it from then on. The
+	// TCP connection is still used to wake up a peer blocked in the
+	// readiness backend, to find out when the peer goes away, and for
+	// the packets which do not fit in the channel (empty packets in the
+	// channel keep their place among the others).
+	bool OfferSharedMemory();
+	bool HandleControlFrame(uint32_t inMarker);
+	bool QueueControlFrame(uint32_t inMarker, const void *inData, uint32_t inSize);
+	bool WriteSharedMemory(const void *inData, uint32_t inSize);
+	bool FitsSharedMemory(uint32_t inSize) const;
+	bool PeekSharedMemoryPacket(const char *&outData, uint32_t &outSize);
 
 	TCPSocket(SOCKET inSocket) :
 		mSocket(inSocket),
 		mFlags(0),
-		mOutgoingDataHead(0), mOutgoingDataSendHead(0),
-		mIncomingDataHead(0), mIncomingDataRecvHead(0)
+		mOutgoingBytes(0),
+		mHighWaterMark(DEFAULT_SOCKET_HIGH_WATER_MARK),
+		mIncomingData(DEFAULT_SOCKET_BUFFER_SIZE),
+		mPoller(nullptr),
+		mThread(nullptr),
+		mCreationTime(std::chrono::steady_clock::now()),
+		mOutgoingCapacity(DEFAULT_SOCKET_BUFFER_SIZE),
+		mFrontPacketOffset(0),
+		mFrontPacketLane(0),
+		mLargePacketSize(0),
+		mLargePacketReceived(0),
+		mLargePacketOffset(0),
+		mLargePacketPlaced(false),
+		mPeekedFrom(PeekedIncomingData)
 	{ }
 
 	enum Flag {
 		FlagListening    = 1,
 		FlagDisconnected = 2,
-		FlagToDisconnect = 4
+		FlagToDisconnect = 4,
+		FlagWriteInterest = 8,
+		FlagConnecting   = 16,
+		FlagLocal        = 32,
+		FlagSharedMemory = 64,
+		FlagOfferSharedMemory = 128,
+		FlagSendImmediately = 256,
+		FlagClosed       = 512,  // The descriptor was released
+		FlagConnectFailed = 1024, // Disconnected before the connection was established
+		FlagSending      = 2048  // A completion backend is sending the front packets
 	};
 
+	// Checked for every socket on every call of the network manager,
+	// so they are kept together at the start of the object
 	SOCKET mSocket;
-	int mFlags;
+	std::atomic<int> mFlags; /**< Also read by the main thread if there is a network thread. */
+	std::atomic<uint32_t> mOutgoingBytes; /**< Queued bytes not sent yet (also read by the main thread). */
+	uint32_t mHighWaterMark;   /**< Outgoing bytes above which the socket is backing up. */
+	OutgoingBudgetPtr mBudget; /**< Shared by the sockets of the network manager. */
+
+	// Received data (length prefixed packets)
+	RingBuffer mIncomingData;
+
+	SocketHandle mHandle;  /**< Slot in the socket tables of the network manager. */
+	SocketPoller *mPoller; /**< Readiness backend watching this socket. */
+	NetworkThread *mThread; /**< Network thread running this socket, if any. */
+	std::chrono::steady_clock::time_point mConnectTime; /**< When the connect started. */
+	std::chrono::steady_clock::time_point mCreationTime;
 	SocketAddress mRemoteAddress;
+	SocketAddress mLocalAddress;       /**< Address the socket was bound to. */
+	std::weak_ptr<TCPSocket> mPeer;    /**< Other end of a local socket. */
+
+	// Packet waiting to be sent, with its own length prefix so that the
+	// payload buffer can be sent without copying it
+	struct OutgoingPacket {
+		uint32_t prefix; /**< Length prefix (payload size, or a control frame marker). */
+		uint32_t size;   /**< Payload size. */
+		PooledBuffer data; /**< Payload, owned by the socket. */
+	};
 
-	// Data to be sent
-	size_t mOutgoingDataHead; // Accumulated
-	size_t mOutgoingDataSendHead; // Already sent
-	std::vector<char> mOutgoingData;
+	// Data to be sent by lane, flushed with a single vectored send per call
+	std::deque<OutgoingPacket> mOutgoingPackets[PACKET_PRIORITY_COUNT];
+	std::atomic<uint32_t> mOutgoingPacketCounts[PACKET_PRIORITY_COUNT] = {}; /**< Also read by the main thread. */
+	uint32_t mOutgoingCapacity;  /**< Max queued bytes, prefixes included. */
+	uint32_t mFrontPacketOffset; /**< Bytes of the packet being sent already sent. */
+	int mFrontPacketLane;        /**< Lane of that packet (if mFrontPacketOffset > 0). */
+	uint32_t mGatheredPackets[PACKET_PRIORITY_COUNT] = {}; /**< Packets of each lane in the send in progress. */
 
-	// Received data
-	size_t mIncomingDataHead; // To process
-	size_t mIncomingDataRecvHead; // Already read
-	std::vector<char> mIncomingData;
+	// Copy of the current packet when it is split by the wrap point
+	std::vector<char> mPacketScratch;
+
+	// Packet bigger than the receive buffer, if any
+	PooledBuffer mLargePacket;
+	uint32_t mLargePacketSize;     /**< Its size (0 if there is none). */
+	uint32_t mLargePacketReceived; /**< Bytes of it received so far. */
+	uint32_t mLargePacketOffset;   /**< Bytes in mIncomingData that go before it. */
+	bool mLargePacketPlaced;       /**< It waits for its empty packet in mSharedMemory. */
+
+	// Traffic counters, and the ones shared by the sockets of the network manager
+	TransportStats mStats;
+	ConnectionStatsPtr mManagerStats;
+
+	// Packets exchanged with a process of the same host, if any
+	SharedMemoryChannelPtr mSharedMemory;
+
+	// Where the packet being peeked comes from
+	enum PeekedFrom {
+		PeekedIncomingData,
+		PeekedLargePacket,
+		PeekedSharedMemory
+	};
+	PeekedFrom mPeekedFrom;
 };
 
 #endif // TCP_SOCKET_H
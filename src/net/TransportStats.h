@@ -0,0 +1,116 @@
+#ifndef TRANSPORT_STATS_H
+#define TRANSPORT_STATS_H
+
+// Traffic counters of a socket, or of all the sockets of a network
+// manager, since they were created. Updated by the thread doing the
+// socket operations, safe to read from any thread.
+// Bytes and calls only count the socket system calls, while packets
+// also count the ones exchanged by local and shared memory sockets.
+class TransportStats
+{
+public:
+
+	TransportStats() :
+		mBytesSent(0),
+		mBytesReceived(0),
+		mPacketsSent(0),
+		mPacketsReceived(0),
+		mPacketsDropped(0),
+		mSendCalls(0),
+		mReceiveCalls(0),
+		mPartialSends(0)
+	{ }
+
+	uint64_t GetBytesSent() const { return mBytesSent; }
+	uint64_t GetBytesReceived() const { return mBytesReceived; }
+	uint64_t GetPacketsSent() const { return mPacketsSent; }
+	uint64_t GetPacketsReceived() const { return mPacketsReceived; }
+	uint64_t GetPacketsDropped() const { return mPacketsDropped; }
+	uint64_t GetSendCalls() const { return mSendCalls; }
+	uint64_t GetReceiveCalls() const { return mReceiveCalls; }
+	uint64_t GetPartialSends() const { return mPartialSends; }
+
+	// A send call of inRequested bytes which returned inResult
+	void CountSend(uint32_t inRequested, int inResult)
+	{
+		mSendCalls++;
+		if (inResult > 0) {
+			mBytesSent += inResult;
+		}
+		if (inResult >= 0 && static_cast<uint32_t>(inResult) < inRequested) {
+			mPartialSends++;
+		}
+	}
+
+	// A receive call which returned inResult
+	void CountReceive(int inResult)
+	{
+		mReceiveCalls++;
+		if (inResult > 0) {
+			mBytesReceived += inResult;
+		}
+	}
+
+	void CountPacketSent() { mPacketsSent++; }
+	void CountPacketReceived() { mPacketsReceived++; }
+	void CountPacketDropped() { mPacketsDropped++; }
+
+private:
+
+	std::atomic<uint64_t> mBytesSent;
+	std::atomic<uint64_t> mBytesReceived;
+	std::atomic<uint64_t> mPacketsSent;
+	std::atomic<uint64_t> mPacketsReceived;
+	std::atomic<uint64_t> mPacketsDropped; /**< Refused by SendPacket, or by the network thread. */
+	std::atomic<uint64_t> mSendCalls;
+	std::atomic<uint64_t> mReceiveCalls;
+	std::atomic<uint64_t> mPartialSends; /**< Calls which sent less than requested. */
+};
+
+// Connection churn of a network manager, on top of the traffic of all
+// its sockets
+class ConnectionStats : public TransportStats
+{
+public:
+
+	ConnectionStats() :
+		mConnects(0),
+		mConnectFailures(0),
+		mAccepts(0),
+		mDisconnects(0),
+		mLifetimeMillis(0)
+	{ }
+
+	uint64_t GetConnects() const { return mConnects; }
+	uint64_t GetConnectFailures() const { return mConnectFailures; }
+	uint64_t GetAccepts() const { return mAccepts; }
+	uint64_t GetDisconnects() const { return mDisconnects; }
+
+	// Average lifetime of the connections closed so far
+	double GetAverageLifetimeMillis() const
+	{
+		const uint64_t disconnects = mDisconnects;
+		return (disconnects > 0) ? static_cast<double>(mLifetimeMillis) / disconnects : 0.0;
+	}
+
+	void CountConnect() { mConnects++; }
+	void CountConnectFailure() { mConnectFailures++; }
+	void CountAccept() { mAccepts++; }
+	void CountDisconnect(uint64_t inLifetimeMillis)
+	{
+		mLifetimeMillis += inLifetimeMillis;
+		mDisconnects++;
+	}
+
+private:
+
+	std::atomic<uint64_t> mConnects;
+	std::atomic<uint64_t> mConnectFailures;
+	std::atomic<uint64_t> mAccepts;
+	std::atomic<uint64_t> mDisconnects;
+	std::atomic<uint64_t> mLifetimeMillis; /**< Added up over the disconnections. */
+};
+
+typedef std::shared_ptr<ConnectionStats> ConnectionStatsPtr;
+
+#endif // TRANSPORT_STATS_H
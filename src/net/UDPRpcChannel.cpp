@@ -0,0 +1,241 @@
+#include "Net.h"
+
+// Every datagram starts with the request id and the datagram kind
+static const uint32_t RPC_HEADER_SIZE = sizeof(uint32_t) + sizeof(uint8_t);
+
+UDPRpcChannel::UDPRpcChannel() :
+	mDelegate(nullptr),
+	mNextRequestId(1),
+	mReceiveBuffer(MAX_RPC_DATAGRAM_SIZE)
+{
+}
+
+UDPRpcChannel::~UDPRpcChannel()
+{
+}
+
+void UDPRpcChannel::SetDelegate(UDPRpcChannelDelegate *delegate)
+{
+	mDelegate = delegate;
+}
+
+bool UDPRpcChannel::Open(uint16_t port)
+{
+	UDPSocketPtr socket = SocketUtil::CreateUDPSocket(SocketAddressFamily::INET);
+	if (socket == nullptr) {
+		return false;
+	}
+
+	SocketAddress bindAddress(port);
+	socket->SetReuseAddress(true);
+	if (socket->Bind(bindAddress) != NO_ERROR ||
+		socket->SetNonBlockingMode(true) != NO_ERROR)
+	{
+		return false;
+	}
+
+	mSocket = socket;
+	return true;
+}
+
+void UDPRpcChannel::Close()
+{
+	mSocket = nullptr;
+	mPendingRequests.clear();
+	mResponseCache.clear();
+	mResponseCacheOrder.clear();
+}
+
+uint32_t UDPRpcChannel::SendRequest(const std::string &host, uint16_t port, const void *data, uint32_t size)
+{
+	return SendRequest(SocketAddress(host + ":" + std::to_string(port)), data, size);
+}
+
+uint32_t UDPRpcChannel::SendRequest(const SocketAddress &address, const void *data, uint32_t size)
+{
+	if (mSocket == nullptr || RPC_HEADER_SIZE + size > MAX_RPC_DATAGRAM_SIZE) {
+		return 0;
+	}
+
+	const uint32_t requestId = mNextRequestId++;
+	if (mNextRequestId == 0) {
+		mNextRequestId = 1; // 0 is reserved for errors
+	}
+
+	OutputMemoryStream stream(RPC_HEADER_SIZE + size);
+	stream.Write(requestId);
+	stream.Write(DatagramKind::Request);
+	stream.Write(data, size);
+
+	PendingRequest &request = mPendingRequests[requestId];
+	request.address = address;
+	request.datagram.assign(stream.GetBufferPtr(), stream.GetBufferPtr() + stream.GetSize());
+	request.sendTime = std::chrono::steady_clock::now();
+	request.attempts = 1;
+
+	// A lost datagram is recovered by the retransmissions
+	mSocket->SendTo(request.datagram.data(), (int)request.datagram.size(), request.address);
+	return requestId;
+}
+
+int UDPRpcChannel::Update()
+{
+	if (mSocket == nullptr) {
+		return 0;
+	}
+
+	// Process all the datagrams already received
+	int datagramCount = 0;
+	for (;;)
+	{
+		SocketAddress fromAddress;
+		const int receivedBytes = mSocket->ReceiveFrom(mReceiveBuffer.data(), (int)mReceiveBuffer.size(), fromAddress);
+		if (receivedBytes == -WSAECONNRESET) {
+			continue; // An earlier datagram was not delivered (Windows)
+		}
+		if (receivedBytes < 0) {
+			break;
+		}
+		datagramCount++;
+		if ((uint32_t)receivedBytes < RPC_HEADER_SIZE) {
+			continue; // Not for us
+		}
+
+		InputMemoryStream stream(mReceiveBuffer.data(), (uint32_t)receivedBytes);
+		uint32_t requestId;
+		DatagramKind kind;
+		stream.Read(requestId);
+		stream.Read(kind);
+
+		const char *payload = mReceiveBuffer.data() + RPC_HEADER_SIZE;
+		const uint32_t payloadSize = (uint32_t)receivedBytes - RPC_HEADER_SIZE;
+		if (kind == DatagramKind::Request) {
+			HandleRequest(fromAddress, requestId, payload, payloadSize);
+		} else {
+			HandleResponse(requestId, kind, payload, payloadSize);
+		}
+	}
+
+	RetransmitRequests();
+	ExpireResponses();
+	return datagramCount;
+}
+
+void UDPRpcChannel::HandleRequest(const SocketAddress &from, uint32_t requestId, const char *data, uint32_t size)
+{
+	const ResponseKey key(from, requestId);
+
+	// Retransmitted request, the response was lost: send it again
+	// without processing the request twice
+	auto it = mResponseCache.find(key);
+	if (it != mResponseCache.end())
+	{
+		const std::vector<char> &datagram(it->second.datagram);
+		mSocket->SendTo(datagram.data(), (int)datagram.size(), from);
+		return;
+	}
+
+	OutputMemoryStream response;
+	response.Write(requestId);
+	response.Write(DatagramKind::Response);
+
+	InputMemoryStream request(data, size);
+	const bool handled = mDelegate != nullptr && mDelegate->OnRpcRequest(request, response);
+	if (!handled || response.GetSize() > MAX_RPC_DATAGRAM_SIZE)
+	{
+		response.Clear();
+		response.SetEncoding(StreamEncoding::Fixed);
+		response.Write(requestId);
+		response.Write(DatagramKind::Redirect);
+	}
+
+	CachedResponse &cached = mResponseCache[key];
+	cached.datagram.assign(response.GetBufferPtr(), response.GetBufferPtr() + response.GetSize());
+	cached.time = std::chrono::steady_clock::now();
+	mResponseCacheOrder.push_back(key);
+
+	mSocket->SendTo(cached.datagram.data(), (int)cached.datagram.size(), from);
+}
+
+void UDPRpcChannel::HandleResponse(uint32_t requestId, DatagramKind kind, const char *data, uint32_t size)
+{
+	// Duplicated or late responses are discarded
+	auto it = mPendingRequests.find(requestId);
+	if (it == mPendingRequests.end()) {
+		return;
+	}
+
+	if (kind == DatagramKind::Redirect)
+	{
+		FailRequest(it);
+		return;
+	}
+
+	mPendingRequests.erase(it);
+
+	if (mDelegate != nullptr)
+	{
+		InputMemoryStream response(data, size);
+		mDelegate->OnRpcResponse(requestId, response);
+	}
+}
+
+void UDPRpcChannel::RetransmitRequests()
+{
+	const auto now = std::chrono::steady_clock::now();
+	const auto timeout = std::chrono::milliseconds(RPC_RETRANSMIT_MILLIS);
+
+	for (auto it = mPendingRequests.begin(); it != mPendingRequests.end();)
+	{
+		PendingRequest &request = it->second;
+		if (now - request.sendTime < timeout)
+		{
+			++it;
+		}
+		else if (request.attempts >= RPC_MAX_ATTEMPTS)
+		{
+			auto failedIt = it++;
+			FailRequest(failedIt);
+		}
+		else
+		{
+			mSocket->SendTo(request.datagram.data(), (int)request.datagram.size(), request.address);
+			request.sendTime = now;
+			request.attempts++;
+			++it;
+		}
+	}
+}
+
+void UDPRpcChannel::ExpireResponses()
+{
+	const auto now = std::chrono::steady_clock::now();
+	const auto lifetime = std::chrono::milliseconds(RPC_RESPONSE_CACHE_MILLIS);
+
+	while (!mResponseCacheOrder.empty())
+	{
+		auto it = mResponseCache.find(mResponseCacheOrder.front());
+		if (it != mResponseCache.end())
+		{
+			if (now - it->second.time < lifetime) {
+				break;
+			}
+			mResponseCache.erase(it);
+		}
+		mResponseCacheOrder.pop_front();
+	}
+}
+
+void UDPRpcChannel::FailRequest(std::map<uint32_t, PendingRequest>::iterator it)
+{
+	// Remove it before notifying, the delegate may send new requests
+	const uint32_t requestId = it->first;
+	std::vector<char> datagram;
+	datagram.swap(it->second.datagram);
+	mPendingRequests.erase(it);
+
+	if (mDelegate != nullptr)
+	{
+		mDelegate->OnRpcFailed(requestId, datagram.data() + RPC_HEADER_SIZE, (uint32_t)datagram.size() - RPC_HEADER_SIZE);
+	}
+}
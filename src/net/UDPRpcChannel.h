@@ -0,0 +1,99 @@
+#ifndef UDP_RPC_CHANNEL_H
+#define UDP_RPC_CHANNEL_H
+
+// Largest datagram sent by the RPC channel (kept under the minimum MSS
+// so that requests and responses are never fragmented)
+constexpr uint32_t MAX_RPC_DATAGRAM_SIZE = DEFAULT_STREAM_SIZE;
+
+// Time to wait for a response before sending the request again
+constexpr int RPC_RETRANSMIT_MILLIS = 250;
+
+// Number of times a request is sent before giving up
+constexpr int RPC_MAX_ATTEMPTS = 4;
+
+// Time a response is kept to answer retransmitted requests
+constexpr int RPC_RESPONSE_CACHE_MILLIS = 5000;
+
+class UDPRpcChannelDelegate
+{
+public:
+
+	virtual ~UDPRpcChannelDelegate() { }
+
+	// Server side: it writes the response to the request into the given
+	// stream, or returns false to make the client use TCP instead
+	virtual bool OnRpcRequest(InputMemoryStream &, OutputMemoryStream &) { return false; }
+
+	// Client side
+	virtual void OnRpcResponse(uint32_t, InputMemoryStream &) { }
+
+	// The request could not be completed over UDP (no response after all
+	// the attempts, or the response does not fit in a datagram). The
+	// request data is only valid during the call, to send it over TCP.
+	virtual void OnRpcFailed(uint32_t, const char *, uint32_t) { }
+};
+
+class UDPRpcChannel
+{
+public:
+
+	UDPRpcChannel();
+	~UDPRpcChannel();
+
+	void SetDelegate(UDPRpcChannelDelegate *delegate);
+
+	// Requests are served, and responses received, on the given port
+	bool Open(uint16_t port);
+	void Close();
+	bool IsOpen() const { return mSocket != nullptr; }
+
+	// It returns the id of the request, or 0 if it cannot be sent over
+	// UDP (channel closed or request larger than a datagram)
+	uint32_t SendRequest(const std::string &host, uint16_t port, const void *data, uint32_t size);
+	uint32_t SendRequest(const SocketAddress &address, const void *data, uint32_t size);
+
+	// Serves incoming requests, delivers incoming responses, and sends
+	// again the requests whose response is late. Call it at least once
+	// per frame. It returns the datagrams received.
+	int Update();
+
+	size_t PendingRequestCount() const { return mPendingRequests.size(); }
+
+private:
+
+	enum class DatagramKind : uint8_t {
+		Request,
+		Response,
+		Redirect   /**< The response has to be requested over TCP. */
+	};
+
+	struct PendingRequest {
+		SocketAddress address;
+		std::vector<char> datagram;
+		std::chrono::steady_clock::time_point sendTime;
+		int attempts;
+	};
+
+	typedef std::pair<SocketAddress, uint32_t> ResponseKey; /**< Client address and request id. */
+
+	struct CachedResponse {
+		std::vector<char> datagram;
+		std::chrono::steady_clock::time_point time;
+	};
+
+	void HandleRequest(const SocketAddress &from, uint32_t requestId, const char *data, uint32_t size);
+	void HandleResponse(uint32_t requestId, DatagramKind kind, const char *data, uint32_t size);
+	void RetransmitRequests();
+	void ExpireResponses();
+	void FailRequest(std::map<uint32_t, PendingRequest>::iterator it);
+
+	UDPRpcChannelDelegate *mDelegate;
+	UDPSocketPtr mSocket;
+	uint32_t mNextRequestId;
+	std::vector<char> mReceiveBuffer;
+	std::map<uint32_t, PendingRequest> mPendingRequests;
+	std::map<ResponseKey, CachedResponse> mResponseCache;
+	std::deque<ResponseKey> mResponseCacheOrder; /**< Cached responses, oldest first. */
+};
+
+#endif // UDP_RPC_CHANNEL_H
@@ -30,7 +30,7 @@ int UDPSocket::SendTo(const void *inData, int inLen, const SocketAddress &inTo)
 	else
 	{
 		auto lastError = SocketUtil::GetLastError();
-		if (lastError != EWOULDBLOCK) {
+		if (lastError != WSAEWOULDBLOCK) {
 			SocketUtil::ReportError("UDPSocket::SendTo");
 		}
 		return -lastError;
@@ -48,7 +48,7 @@ int UDPSocket::ReceiveFrom(void *inBuffer, int inLen, SocketAddress &outFrom)
 	else
 	{
 		auto lastError = SocketUtil::GetLastError();
-		if (lastError != EWOULDBLOCK) {
+		if (lastError != WSAEWOULDBLOCK && lastError != WSAECONNRESET) {
 			SocketUtil::ReportError("UDPSocket::ReceiveFrom");
 		}
 		return -lastError;